@@ -0,0 +1,62 @@
+/**
+ * check.c:
+ * Regression checks of the library, run by `make test`: exits non zero
+ * (after logging what's wrong) when any fails.
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "ansipixels.h"
+#include <stdio.h>
+
+// Introducers never completed (Alt-P, Alt-O then a key, a stray UTF-8 lead
+// byte) must not hold the input once it's final. Returns the failures count,
+// adds the checks done to *checks.
+static int check_input(int *checks) {
+    static const struct {
+        const char *in;
+        uint32_t keys[8]; // 0 terminated.
+    } cases[] = {
+        {"\033Phello\033[Aq", {'P', 'h', 'e', 'l', 'l', 'o', INPUT_KEY_UP, 'q'}},
+        {"\033Ox\033OA", {'O', 'x', INPUT_KEY_UP}},
+        {"\033]", {']'}},
+        {"a\xc3", {'a', 0xFFFD}},
+    };
+    int failures = 0;
+    buffer quoted = {0};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        (*checks)++;
+        input_decoder d = {0};
+        buffer in = new_buf(32);
+        append_data(&in, cases[i].in, strlen(cases[i].in));
+        input_event ev[16];
+        int n = input_decode(&d, &in, ev, 16, true), k = 0;
+        while (k < n && k < 8 && cases[i].keys[k] != 0 && ev[k].type == INPUT_KEY && ev[k].key == cases[i].keys[k]) {
+            k++;
+        }
+        if (k != n || (k < 8 && cases[i].keys[k] != 0) || in.size != 0) {
+            LOG_ERROR(
+                "input %s decoded to %d events (%d expected ones), %zu bytes left",
+                debug_data(&quoted, cases[i].in, strlen(cases[i].in)),
+                n,
+                k,
+                in.size
+            );
+            failures++;
+        }
+        free_buf(&in);
+    }
+    free_buf(&quoted);
+    return failures;
+}
+
+int main(void) {
+    int checks = 0;
+    int failures = check_input(&checks);
+    if (failures > 0) {
+        LOG_ERROR("%d of %d checks failed", failures, checks);
+        return 1;
+    }
+    LOG_INFO("All %d checks passed", checks);
+    return 0;
+}
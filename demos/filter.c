@@ -8,10 +8,10 @@
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #include "ansipixels.h"
-#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
@@ -21,13 +21,15 @@
 enum {
 #if DEBUG
     // short on purpose for testing to trigger potential bugs with half complete sequences.
-    BUF_SIZE = 4
+    BUF_SIZE = 4,
+    MAP_WINDOW = BUF_SIZE,
 #else
-    BUF_SIZE = 32768 // Seems fastest on macOS arm64.
+    BUF_SIZE = 32768,     // Seems fastest on macOS arm64.
+    MAP_WINDOW = 1 << 20, // how much of a mapped file is filtered (and written) at once.
 #endif
 };
 
-static buffer quoted = {0};
+static _Thread_local buffer quoted = {0}; // debug logs, per thread for -j.
 
 void usage(const char *prog) {
     fprintf(stderr, "Usage: %s [flags] [filename or stdin]\n", prog);
@@ -36,6 +38,11 @@ void usage(const char *prog) {
     fprintf(stderr, "  -n, --frames <n> stop after filtering n frames (clear screens)\n");
     fprintf(stderr, "  -a, --all        filters all ANSI sequences, leaving only the text content\n");
     fprintf(stderr, "  -p, --pause      pause at the end (implies raw mode for filter itself and a filename)\n");
+    fprintf(stderr, "  -s, --start <n>  start at the nth frame (clear screen) of an indexed recording (record -i)\n");
+    fprintf(stderr, "  -t, --time <s>   start at the last frame before s seconds of an indexed recording\n");
+    fprintf(stderr, "  -r, --replay <x> replay an indexed recording in real time at x speed (e.g 0.5, 2, 10 or\n");
+    fprintf(stderr, "                   0 for max), skipping to the next due frame when the output can't keep up\n");
+    fprintf(stderr, "  -j, --jobs <n>   filter a file with n threads (0 for one per core), output in order\n");
 }
 
 typedef enum filter_mode {
@@ -43,123 +50,355 @@ typedef enum filter_mode {
     FILTER_ALL      // filter all ANSI sequences, leaving only the text content
 } filter_mode;
 
-// Returns >0 if the clear screen sequence was found (ending at that
-// returned position, not transferred to output), otherwise 0.
-int filter(buffer *input, buffer *output, filter_mode mode, bool eof) {
-    while (true) {
-        char *data = input->data + input->start;
-        int size = (int)input->size;
-        char *esc = memchr(data, '\x1b', size);
-        if (esc != NULL) {
-            size = esc - data;
+typedef struct filter_state {
+    filter_mode mode;
+    iov_batch *output;
+    const char *in, *in_end; // chunk being fed, kept tokens in it are written from there without copy.
+    buffer pending;          // clear screen sequence held back until after the pause (default mode).
+    bool clear_screen;       // found a clear screen (new frame).
+} filter_state;
+
+enum {
+    REPLAY_LATE_NS = 50 * 1000 * 1000, // how late before skipping ahead.
+    INPUT_CHECK_NS = 10 * 1000 * 1000, // how often to check for Ctrl-C while pausing at frames (-p).
+};
+
+typedef struct replay {
+    double speed;     // 0 for as fast as possible.
+    uint64_t start;   // now_ns() when the replay (re)started.
+    uint64_t base_ts; // recording timestamp at start.
+    bool started;
+    int dropped; // number of times output was skipped ahead.
+} replay;
+
+// Starts the replay clock over from the current chunk (e.g after a pause).
+static void replay_rebase(replay *rp) { rp->started = false; }
+
+// Waits until the chunk just read from rec is due (absolute deadlines so there
+// is no drift). If already too late, seeks to the last clear screen frame that
+// is due and returns true: the chunk must then be dropped.
+static bool replay_wait(replay *rp, rec_reader *rec) {
+    if (rp->speed <= 0) {
+        return false;
+    }
+    uint64_t now = now_ns();
+    if (!rp->started || rec->ts < rp->base_ts) {
+        rp->start = now;
+        rp->base_ts = rec->ts;
+        rp->started = true;
+        return false;
+    }
+    uint64_t deadline = rp->start + (uint64_t)((double)(rec->ts - rp->base_ts) / rp->speed);
+    if (now < deadline) {
+        sleep_until_ns(deadline);
+        return false;
+    }
+    if (now - deadline < REPLAY_LATE_NS) {
+        return false;
+    }
+    const rec_frame *f = rec_find_time(rec, rp->base_ts + (uint64_t)((double)(now - rp->start) * rp->speed));
+    if (f == NULL || f->chunk_offset < rec->next) {
+        return false; // no full frame to skip to, keep going.
+    }
+    LOG_DEBUG("Replay %.1fms late, skipping to frame at %.3fs", (double)(now - deadline) / 1e6, (double)f->ts / 1e9);
+    rec_seek(rec, f);
+    rp->dropped++;
+    return true;
+}
+
+static void keep_token(filter_state *st, const ansi_token *t) {
+    if (t->data >= st->in && t->data < st->in_end) {
+        iov_ref(st->output, t->data, t->size);
+    } else {
+        iov_copy(st->output, t->data, t->size); // spanned chunks, only in the tokenizer buffer.
+    }
+}
+
+// Tokenizer callback: transfers the tokens to keep to the output.
+// Stops (returns 1) at a clear screen and after an end of synchronized output.
+static int filter_token(void *ctx, const ansi_token *t) {
+    filter_state *st = ctx;
+    bool keep = false;
+    switch (t->type) {
+    case ANSI_TEXT:
+        keep = true;
+        break;
+    case ANSI_ESC:
+        LOG_DEBUG("Found ESC sequence %s", debug_data(&quoted, t->data, t->size));
+        // DECPAM/DECPNM (ESC > and ESC =) and SCS (ESC ( x, ESC ) x) are dropped in all modes,
+        // others (e.g DECSC/DECRC ESC 7 and ESC 8) are kept in the default mode.
+        // Malformed ones (0 final) are dropped too.
+        keep = st->mode == FILTER_DEFAULT && t->final != 0 && t->final != '>' && t->final != '=' &&
+               t->intermediate != '(' && t->intermediate != ')';
+        break;
+    case ANSI_CSI: {
+        LOG_DEBUG("Found CSI sequence %s", debug_data(&quoted, t->data, t->size));
+        if (t->final == 'J') {
+            st->clear_screen = true;
+            if (st->mode == FILTER_DEFAULT) {
+                append_data(&st->pending, t->data, t->size);
+            }
+            return 1;
         }
-        LOG_DEBUG(
-            "Filtering %s (%d bytes), esc at %zd", debug_buf(&quoted, *input), size, esc != NULL ? esc - data : -1
-        );
-        // part before first escape character, possibly all of it if no escape character found
-        transfer(output, input, size);
-        data = input->data + input->start; // update data pointer after transfer
-        if (esc == NULL) {
-            // No ANSI sequences, we just copied input to output, nothing left in input.
-            LOG_DEBUG("No ANSI sequence found, transferred all %d bytes to output", size);
-            assert(input->size == 0);
-            return 0;
+        bool is_sync = t->prefix == '?' && t->n_params == 1 && t->params[0] == 2026 && t->intermediate == 0 &&
+                       (t->final == 'h' || t->final == 'l');
+        // Keep non-query non status non kitty CSI in default mode (for colors/cursor moves).
+        // And do also keep \033[?2026h and \033[?2026l (avoids flickering).
+        keep = st->mode == FILTER_DEFAULT && t->final != 'n' && t->final != 'c' && t->final != 'u' &&
+               (t->prefix != '?' || is_sync);
+        if (keep && is_sync && t->final == 'l') {
+            // it's an end sync, let's emit.
+            keep_token(st, t);
+            return 1;
         }
-        size = (int)input->size; // update size after transfer
-        LOG_DEBUG("Input post transfer is now %s", debug_buf(&quoted, *input));
-        if (size < 3) {
-            LOG_DEBUG("Not enough data to contain a full ANSI sequence, waiting for more data to read");
-            // Not enough data to contain a full ANSI sequence, wait for more data to read.
-            // if we found no (new) data and we reached EOF, it's an error, otherwise just wait for more data.
-            return eof ? -1 : 0;
+        break;
+    }
+    case ANSI_STRING: // OSC, DCS etc... are dropped in all modes.
+        LOG_DEBUG("Found string sequence ESC %c of %zu bytes", t->final, t->size);
+        break;
+    }
+    if (keep) {
+        keep_token(st, t);
+    }
+    return 0;
+}
+
+// Filters a chunk with tok (its own or the previous chunk's), until its end.
+static void filter_chunk(filter_state *st, ansi_tokenizer *tok, const char *data, size_t n, int *frames) {
+    tok->ctx = st;
+    st->in = data;
+    st->in_end = data + n;
+    while (n > 0) {
+        st->clear_screen = false;
+        size_t used = ansi_feed(tok, data, n);
+        data += used;
+        n -= used;
+        if (st->clear_screen) {
+            (*frames)++;
+            iov_copy(st->output, st->pending.data + st->pending.start, st->pending.size);
+            clear_buf(&st->pending);
         }
-        int c = data[1]; // should be ESC, we assert it:
-        LOG_DEBUG("Found ANSI sequence starting with ESC %d (%c)", c, c);
-        switch (c) {
-        case '>':
-        case '=': // DECPAM/DECPNM we ignore in all modes.
-            LOG_DEBUG("Found DECPAM/DECPNM sequence ESC %c", c);
-            consume(input, 2); // remove ESC and the > or = byte
-            continue;
-        case '7':
-        case '8': // DECSC/DECRC save/restore cursor position.
-            LOG_DEBUG("Found DECSC/DECRC sequence ESC %c", c);
-            if (mode == FILTER_ALL) {
-                consume(input, 2); // remove ESC and the 7/8 byte
-            } else {
-                transfer(output, input, 2);
-            }
-            continue;
-        case '[': // CSI sequence.
-            LOG_DEBUG("Found CSI sequence: %s", debug_buf(&quoted, *input));
-            // CSI ends at a final byte in the 0x40..0x7E range.
-            for (int i = 2; i < size; i++) {
-                c = data[i];
-                if (c >= 0x40 && c <= 0x7E) {
-                    char start = data[2];
-                    LOG_DEBUG("Found end of ANSI sequence %c, starts %c at %d, continuing", c, start, i);
-                    if (c == 'J') {
-                        return i + 1;
-                    }
-                    // TODO: Would strncmp like of ?2026 be faster/better?
-                    bool is_sync = false;
-                    if (mode == FILTER_DEFAULT && c != 'n' && c != 'c' && c != 'u' &&
-                        (start != '?' || (is_sync =
-                                              (i == 7 && (c == 'h' || c == 'l') && data[3] == '2' && data[4] == '0' &&
-                                               data[5] == '2' && data[6] == '6')))) {
-                        // Keep non-query non status non kitty CSI in default mode (for colors/cursor moves).
-                        // And do also keep \033[?2026h and \033[?2026l (avoids flickering).
-                        transfer(output, input, i + 1);
-                        if (is_sync && c == 'l') {
-                            // it's an end sync, let's emit.
-                            return 0;
-                        }
-                    } else {
-                        // Drop all CSI in all-mode and query CSI in default mode.
-                        consume(input, i + 1);
-                    }
-                    goto next_iteration;
-                }
-            }
-            LOG_DEBUG("Did not find end of CSI sequence, waiting for more data to read eof=%d", eof);
-            return eof ? -1 : 0;
-        case ']': // OSC sequence, yank it until BEL or ST (ESC \)
-            LOG_DEBUG("Found OSC sequence: %s", debug_buf(&quoted, *input));
-            for (int i = 2; i < size; i++) {
-                c = data[i];
-                if (c == '\a' || (c == '\\' && data[i - 1] == '\x1b')) {
-                    LOG_DEBUG("Found end of OSC sequence at %d, continuing", i);
-                    consume(input, i + 1);
-                    goto next_iteration;
-                }
-            }
-            LOG_DEBUG("Did not find end of OSC sequence, waiting for more data to read");
-            return eof ? -1 : 0;
-        case 'P': // DCS sequence, yank until ST (ESC \)
-            LOG_DEBUG("Found DCS sequence: %s", debug_buf(&quoted, *input));
-            for (int i = 2; i < size; i++) {
-                c = data[i];
-                if (c == '\\' && data[i - 1] == '\x1b') {
-                    LOG_DEBUG("Found end of DCS sequence at %d, continuing", i);
-                    consume(input, i + 1);
-                    goto next_iteration;
-                }
+    }
+}
+
+// --- Parallel mode (-j): the input is cut in chunks at resync points (frames
+// of indexed recordings, ESC bytes otherwise) that a pool of threads filter,
+// each taking the next chunk as it's done, while the main thread writes their
+// outputs in order. A chunk is filtered assuming no sequence spans its start:
+// when the previous one ends in the middle of one anyway (e.g the ESC was a
+// string's ST) it's filtered again continuing the previous tokenizer.
+
+enum { PAR_SLOTS_PER_JOB = 4 }; // chunks in flight per thread, bounds the memory used.
+
+typedef struct par_chunk {
+    const char *data;
+    size_t size;
+    buffer copy; // recordings: the chunk's output, read by the worker.
+    iov_batch out;
+    filter_state st;
+    ansi_tokenizer tok;
+    int frames;
+    bool done;
+} par_chunk;
+
+typedef struct par_job {
+    const char *map; // mapped input, cut at offsets...
+    size_t *offsets;
+    rec_reader *rec; // ...or recording, cut at frames (the last one NULL for the end).
+    rec_frame *frames;
+    size_t n_chunks;
+    par_chunk *slots;
+    size_t n_slots;
+    pthread_mutex_t mu;
+    pthread_cond_t cond; // a chunk is done or a slot was freed.
+    size_t next, written;
+    bool stop; // error.
+} par_job;
+
+static void *par_worker(void *arg) {
+    par_job *j = arg;
+    rec_reader *rec = j->rec != NULL ? rec_clone(j->rec) : NULL;
+    for (;;) {
+        pthread_mutex_lock(&j->mu);
+        while (!j->stop && j->next < j->n_chunks && j->next >= j->written + j->n_slots) {
+            pthread_cond_wait(&j->cond, &j->mu);
+        }
+        if (j->stop || j->next == j->n_chunks) {
+            pthread_mutex_unlock(&j->mu);
+            break;
+        }
+        size_t k = j->next++;
+        pthread_mutex_unlock(&j->mu);
+        par_chunk *c = &j->slots[k % j->n_slots];
+        if (rec != NULL) {
+            clear_buf(&c->copy);
+            const rec_frame *to = k + 1 < j->n_chunks ? &j->frames[k + 1] : NULL;
+            if (rec_read_frames(rec, &c->copy, &j->frames[k], to) < 0) {
+                LOG_ERROR("Error reading recording: %s", strerror(errno));
+                clear_buf(&c->copy);
             }
-            LOG_DEBUG("Did not find end of DCS sequence, waiting for more data to read");
-            return eof ? -1 : 0;
-        case '(':
-        case ')': // SCS sequence, we ignore it in all modes, it's followed by an extra character.
-            LOG_DEBUG("Found SCS sequence ESC %c", c);
-            consume(input, 3); // remove ESC and the ( or ) byte
+            c->data = c->copy.data + c->copy.start;
+            c->size = c->copy.size;
+        } else {
+            c->data = j->map + j->offsets[k];
+            c->size = j->offsets[k + 1] - j->offsets[k];
+        }
+        c->frames = 0;
+        ansi_init(&c->tok, filter_token, &c->st);
+        filter_chunk(&c->st, &c->tok, c->data, c->size, &c->frames);
+        pthread_mutex_lock(&j->mu);
+        c->done = true;
+        pthread_cond_broadcast(&j->cond);
+        pthread_mutex_unlock(&j->mu);
+    }
+    rec_close_reader(rec);
+    free_buf(&quoted);
+    return NULL;
+}
+
+// Chunks of about MAP_WINDOW bytes starting at an ESC (not followed by
+// backslash: most likely a string terminator).
+static size_t par_cut_map(const char *map, size_t size, size_t **offsets) {
+    size_t n = 0, cap = size / MAP_WINDOW + 2;
+    *offsets = malloc(cap * sizeof(size_t));
+    (*offsets)[n++] = 0;
+    size_t pos = MAP_WINDOW;
+    while (pos < size) {
+        const char *p = scan_esc(map + pos, size - pos);
+        if (p == NULL) {
+            break;
+        }
+        size_t off = (size_t)(p - map);
+        if (off + 1 < size && map[off + 1] == '\\') {
+            pos = off + 1;
             continue;
-        default:
-            LOG_ERROR("Found other ANSI sequence starting with ESC %d %c - please report a bug", c, c);
-            debug_print_buf(*input);
-            return -1;
         }
-    next_iteration:
-        continue;
+        if (n + 1 == cap) {
+            cap *= 2;
+            *offsets = realloc(*offsets, cap * sizeof(size_t));
+        }
+        (*offsets)[n++] = off;
+        pos = off + MAP_WINDOW;
+    }
+    (*offsets)[n] = size;
+    return n;
+}
+
+// Chunks of about MAP_WINDOW bytes of chunk data, starting at frames.
+static size_t par_cut_rec(const rec_reader *rec, rec_frame **frames) {
+    size_t n = 0;
+    *frames = malloc((rec->n_frames + 1) * sizeof(rec_frame));
+    (*frames)[n++] = (rec_frame){.chunk_offset = REC_HEADER_SIZE};
+    for (size_t i = 0; i < rec->n_frames; i++) {
+        if (rec->frames[i].chunk_offset - (*frames)[n - 1].chunk_offset >= MAP_WINDOW) {
+            (*frames)[n++] = rec->frames[i];
+        }
     }
+    return n;
+}
+
+static int filter_parallel(filter_mode mode, int jobs, const buffer *map, rec_reader *rec) {
+    par_job j = {.rec = rec};
+    if (rec != NULL) {
+        j.n_chunks = par_cut_rec(rec, &j.frames);
+    } else {
+        j.map = map->data + map->start;
+        j.n_chunks = par_cut_map(j.map, map->size, &j.offsets);
+    }
+    j.n_slots = (size_t)jobs * PAR_SLOTS_PER_JOB;
+    j.slots = calloc(j.n_slots, sizeof(par_chunk));
+    for (size_t i = 0; i < j.n_slots; i++) {
+        par_chunk *c = &j.slots[i];
+        iov_init(&c->out);
+        c->st = (filter_state){.mode = mode, .output = &c->out, .pending = new_buf(16)};
+    }
+    pthread_mutex_init(&j.mu, NULL);
+    pthread_cond_init(&j.cond, NULL);
+    pthread_t *threads = calloc((size_t)jobs, sizeof(pthread_t));
+    int started = 0;
+    while (started < jobs && pthread_create(&threads[started], NULL, par_worker, &j) == 0) {
+        started++;
+    }
+    LOG_INFO(
+        "Filtering %zu chunks with %d threads, %s mode", j.n_chunks, started, mode == FILTER_ALL ? "all" : "default"
+    );
+    ansi_tokenizer carry; // tokenizer at the end of the last written chunk.
+    bool carried = false;
+    size_t total_read = 0, total_written = 0, refiltered = 0;
+    int frames = 0, ret = started > 0 ? 0 : 1;
+    for (size_t k = 0; k < j.n_chunks && ret == 0; k++) {
+        par_chunk *c = &j.slots[k % j.n_slots];
+        pthread_mutex_lock(&j.mu);
+        while (!c->done) {
+            pthread_cond_wait(&j.cond, &j.mu);
+        }
+        pthread_mutex_unlock(&j.mu);
+        if (carried && ansi_in_sequence(&carry)) {
+            // A sequence spans the chunks: the speculative output is wrong.
+            LOG_DEBUG("Chunk %zu starts in a sequence, filtering it again", k);
+            iov_free(&c->out);
+            iov_init(&c->out);
+            clear_buf(&c->st.pending);
+            ansi_free(&c->tok);
+            c->tok = carry;
+            c->frames = 0;
+            filter_chunk(&c->st, &c->tok, c->data, c->size, &c->frames);
+            refiltered++;
+        } else if (carried) {
+            ansi_free(&carry);
+        }
+        ssize_t m = c->out.size > 0 ? iov_flush(&c->out, STDOUT_FILENO) : 0;
+        if (m < 0) {
+            LOG_ERROR("Error writing output: %s", strerror(errno));
+            ret = 1;
+        }
+        total_read += c->size;
+        total_written += m > 0 ? (size_t)m : 0;
+        frames += c->frames;
+        carry = c->tok;
+        carried = true;
+        pthread_mutex_lock(&j.mu);
+        c->done = false;
+        j.written++;
+        j.stop = ret != 0;
+        pthread_cond_broadcast(&j.cond);
+        pthread_mutex_unlock(&j.mu);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (carried) {
+        if (ret == 0 && ansi_in_sequence(&carry)) {
+            LOG_ERROR(
+                "Unterminated ANSI sequence at end of input: %zu: %s",
+                carry.seq.size,
+                debug_buf(&quoted, slice_buf(carry.seq, 0, 20))
+            );
+        }
+        ansi_free(&carry);
+    }
+    LOG_INFO(
+        "Total read: %zu bytes, written : %zu bytes, frames processed: %d, chunks filtered again: %zu",
+        total_read,
+        total_written,
+        frames,
+        refiltered
+    );
+    for (size_t i = 0; i < j.n_slots; i++) {
+        iov_free(&j.slots[i].out);
+        free_buf(&j.slots[i].st.pending);
+        free_buf(&j.slots[i].copy);
+        if (j.slots[i].done) {
+            ansi_free(&j.slots[i].tok); // filtered but not written (error).
+        }
+    }
+    pthread_mutex_destroy(&j.mu);
+    pthread_cond_destroy(&j.cond);
+    free(threads);
+    free(j.slots);
+    free(j.offsets);
+    free(j.frames);
+    return ret;
 }
 
 int main(int argc, char **argv) {
@@ -170,6 +409,10 @@ int main(int argc, char **argv) {
         {"all", no_argument, 0, 'a'},
         {"frames", required_argument, 0, 'n'},
         {"pause", no_argument, 0, 'p'},
+        {"start", required_argument, 0, 's'},
+        {"time", required_argument, 0, 't'},
+        {"replay", required_argument, 0, 'r'},
+        {"jobs", required_argument, 0, 'j'},
         // terminator
         {0, 0, 0, 0}
     };
@@ -179,8 +422,13 @@ int main(int argc, char **argv) {
     filter_mode mode = FILTER_DEFAULT;
     bool pause_at_end = false;
     int frames_limit = -1; // default to no frame limit
+    int start_frame = 0;   // 1 for the first frame, 0 to not seek
+    double start_time = -1;
+    replay rp = {0};
+    bool replaying = false;
+    int jobs = -1; // sequential
 
-    while ((opt = getopt_long(argc, argv, "han:p", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "han:ps:t:r:j:", long_options, &option_index)) != -1) {
         switch (opt) {
         case 'h':
             usage(argv[0]);
@@ -194,6 +442,22 @@ int main(int argc, char **argv) {
         case 'p':
             pause_at_end = true;
             break;
+        case 's':
+            start_frame = atoi(optarg);
+            break;
+        case 't':
+            start_time = atof(optarg);
+            break;
+        case 'r':
+            replaying = true;
+            rp.speed = atof(optarg);
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs <= 0) {
+                jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            break;
         default: // '?' for unknown option
             fprintf(stderr, "Error: unknown flag\n");
             usage(argv[0]);
@@ -203,6 +467,7 @@ int main(int argc, char **argv) {
     int ifile = STDIN_FILENO; // default to stdin if no file provided
     char *name = "stdin";
     ap_t ap = NULL;
+    rec_reader *rec = NULL; // if the input is an indexed recording.
     if (optind < argc) {
         name = argv[optind];
         ifile = open(name, O_RDONLY);
@@ -210,6 +475,37 @@ int main(int argc, char **argv) {
             LOG_ERROR("Error opening input file '%s': %s", name, strerror(errno));
             return 1;
         }
+        rec = rec_open(ifile);
+        if (rec == NULL && errno != 0) {
+            return 1; // error already logged
+        }
+    }
+    if ((start_frame > 0 || start_time >= 0 || replaying) && rec == NULL) {
+        LOG_ERROR("%s: Seeking (-s or -t) and replay require an indexed recording (made with record -i)", argv[0]);
+        return 1;
+    }
+    if (jobs > 0 && (pause_at_end || replaying || frames_limit > 0 || start_frame > 0 || start_time >= 0)) {
+        LOG_ERROR("%s: Parallel filtering (-j) can't be combined with -p, -r, -n, -s or -t", argv[0]);
+        return 1;
+    }
+    time_init();
+    if (rec != NULL) {
+        const rec_frame *frame = NULL;
+        if (start_frame > 0) {
+            frame = rec_find_clear(rec, (size_t)(start_frame - 1));
+        } else if (start_time >= 0) {
+            frame = rec_find_time(rec, (uint64_t)(start_time * 1e9));
+        }
+        if (frame != NULL) {
+            LOG_INFO("Starting at frame %zu at %.3fs", rec_clear_count(rec, frame) + 1, (double)frame->ts / 1e9);
+            rec_seek(rec, frame);
+        } else if (start_frame > 0) {
+            LOG_ERROR("Recording '%s' has less than %d frames", name, start_frame);
+            rec_close_reader(rec);
+            return 1;
+        }
+    }
+    if (optind < argc) {
         if (pause_at_end) {
             ap = ap_open();
             if (ap == NULL) {
@@ -234,68 +530,105 @@ int main(int argc, char **argv) {
     );
     size_t totalRead = 0;
     size_t totalWritten = 0;
-    buffer inputbuf = new_buf(BUF_SIZE);
-    buffer outbuf = new_buf(BUF_SIZE);
+    // Regular files are mapped and filtered in place (zero copy), others read in inputbuf.
+    buffer map = {0};
+    bool mapped = rec == NULL && map_buf(ifile, &map);
+    if (jobs > 0 && !mapped && rec == NULL) {
+        LOG_INFO("'%s' can't be mapped (not a regular file or empty), filtering it with one thread", name);
+    } else if (jobs > 0) {
+        int ret = filter_parallel(mode, jobs, &map, rec);
+        rec_close_reader(rec);
+        if (mapped) {
+            unmap_buf(&map);
+        }
+        if (ifile != STDIN_FILENO) {
+            close(ifile);
+        }
+        free_buf(&quoted);
+        return ret;
+    }
+    // The read chunk buffers (input and stdin) from a pool.
+    pool chunks;
+    pool_init(&chunks, BUF_SIZE, 2);
+    buffer inputbuf = new_buf_in(BUF_SIZE, &chunks.alloc);
+    buffer input;
+    iov_batch outbuf;
+    iov_init(&outbuf);
+    filter_state st = {.mode = mode, .output = &outbuf, .pending = new_buf(16)};
+    ansi_tokenizer tok;
+    ansi_init(&tok, filter_token, &st);
     bool continue_processing = true;
-    int new_frame_end_index = 0;
     int frames_count = 0;
-    buffer stdin_buf = new_buf(BUF_SIZE);
-    bool eof = false;
+    buffer stdin_buf = new_buf_in(BUF_SIZE, &chunks.alloc);
+    uint64_t next_input_check = 0; // checking input is a syscall, not worth doing for every chunk.
     do {
-        // Make sure we will eventually find the end (or EOF) even with tiny test buffer size.
-        ssize_t n = read_n(ifile, &inputbuf, BUF_SIZE);
+        // The tokenizer keeps partial sequences itself so the input is always fully consumed.
+        ssize_t n;
+        if (mapped) {
+            n = map.size < MAP_WINDOW ? (ssize_t)map.size : MAP_WINDOW;
+            input = slice_buf(map, 0, (size_t)n);
+            consume(&map, (size_t)n);
+        } else {
+            clear_buf(&inputbuf);
+            n = rec != NULL ? rec_read(rec, &inputbuf, BUF_SIZE) : read_n(ifile, &inputbuf, BUF_SIZE);
+            input = inputbuf;
+            if (n > 0 && replaying && replay_wait(&rp, rec)) {
+                // Skipped ahead to a clear screen: whatever sequence was in progress is gone too.
+                ansi_reset(&tok);
+                continue;
+            }
+        }
         if (n < 0) {
             LOG_ERROR("Error reading input: %s", strerror(errno));
             return 1;
         }
         if (n == 0) {
-            eof = true;
-            if (inputbuf.size == 0) {
-                continue_processing = false; // EOF
-                goto pause_check;
-            }
+            continue_processing = false; // EOF
         }
         totalRead += n;
-        LOG_DEBUG("Read %zd bytes, inputbuf now %s", n, debug_buf(&quoted, inputbuf));
-        new_frame_end_index = filter(&inputbuf, &outbuf, mode, eof);
-        if (new_frame_end_index < 0) {
-            continue_processing = false;
-        } else if (new_frame_end_index > 0) {
-            frames_count++;
-            LOG_DEBUG("Found clear screen sequence offset %d, frames count now %d", new_frame_end_index, frames_count);
-            if (frames_limit > 0 && frames_count >= frames_limit) {
-                LOG_DEBUG("Reached frames limit of %d, stopping processing", frames_limit);
-                continue_processing = false;
+        LOG_DEBUG("Read %zd bytes, input now %s", n, debug_buf(&quoted, input));
+        do {
+            st.clear_screen = false;
+            st.in = input.data + input.start;
+            st.in_end = st.in + input.size;
+            size_t used = ansi_feed(&tok, st.in, input.size);
+            consume(&input, used);
+            if (st.clear_screen) {
+                frames_count++;
+                LOG_DEBUG("Found clear screen sequence, frames count now %d", frames_count);
+                if (frames_limit > 0 && frames_count >= frames_limit) {
+                    LOG_DEBUG("Reached frames limit of %d, stopping processing", frames_limit);
+                    continue_processing = false;
+                }
             }
-        }
-        LOG_DEBUG("Filtered to %zd bytes %s", outbuf.size, debug_buf(&quoted, outbuf));
-        ssize_t m = write_buf(1, outbuf);
-        if (m < 0) {
-            LOG_ERROR("Error writing output: %s", strerror(errno));
-            return 1;
-        }
-        clear_buf(&outbuf); // reset output buffer for reuse
-        totalWritten += m;
-        if (new_frame_end_index > 0) {
-            LOG_DEBUG("Outputting filtered clear screen sequence and text content until next frame");
-            if (mode == FILTER_ALL) {
-                // remove the clear screen sequence (filter all).
-                consume(&inputbuf, new_frame_end_index);
-            } else {
-                // add that clear screen to the output buffer for next iteration.
-                transfer(&outbuf, &inputbuf, new_frame_end_index);
+            LOG_DEBUG("Filtered to %zu bytes in %d ranges", outbuf.size, outbuf.n);
+            ssize_t m = outbuf.size > 0 ? iov_flush(&outbuf, 1) : 0;
+            if (m < 0) {
+                LOG_ERROR("Error writing output: %s", strerror(errno));
+                return 1;
             }
-        }
-        compact(&inputbuf); // compact input buffer to avoid unbounded growth if we have a lot of non ANSI data.
-    pause_check:
-        if (pause_at_end) {
-            // Check for Ctrl-C or Ctrl-D without blocking.
-            if (continue_processing && ap_stdin_ready(ap)) {
-                ssize_t stdin_n =
-                    read_buf(STDIN_FILENO, &stdin_buf); // read input only when select() says data is ready
-                if (stdin_n > 0) {
-                    LOG_DEBUG("Read %zd bytes: %s", stdin_n, debug_buf(&quoted, stdin_buf));
-                    if (stdin_buf.data[0] == '\x03' || stdin_buf.data[0] == '\x04') { // Ctrl-C or Ctrl-D
+            totalWritten += m;
+            if (st.clear_screen) {
+                // Output the clear screen (if kept) after the pause, with the next frame.
+                iov_copy(&outbuf, st.pending.data + st.pending.start, st.pending.size);
+                clear_buf(&st.pending);
+            }
+            if (pause_at_end) {
+                // Check for Ctrl-C or Ctrl-D without blocking (at most every INPUT_CHECK_NS).
+                bool check_input = false;
+                if (continue_processing) {
+                    uint64_t now = now_ns();
+                    check_input = now >= next_input_check;
+                    if (check_input) {
+                        next_input_check = now + INPUT_CHECK_NS;
+                    }
+                }
+                input_event ev[16];
+                int n_ev = check_input ? ap_read_events(ap, ev, 16) : 0;
+                for (int i = 0; i < n_ev; i++) {
+                    LOG_DEBUG("Input event %d: %s", ev[i].type, debug_data(&quoted, ev[i].data, ev[i].size));
+                    bool ctrl_c_or_d = (ev[i].mods & INPUT_CTRL) && (ev[i].key == 'c' || ev[i].key == 'd');
+                    if (ev[i].type == INPUT_KEY && ctrl_c_or_d) {
                         ap_move_to(ap, 0, 0);
                         ap_str(ap, STR(RED));
                         ap_str(ap, STR("Exit input request received, exiting..."));
@@ -303,35 +636,46 @@ int main(int argc, char **argv) {
                         ap_end(ap);
                         return 1;
                     }
+                }
+                // Pause at the end (!continued_processing) or if we hit a new frame.
+                if (!continue_processing || st.clear_screen) {
+                    ap_show_cursor(ap);
+                    ap_end(ap);
+                    read_buf(STDIN_FILENO, &stdin_buf); // wait for any input to exit
+                    ap_hide_cursor(ap);
+                    ap_flush(ap);
                     clear_buf(&stdin_buf); // reset input buffer for reuse
+                    replay_rebase(&rp);
                 }
             }
-            // Pause at the end (!continued_processing) or if we hit a new frame.
-            if (!continue_processing || new_frame_end_index > 0) {
-                ap_show_cursor(ap);
-                ap_end(ap);
-                read_buf(STDIN_FILENO, &stdin_buf); // wait for any input to exit
-                ap_hide_cursor(ap);
-                ap_flush(ap);
-                clear_buf(&stdin_buf); // reset input buffer for reuse
-            }
-        }
+        } while (continue_processing && input.size > 0);
     } while (continue_processing);
+    rec_close_reader(rec);
+    if (mapped) {
+        unmap_buf(&map);
+    }
     if (ifile != STDIN_FILENO) {
         close(ifile);
     }
     // always report when no frames_limit or we stopped before the limit.
-    if (inputbuf.size > 0 && frames_count != frames_limit) {
+    if (ansi_in_sequence(&tok) && frames_count != frames_limit) {
         LOG_ERROR(
-            "Unterminated ANSI sequence in input buffer: %zu: %s",
-            inputbuf.size,
-            debug_buf(&quoted, slice_buf(inputbuf, 0, 20))
+            "Unterminated ANSI sequence at end of input: %zu: %s",
+            tok.seq.size,
+            debug_buf(&quoted, slice_buf(tok.seq, 0, 20))
         );
     }
     LOG_INFO("Total read: %zu bytes, written : %zu bytes, frames processed: %d", totalRead, totalWritten, frames_count);
+    if (replaying) {
+        LOG_INFO("Replay at %gx speed skipped ahead %d times to keep up", rp.speed, rp.dropped);
+    }
+    LOG_INFO("Buffers heap allocations: %zu, chunk pool overflows: %d", buf_heap_allocs(), chunks.overflows);
+    ansi_free(&tok);
     free_buf(&quoted);
-    free_buf(&outbuf);
+    iov_free(&outbuf);
     free_buf(&inputbuf);
     free_buf(&stdin_buf);
+    pool_free(&chunks);
+    free_buf(&st.pending);
     return 0;
 }
@@ -11,16 +11,24 @@
 #include <stdio.h>
 #include <unistd.h>
 
+// Whether q was typed (and kept in ap->input by the round trip measurements).
+static bool q_pressed(ap_t ap) {
+    return ap->input.size > 0 && memchr(ap->input.data + ap->input.start, 'q', ap->input.size) != NULL;
+}
+
 int main(int argc, char **argv) {
     int num_iter = 1000 * 1000;
     int time_every = 100 * 1000;
+    bool rtt = false;
 
-    // Manual flag parsing to avoid getopt dependency/complexity for just 2 args
+    // Manual flag parsing to avoid getopt dependency/complexity for just 3 args
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
             num_iter = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
             time_every = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-rtt") == 0) {
+            rtt = true; // use the library's DA1 probes instead of the cursor position requests.
         }
     }
 
@@ -31,11 +39,36 @@ int main(int argc, char **argv) {
     dprintf(STDOUT_FILENO, "Terminal in raw mode - 'q' to exit early\n");
     dprintf(STDOUT_FILENO, "it should end on its own otherwise after %d\n", num_iter);
 
+    buffer quoted = new_buf(32);
+    if (rtt) {
+        // Other input is kept in ap->input instead of confusing the measurement.
+        int iter = 0;
+        while (iter < num_iter && !q_pressed(ap)) {
+            if (ap_rtt_measure(ap, 1, 1000 * 1000 * 1000) != 1) {
+                return LOGF("No answer to the round trip probe");
+            }
+            iter++;
+        }
+        const histogram *h = &ap->rtt.hist;
+        dprintf(
+            STDOUT_FILENO,
+            "%d round trips: min %.3fms avg %.3fms p50 %.3fms p99 %.3fms max %.3fms\n",
+            iter,
+            (double)h->min / 1e6,
+            (double)hist_mean(h) / 1e6,
+            (double)hist_quantile(h, .5) / 1e6,
+            (double)hist_quantile(h, .99) / 1e6,
+            (double)h->max / 1e6
+        );
+        LOG_DEBUG("Other input: %s", debug_buf(&quoted, ap->input));
+        free_buf(&quoted);
+        return 0;
+    }
+
     const char *req = "\033[6n";
     int req_len = strlen(req);
 
     uint64_t now = now_ns();
-    buffer quoted = new_buf(32);
     char buf[80];
     for (int iter = 1; iter <= num_iter; iter++) {
         if (write(STDOUT_FILENO, req, req_len) != req_len) {
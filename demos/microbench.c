@@ -0,0 +1,566 @@
+/**
+ * microbench.c:
+ * Headless micro benchmarks of the hot paths (no terminal needed): formatting
+ * (ns per emitted sequence for the current code against the previous digit at
+ * a time + append_data implementation), buffer appends, mempbrk, the filter
+ * tokenizer and recording compression on rendered workloads, end to end rendering to /dev/null and to
+ * a pty and the pixel encoders. With -json every result is a JSON line, e.g
+ * for `make bench`.
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "ansipixels.h"
+#include "lz4.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+static bool json;
+
+static void report(const char *name, uint64_t elapsed, uint64_t n, double bytes) {
+    double ns = (double)elapsed / (double)n;
+    double per_op = bytes / (double)n;
+    if (json) {
+        printf(
+            "{\"bench\": \"%s\", \"n\": %llu, \"ns_per_op\": %.3f, \"bytes_per_op\": %.2f, \"mb_per_s\": %.1f}\n",
+            name,
+            (unsigned long long)n,
+            ns,
+            per_op,
+            per_op / ns * 1e3
+        );
+    } else {
+        printf("%-26s %10.2f ns/op %10.2f bytes/op %9.1f MB/s\n", name, ns, per_op, per_op / ns * 1e3);
+    }
+    fflush(stdout);
+}
+
+// The original ap_itoa, kept as the baseline.
+static void legacy_itoa(buffer *b, int n) {
+    char buf[16];
+    int sign = n < 0 ? -1 : 1;
+    char *end = buf + sizeof buf - 1;
+    char *p = end;
+    do {
+        *p-- = '0' + sign * (n % 10);
+        n /= 10;
+    } while (n);
+    if (sign < 0) {
+        *p-- = '-';
+    }
+    append_data(b, p + 1, (size_t)(end - p));
+}
+
+static void legacy_move_to(buffer *b, int x, int y) {
+    append_str(b, STR("\033["));
+    legacy_itoa(b, y + 1);
+    append_byte(b, ';');
+    legacy_itoa(b, x + 1);
+    append_byte(b, 'H');
+}
+
+static void legacy_rgb(buffer *b, int r, int g, int bl) {
+    append_str(b, STR("\033[38;2;"));
+    legacy_itoa(b, r);
+    append_byte(b, ';');
+    legacy_itoa(b, g);
+    append_byte(b, ';');
+    legacy_itoa(b, bl);
+    append_byte(b, 'm');
+}
+
+typedef enum bench_kind {
+    ITOA_LEGACY,
+    ITOA,
+    MOVE_TO_LEGACY,
+    MOVE_TO,
+    RGB_LEGACY,
+    RGB,
+    APPEND_DATA,
+    APPEND_BYTE,
+    APPEND_INT,
+} bench_kind;
+
+static const char *bench_names[] = {
+    "itoa/legacy",
+    "itoa/ap_itoa",
+    "move_to/legacy",
+    "move_to/ap_move_to",
+    "rgb/legacy",
+    "rgb/ap_fg",
+    "append/append_data",
+    "append/append_byte",
+    "append/append_int",
+};
+
+static void run(ap_t ap, bench_kind kind, int n) {
+    size_t bytes = 0;
+    clear_buf(&ap->buf);
+    uint64_t start = now_ns();
+    for (int i = 0; i < n; i++) {
+        if ((i & 1023) == 0) {
+            bytes += ap->buf.size;
+            clear_buf(&ap->buf);
+        }
+        int x = i % 200;
+        int y = (i / 200) % 60;
+        switch (kind) {
+        case ITOA_LEGACY:
+            legacy_itoa(&ap->buf, i & 0xFFFF);
+            break;
+        case ITOA:
+            ap_itoa(ap, i & 0xFFFF);
+            break;
+        case MOVE_TO_LEGACY:
+            legacy_move_to(&ap->buf, x, y);
+            break;
+        case MOVE_TO:
+            ap->cx = ap->cy = -1; // force the absolute CUP (the relative one would be even shorter)
+            ap_move_to(ap, x, y);
+            break;
+        case RGB_LEGACY:
+            legacy_rgb(&ap->buf, i & 0xFF, (i >> 3) & 0xFF, (i >> 5) & 0xFF);
+            break;
+        case RGB:
+            ap_fg(ap, AP_COLOR_RGB(i & 0xFF, (i >> 3) & 0xFF, (i >> 5) & 0xFF));
+            ap_apply_style(ap);
+            break;
+        case APPEND_DATA:
+            append_data(&ap->buf, "0123456789abcdef", 1 + (i & 15));
+            break;
+        case APPEND_BYTE:
+            append_byte(&ap->buf, (char)('a' + (i & 15)));
+            break;
+        case APPEND_INT:
+            append_int(&ap->buf, i);
+            break;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    bytes += ap->buf.size;
+    report(bench_names[kind], elapsed, (uint64_t)n, (double)bytes);
+}
+
+// Scans 64KB of text for the filter's sequence introducers: ops are whole scans.
+static void run_mempbrk(int n) {
+    enum { SIZE = 64 * 1024 };
+    char *text = malloc(SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        text[i] = (char)(' ' + i % 95);
+    }
+    text[SIZE - 1] = '\033';
+    static const char *names[] = {"mempbrk/1", "mempbrk/2", "mempbrk/4", "mempbrk/6"};
+    static const int lens[] = {1, 2, 4, 6};
+    const char accept[] = "\033\x9b\x90\x9d\x07\x18";
+    for (int k = 0; k < 4; k++) {
+        int scans = n / 1000 > 0 ? n / 1000 : 1;
+        size_t found = 0;
+        uint64_t start = now_ns();
+        for (int i = 0; i < scans; i++) {
+            found += (size_t)(mempbrk(text, SIZE, accept, (size_t)lens[k]) - text);
+        }
+        uint64_t elapsed = now_ns() - start;
+        if (found != (size_t)scans * (SIZE - 1)) {
+            LOG_ERROR("mempbrk found the wrong offset %zu", found / (size_t)scans);
+        }
+        report(names[k], elapsed, (uint64_t)scans, (double)SIZE * scans);
+    }
+    free(text);
+}
+
+// Decodes a 4MB bracketed paste and 100k mouse motion reports with keys in
+// between: ops are whole passes over the input.
+static void run_input(int n) {
+    static const char *names[] = {"input/paste", "input/mouse"};
+    for (int k = 0; k < 2; k++) {
+        buffer in = new_buf(4 << 20);
+        if (k == 0) {
+            append_str(&in, STR("\033[200~"));
+            while (in.size < (4 << 20)) {
+                append_str(&in, STR("pasted text, with\tsome UTF-8: \xc3\xa9t\xc3\xa9\n"));
+            }
+            append_str(&in, STR("\033[201~"));
+        } else {
+            for (int i = 0; i < 100000; i++) {
+                append_str(&in, STR("\033[<35;"));
+                append_int(&in, i % 200 + 1);
+                append_str(&in, i % 10 == 0 ? STR(";12Mx") : STR(";12M"));
+            }
+        }
+        int passes = n / 100000 > 0 ? n / 100000 : 1;
+        input_event ev[256];
+        uint64_t events = 0;
+        uint64_t start = now_ns();
+        for (int i = 0; i < passes; i++) {
+            input_decoder d = {0};
+            buffer view = in;
+            int got;
+            while ((got = input_decode(&d, &view, ev, 256, true)) > 0) {
+                events += (uint64_t)got;
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        LOG_DEBUG("%s: %.1f events per pass", names[k], (double)events / passes);
+        report(names[k], elapsed, (uint64_t)passes, (double)in.size * passes);
+        free_buf(&in);
+    }
+}
+
+// --- Rendering workloads, drawn in the back grid for frame f.
+
+typedef enum workload {
+    FIRE,   // every cell changes truecolor background every frame.
+    TEXT,   // full screen of scrolling colored text.
+    SPARSE, // a static screen with a counter and a few cells changing.
+} workload;
+
+static const char *workload_names[] = {"fire", "text", "sparse"};
+
+static uint32_t rnd(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+static void draw(ap_t ap, workload wl, int f) {
+    uint32_t seed = (uint32_t)f * 2654435761u;
+    char line[256];
+    switch (wl) {
+    case FIRE:
+        for (int y = 0; y < ap->h; y++) {
+            for (int x = 0; x < ap->w; x++) {
+                uint32_t heat = (uint32_t)(ap->h - y) * 255 / (uint32_t)ap->h;
+                uint32_t r = (heat + rnd(&seed) % 64) & 0xFF;
+                ap_put(ap, x, y, (cell){' ', AP_COLOR_DEFAULT, AP_COLOR_RGB(r, r / 2, r / 8), 0, 0});
+            }
+        }
+        break;
+    case TEXT:
+        for (int y = 0; y < ap->h; y++) {
+            int n = snprintf(
+                line, sizeof(line), "%06d: the quick brown fox jumps over the lazy dog %*s", f + y, (f + y) % 40, "|"
+            );
+            ap_put_str(ap, 0, y, (string){line, (size_t)n}, AP_COLOR_256((f + y) % 256), AP_COLOR_DEFAULT, 0);
+        }
+        break;
+    case SPARSE:
+        if (f == 0) {
+            ap_clear_grid(ap);
+            for (int y = 0; y < ap->h; y += 2) {
+                ap_put_str(ap, 2, y, STR("static dashboard label"), AP_COLOR_256(4), AP_COLOR_DEFAULT, 0);
+            }
+        }
+        int n = snprintf(line, sizeof(line), "frame %d", f);
+        ap_put_str(ap, ap->w - 20, 0, (string){line, (size_t)n}, AP_COLOR_DEFAULT, AP_COLOR_DEFAULT, AP_BOLD);
+        for (int i = 0; i < 3; i++) {
+            ap_put(
+                ap,
+                (int)(rnd(&seed) % (uint32_t)ap->w),
+                (int)(rnd(&seed) % (uint32_t)ap->h),
+                (cell){'*', AP_COLOR_256(rnd(&seed) % 256), AP_COLOR_DEFAULT, 0, 0}
+            );
+        }
+        break;
+    }
+}
+
+// Renders frames of wl to out, reports ns and bytes per frame.
+static void run_render(const char *target, int out, workload wl, int frames) {
+    ap_t ap = ap_new(out, 200, 60);
+    if (ap == NULL) {
+        return;
+    }
+    uint64_t start = now_ns();
+    for (int f = 0; f < frames; f++) {
+        draw(ap, wl, f);
+        ap_present(ap);
+    }
+    uint64_t elapsed = now_ns() - start;
+    ap_stats st;
+    ap_stats_get(ap, &st);
+    char name[64];
+    snprintf(name, sizeof(name), "render/%s/%s", workload_names[wl], target);
+    report(name, elapsed, (uint64_t)frames, (double)st.bytes);
+    ap_free(ap);
+}
+
+static void *drain_pty(void *arg) {
+    int fd = *(int *)arg;
+    char buf[64 * 1024];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static void run_render_pty(workload wl, int frames) {
+    int master, slave;
+    struct winsize ws = {.ws_row = 60, .ws_col = 200};
+    if (openpty(&master, &slave, NULL, NULL, &ws) != 0) {
+        LOG_ERROR("openpty failed: %s", strerror(errno));
+        return;
+    }
+    pthread_t reader;
+    pthread_create(&reader, NULL, drain_pty, &master);
+    run_render("pty", slave, wl, frames);
+    close(slave); // the reader then gets EOF/EIO.
+    pthread_join(reader, NULL);
+    close(master);
+}
+
+// The output of frames of wl as a filter corpus: data with frame start offsets.
+static buffer render_corpus(workload wl, int frames, size_t *offsets) {
+    FILE *tmp = tmpfile();
+    buffer corpus = {0};
+    if (tmp == NULL) {
+        LOG_ERROR("tmpfile failed: %s", strerror(errno));
+        return corpus;
+    }
+    ap_t ap = ap_new(fileno(tmp), 200, 60);
+    for (int f = 0; f < frames; f++) {
+        offsets[f] = (size_t)lseek(fileno(tmp), 0, SEEK_CUR);
+        draw(ap, wl, f);
+        ap_present(ap);
+    }
+    offsets[frames] = (size_t)lseek(fileno(tmp), 0, SEEK_CUR);
+    ap_free(ap);
+    if (!map_buf(fileno(tmp), &corpus)) {
+        LOG_ERROR("Failed to map the %s corpus", workload_names[wl]);
+    }
+    fclose(tmp); // the mapping stays valid.
+    return corpus;
+}
+
+// What the filter keeps in its default mode (text, ESC and CSI but not the
+// queries nor strings), simplified: no frame splitting.
+static int keep_token(void *ctx, const ansi_token *t) {
+    buffer *out = ctx;
+    bool keep = t->type == ANSI_TEXT || (t->type == ANSI_ESC && t->final != 0) ||
+                (t->type == ANSI_CSI && t->final != 'n' && t->final != 'c' && t->final != 'u');
+    if (keep) {
+        append_data(out, t->data, t->size);
+    }
+    return 0;
+}
+
+// Tokenizes and filters the corpus in read() sized chunks: ops are whole passes.
+static void run_filter(workload wl, buffer corpus, int passes) {
+    enum { CHUNK = 32 * 1024 }; // filter's BUF_SIZE.
+    buffer out = new_buf(2 * CHUNK);
+    ansi_tokenizer tok;
+    ansi_init(&tok, keep_token, &out);
+    uint64_t start = now_ns();
+    for (int p = 0; p < passes; p++) {
+        for (size_t off = 0; off < corpus.size; off += CHUNK) {
+            size_t n = corpus.size - off < CHUNK ? corpus.size - off : CHUNK;
+            ansi_feed(&tok, corpus.data + corpus.start + off, n);
+            clear_buf(&out);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    char name[64];
+    snprintf(name, sizeof(name), "filter/%s", workload_names[wl]);
+    report(name, elapsed, (uint64_t)passes, (double)corpus.size * passes);
+    ansi_free(&tok);
+    free_buf(&out);
+}
+
+// LZ4 compression of the corpus in recording blocks: ops are whole passes,
+// throughput in uncompressed bytes. The blocks compressed by the last pass
+// are kept for the decompression ones (checked outside of the timing).
+static void run_lz4(workload wl, buffer corpus, int passes) {
+    const char *data = corpus.data + corpus.start;
+    size_t n_blocks = (corpus.size + REC_BLOCK_SIZE - 1) / REC_BLOCK_SIZE, bound = lz4_bound(REC_BLOCK_SIZE);
+    char *packed = malloc(n_blocks * bound + 1), *out = malloc(REC_BLOCK_SIZE);
+    size_t *sizes = malloc(n_blocks * sizeof(size_t) + 1);
+    size_t total = 0;
+    uint64_t start = now_ns();
+    for (int p = 0; p < passes; p++) {
+        total = 0;
+        for (size_t i = 0, off = 0; off < corpus.size; i++, off += REC_BLOCK_SIZE) {
+            size_t n = corpus.size - off < REC_BLOCK_SIZE ? corpus.size - off : REC_BLOCK_SIZE;
+            sizes[i] = lz4_compress(data + off, n, packed + i * bound);
+            total += sizes[i];
+        }
+    }
+    uint64_t compress = now_ns() - start;
+    for (size_t i = 0, off = 0; off < corpus.size; i++, off += REC_BLOCK_SIZE) {
+        size_t n = corpus.size - off < REC_BLOCK_SIZE ? corpus.size - off : REC_BLOCK_SIZE;
+        if (lz4_decompress(packed + i * bound, sizes[i], out, n) != (ssize_t)n || memcmp(out, data + off, n) != 0) {
+            LOG_ERROR("LZ4 round trip mismatch at %zu", off);
+        }
+    }
+    start = now_ns();
+    for (int p = 0; p < passes; p++) {
+        for (size_t i = 0; i < n_blocks; i++) {
+            lz4_decompress(packed + i * bound, sizes[i], out, REC_BLOCK_SIZE);
+        }
+    }
+    uint64_t decompress = now_ns() - start;
+    char name[64];
+    snprintf(name, sizeof(name), "lz4/compress/%s", workload_names[wl]);
+    report(name, compress, (uint64_t)passes, (double)corpus.size * passes);
+    snprintf(name, sizeof(name), "lz4/decompress/%s", workload_names[wl]);
+    report(name, decompress, (uint64_t)passes, (double)corpus.size * passes);
+    LOG_INFO(
+        "LZ4 %s: %zu bytes compressed to %zu (%.1f%%)",
+        workload_names[wl],
+        corpus.size,
+        total,
+        corpus.size ? 100. * (double)total / (double)corpus.size : 0.
+    );
+    free(packed);
+    free(sizes);
+    free(out);
+}
+
+// Pixel encoders on a w x h animated gradient: ops are whole images.
+static void pattern(image *img, int f) {
+    for (int y = 0; y < img->h; y++) {
+        uint8_t *p = image_at(img, 0, y);
+        for (int x = 0; x < img->w; x++, p += 4) {
+            p[0] = (uint8_t)(x * 256 / img->w + f);
+            p[1] = (uint8_t)(y * 256 / img->h + 2 * f);
+            p[2] = (uint8_t)((x ^ y) + f);
+            p[3] = 255;
+        }
+    }
+}
+
+typedef enum image_kind { HALFBLOCKS, QUADRANTS, KITTY, KITTY_ZLIB, SIXEL } image_kind;
+
+static void run_image(image_kind kind, int frames) {
+    static const char *names[] = {
+        "image/halfblocks", "image/quadrants", "image/kitty", "image/kitty_zlib", "image/sixel"
+    };
+    // Full screen: 200x60 cells of 10x20 pixels for the graphics protocols.
+    int w = kind == HALFBLOCKS ? 200 : kind == QUADRANTS ? 400 : 2000;
+    int h = kind <= QUADRANTS ? 120 : 1200;
+    image img = new_image(w, h);
+    grid g = new_grid(200, 60);
+    buffer out = new_buf(1024);
+    sixel_encoder *enc = sixel_new();
+    uint64_t elapsed = 0, bytes = 0;
+    for (int f = 0; f < frames; f++) {
+        pattern(&img, f);
+        clear_buf(&out);
+        uint64_t start = now_ns();
+        switch (kind) {
+        case HALFBLOCKS:
+            image_halfblocks(&g, 0, 0, &img);
+            break;
+        case QUADRANTS:
+            image_quadrants(&g, 0, 0, &img);
+            break;
+        case KITTY:
+        case KITTY_ZLIB:
+            kitty_encode(&out, &img, 1, kind == KITTY_ZLIB);
+            break;
+        case SIXEL:
+            sixel_encode(enc, &out, &img, 255);
+            break;
+        }
+        elapsed += now_ns() - start;
+        bytes += out.size;
+    }
+    report(names[kind], elapsed, (uint64_t)frames, (double)bytes);
+    sixel_free(enc);
+    free_buf(&out);
+    free_grid(&g);
+    free_image(&img);
+}
+
+// Saves the corpus as a recording (one chunk per frame at 60 fps).
+static void save_corpus(const char *dir, workload wl, buffer corpus, const size_t *offsets, int frames) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.rec", dir, workload_names[wl]);
+    rec_writer *w = rec_create(path, 200, 60);
+    if (w == NULL) {
+        return;
+    }
+    for (int f = 0; f < frames; f++) {
+        rec_write_at(
+            w,
+            w->start + (uint64_t)f * 1000000000 / 60,
+            corpus.data + corpus.start + offsets[f],
+            offsets[f + 1] - offsets[f]
+        );
+    }
+    rec_close_writer(w);
+    LOG_INFO("Wrote %s (%zu bytes of output)", path, corpus.size);
+}
+
+static void usage(const char *prog) {
+    fprintf(
+        stderr,
+        "Usage: %s [-n ops] [-f frames] [-json] [-corpus dir]\n"
+        "  -n ops        iterations of the formatting benchmarks (default 10M)\n"
+        "  -f frames     frames of the rendering and filter benchmarks (default 300)\n"
+        "  -json         one JSON object per result line\n"
+        "  -corpus dir   also save the rendered workloads as dir/{fire,text,sparse}.rec\n",
+        prog
+    );
+}
+
+int main(int argc, char **argv) {
+    int n = 10 * 1000 * 1000;
+    int frames = 300;
+    const char *corpus_dir = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            n = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "-corpus") == 0 && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (n < 1 || frames < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    time_init();
+    // Headless ap: nothing is ever flushed to the output.
+    ap_t headless = ap_new(-1, 200, 60);
+    ensure_cap(&headless->buf, 64 * 1024);
+    for (bench_kind k = ITOA_LEGACY; k <= APPEND_INT; k++) {
+        run(headless, k, n);
+    }
+    ap_free(headless);
+    run_mempbrk(n);
+    run_input(n);
+    int devnull = open("/dev/null", O_WRONLY);
+    size_t *offsets = malloc(sizeof(size_t) * (size_t)(frames + 1));
+    for (workload wl = FIRE; wl <= SPARSE; wl++) {
+        buffer corpus = render_corpus(wl, frames, offsets);
+        if (corpus.size > 0) {
+            run_filter(wl, corpus, 10);
+            run_lz4(wl, corpus, 3);
+            if (corpus_dir != NULL) {
+                save_corpus(corpus_dir, wl, corpus, offsets, frames);
+            }
+        }
+        unmap_buf(&corpus);
+        run_render("devnull", devnull, wl, frames);
+        run_render_pty(wl, frames);
+    }
+    free(offsets);
+    close(devnull);
+    for (image_kind k = HALFBLOCKS; k <= SIXEL; k++) {
+        if (k == KITTY_ZLIB && !AP_ZLIB) {
+            continue;
+        }
+        run_image(k, frames / 10 > 0 ? frames / 10 : 1);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * pixels.c:
+ * Animated full screen image drawn with one of the pixel encoders: half
+ * blocks, quadrants, kitty graphics or sixel. 'q' to exit early.
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "ansipixels.h"
+#include <stdio.h>
+#include <unistd.h>
+
+typedef enum mode { HALF, QUAD, KITTY, SIXEL } mode;
+
+static const char *mode_names[] = {"half", "quad", "kitty", "sixel"};
+
+enum { DETECT_TIMEOUT_NS = 500 * 1000 * 1000 };
+
+static void usage(const char *prog) {
+    fprintf(
+        stderr,
+        "Usage: %s [-m half|quad|kitty|sixel|auto] [-n frames] [-r hz] [-c colors] [-z]\n"
+        "  -m mode     encoder (default half), auto for the best the terminal supports\n"
+        "  -n frames   frames to show (default 300)\n"
+        "  -r hz       frame rate (default 0: as fast as possible)\n"
+        "  -c colors   sixel palette size (default 255)\n"
+        "  -z          zlib compress kitty images (when built with ZLIB=1)\n",
+        prog
+    );
+}
+
+// Animated xor pattern with a moving see through disc.
+static void draw(image *img, int f) {
+    int cx = img->w / 2 + (f * 3) % (img->w / 2 + 1) - img->w / 4, cy = img->h / 2, r = img->h / 4;
+    for (int y = 0; y < img->h; y++) {
+        uint8_t *p = image_at(img, 0, y);
+        for (int x = 0; x < img->w; x++, p += 4) {
+            int dx = x - cx, dy = y - cy;
+            p[0] = (uint8_t)((x * 256 / img->w + f * 4) & 0xFF);
+            p[1] = (uint8_t)((y * 256 / img->h + f * 2) & 0xFF);
+            p[2] = (uint8_t)(((x ^ y) + f) & 0xFF);
+            p[3] = dx * dx + dy * dy < r * r ? 0 : 255;
+        }
+    }
+}
+
+typedef struct pixels {
+    mode m;
+    int frames, colors;
+    bool zlib;
+    int cw, ch;
+    image img;
+    int f; // frames shown.
+} pixels;
+
+static int update(ap_t ap, const ap_frame *fr, void *ctx) {
+    pixels *p = ctx;
+    for (int i = 0; i < fr->n_events; i++) {
+        if (fr->events[i].type == INPUT_KEY && fr->events[i].key == 'q') {
+            return AP_RUN_STOP;
+        }
+    }
+    if (p->f >= p->frames) {
+        return AP_RUN_STOP;
+    }
+    if (fr->tick == 0 || fr->resized) {
+        // Keep the last line free so sixel images never scroll.
+        int w = p->m == HALF ? ap->w : p->m == QUAD ? 2 * ap->w : p->cw * ap->w;
+        int h = p->m == HALF || p->m == QUAD ? 2 * (ap->h - 1) : p->ch * (ap->h - 1);
+        free_image(&p->img);
+        p->img = new_image(w, h);
+        ap_clear_grid(ap);
+        ap_invalidate_all(ap);
+    }
+    return AP_RUN_RENDER | AP_RUN_ANIMATE;
+}
+
+static void render(ap_t ap, const ap_frame *fr, void *ctx) {
+    (void)fr;
+    pixels *p = ctx;
+    draw(&p->img, p->f++);
+    switch (p->m) {
+    case HALF:
+        ap_put_halfblocks(ap, 0, 0, &p->img);
+        ap_present(ap);
+        break;
+    case QUAD:
+        ap_put_quadrants(ap, 0, 0, &p->img);
+        ap_present(ap);
+        break;
+    case KITTY:
+        ap_start(ap);
+        ap_kitty(ap, 0, 0, &p->img, 1, p->zlib); // same id: replaces the previous frame.
+        ap_end(ap);
+        break;
+    case SIXEL:
+        ap_start(ap);
+        ap_sixel(ap, 0, 0, &p->img, p->colors);
+        ap_end(ap);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    pixels p = {.m = HALF, .frames = 300, .colors = 255};
+    double hz = 0;
+    bool detect = false; // -m auto
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            detect = strcmp(name, "auto") == 0;
+            for (p.m = HALF; p.m <= SIXEL && strcmp(name, mode_names[p.m]) != 0; p.m++) {
+            }
+            if (p.m > SIXEL && !detect) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            p.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            p.colors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            hz = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-z") == 0) {
+            p.zlib = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    ap_t ap = ap_open();
+    if (ap == NULL) {
+        return 1; // error already logged
+    }
+    if (ap->w < 1 || ap->h < 2) {
+        return LOGF("Terminal too small");
+    }
+    if (detect) {
+        ap_detect_caps(ap, DETECT_TIMEOUT_NS, true);
+        p.m = (ap->caps & AP_CAP_KITTY_GRAPHICS) ? KITTY : (ap->caps & AP_CAP_SIXEL) ? SIXEL : HALF;
+    }
+    ap_hide_cursor(ap);
+    ap_clear_screen(ap, true);
+    ap_cell_pixels(ap, &p.cw, &p.ch);
+    ap_app app = {.hz = hz, .update = update, .render = render, .ctx = &p};
+    uint64_t start = now_ns();
+    ap_run(ap, &app);
+    double secs = (double)(now_ns() - start) / 1e9;
+    if (p.m == KITTY) {
+        ap_start(ap);
+        ap_kitty_delete(ap, 1);
+        ap_end(ap);
+    }
+    ap_stats st;
+    ap_stats_get(ap, &st);
+    ap_clear_screen(ap, true);
+    ap_show_cursor(ap);
+    dprintf(
+        STDOUT_FILENO,
+        "%s %dx%d pixels: %d frames in %.3fs, %.1f fps, %.0f bytes/frame",
+        mode_names[p.m],
+        p.img.w,
+        p.img.h,
+        p.f,
+        secs,
+        p.f / secs,
+        st.frames ? (double)st.bytes / (double)st.frames : 0.
+    );
+    if (hz > 0) {
+        dprintf(
+            STDOUT_FILENO,
+            ", late p50 %.3fms p99 %.3fms, %llu ticks missed",
+            (double)hist_quantile(&app.late_ns, .5) / 1e6,
+            (double)hist_quantile(&app.late_ns, .99) / 1e6,
+            (unsigned long long)app.missed
+        );
+    }
+    dprintf(STDOUT_FILENO, "\r\n");
+    free_image(&p.img);
+    return 0;
+}
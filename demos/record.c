@@ -3,14 +3,16 @@
  * Intercept and log the I/O of a child process in a pseudo-terminal (PTY),
  * with an optional HUD overlay showing the latest stats.
  *
- * TODO: probably save the terminal size explicitly so filter (replay) can
- * ask the user to match it.
+ * TODO: indexed recordings save the terminal size (rec_reader width and
+ * height) but filter doesn't compare it with the terminal's yet to ask the
+ * user to match it.
  *
  * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #include "ansipixels.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdio.h>
@@ -23,53 +25,303 @@
 #include <pty.h>
 #endif
 
+enum {
+    CHILD_EXIT_WAIT_NS = 1000 * 1000 * 1000, // after the PTY closed, for the exit status.
+    READ_BUF_SIZE = 1 << 16,
+    DEFAULT_HUD_RATE = 30, // HUD updates per second.
+};
+
 void usage(const char *prog) {
     fprintf(stderr, "Usage: %s [flags] program args...\n", prog);
+    fprintf(stderr, "   or: %s --multi [flags] 'command 1' 'command 2'...\n", prog);
     fprintf(stderr, "Flags:\n");
     fprintf(stderr, "  -h, --help    show this help message\n");
     fprintf(stderr, "  -o, --output  save recording of the session to the given file\n");
     fprintf(stderr, "  -H, --hud     enable HUD feature\n");
+    fprintf(stderr, "  -R, --hud-rate  HUD updates per second (default %d, 0 for every output)\n", DEFAULT_HUD_RATE);
+    fprintf(stderr, "  -i, --index   save the output as an indexed recording (timestamps and frames index,\n");
+    fprintf(stderr, "                seekable with filter -s/-t), instead of appending raw bytes\n");
+    fprintf(stderr, "  -m, --multi   record many sessions at once: each argument is a shell command run\n");
+    fprintf(stderr, "                headless (no input, no output), saved to <output>.<n> (n from 1)\n");
+    fprintf(stderr, "  -W, --writer-thread  write the recordings from a background thread, in batches\n");
+    fprintf(stderr, "  -z, --compress  LZ4 compressed indexed recording (implies -i and -W: compressed in the\n");
+    fprintf(stderr, "                  writer thread), filter reads them as the uncompressed ones\n");
 }
 
-// Check if buffer ends with a complete UTF8 and ANSI sequence
+// Feeds the child output to the tokenizer (which tracks ANSI sequences
+// across reads) and checks if it ends with complete UTF8 and ANSI sequences.
 // Returns true if there's an incomplete sequence at the end.
-bool partial_end(const char *buf, size_t len) {
-    if (len == 0) {
-        return false;
+bool partial_end(ansi_tokenizer *tok, const char *buf, size_t len) {
+    ansi_feed(tok, buf, len);
+    if (ansi_in_sequence(tok)) {
+        return true;
     }
-    // If we're inside a UTF-8 multi-byte sequence that's also bad to cut:
-    // Check if the last byte is a UTF-8 continuation byte (0b10xxxxxx)
-    if ((unsigned char)buf[len - 1] >= 0x80) {
-        // ends with UTF-8 high byte: incomplete (even if actually it could be
-        // the last byte of a valid sequence, we treat it as incomplete to be safe)
+    // If we're inside a UTF-8 multi-byte sequence that's also bad to cut.
+    return utf8_partial(buf, len) > 0;
+}
+
+typedef struct recorder recorder;
+
+// One recorded child.
+typedef struct session {
+    recorder *r;
+    int n;           // session number (from 1).
+    int pty;         // -1 once closed.
+    pid_t pid;
+    const char *program;
+    rec_writer *out; // NULL when not saving.
+    bool exited;     // child reaped (or given up on).
+    bool output;     // output was read in the current loop iteration.
+    bool done;
+    int status;      // our exit status for this session.
+    size_t total_written;
+} session;
+
+// All the sessions, sharing the event loop, the read buffer and the optional writer thread.
+struct recorder {
+    ev_loop *loop;
+    session *sessions;
+    int n_sessions;
+    int running;      // sessions not done.
+    rec_queue *queue; // NULL to write from the loop.
+    // Interactive (single session, on our terminal) mode:
+    ap_t ap;
+    bool hud;
+    // track if last child output ends with complete sequence and thus it's ok to
+    // update the HUD, ie to avoid corrupting mid utf8 or csi
+    bool hud_ok;
+    ansi_tokenizer tok;
+    uint64_t hud_interval; // ns between HUD updates.
+    uint64_t next_hud;     // earliest next HUD update.
+    int hud_timer;         // pending HUD update timer, -1 if none.
+    ssize_t last_read, last_written;
+    buffer quoted;
+    size_t total_read;
+    // Child output is read until the PTY is drained (or this is full) so it's
+    // written out and saved in as few calls as possible.
+    char buf[READ_BUF_SIZE];
+};
+
+// Outputs the child's data (if any) with the HUD on top, in one write. The HUD
+// is redrawn at most hud_rate times per second, with a timer for the last update.
+int on_hud_timer(ev_loop *l, int id, int events, void *ctx);
+
+bool output_with_hud(recorder *r, const char *data, size_t len) {
+    // Only update HUD if child output ended with a complete ANSI sequence (and not too often).
+    bool draw = r->hud_ok;
+    uint64_t now = draw ? now_ns() : 0;
+    if (draw && now < r->next_hud) {
+        draw = false;
+        if (r->hud_timer < 0) {
+            r->hud_timer = ev_timer(r->loop, r->next_hud, on_hud_timer, r);
+        }
+    }
+    if (!draw) {
+        if (len > 0 && write_all(1, data, (ssize_t)len) < 0) {
+            LOG_ERROR("Error writing %zu to stdout: %s", len, strerror(errno));
+            return false;
+        }
         return true;
     }
-    // Find the last ESC character (0x1b)
-    int last_esc = -1;
-    for (int i = (int)len - 1; i >= 0; i--) {
-        if ((unsigned char)buf[i] == 0x1b) {
-            last_esc = i;
-            break;
+    if (r->hud_timer >= 0) {
+        ev_cancel(r->loop, r->hud_timer);
+        r->hud_timer = -1;
+    }
+    r->next_hud = now + r->hud_interval;
+    ap_t ap = r->ap;
+    ap_save_cursor(ap);
+    ap_move_to(ap, 0, 0); // move to top
+    // Inverse colors for visibility, and show total read/written
+    ap_attr(ap, AP_INVERSE);
+    ap_str(ap, STR("R: "));
+    ap_itoa(ap, r->last_read);
+    ap_str(ap, STR(" ("));
+    ap_itoa(ap, r->total_read);
+    ap_str(ap, STR("), W: "));
+    ap_itoa(ap, r->last_written);
+    ap_str(ap, STR(" ("));
+    ap_itoa(ap, r->sessions[0].total_written);
+    ap_str(ap, STR(") "));
+    ap_reset_style(ap); // no-op (DECRC restores the child's rendition) but keeps ap's state tidy.
+    ap_restore_cursor(ap);
+    ap_flush_after(ap, data, len);
+    return true;
+}
+
+int on_hud_timer(ev_loop *l, int id, int events, void *ctx) {
+    (void)l, (void)id, (void)events;
+    recorder *r = ctx;
+    r->hud_timer = -1;
+    output_with_hud(r, NULL, 0);
+    return 0;
+}
+
+// Parent's input: send to child (interactive mode).
+int on_stdin(ev_loop *l, int fd, int events, void *ctx) {
+    (void)events;
+    recorder *r = ctx;
+    ssize_t readn = read(fd, r->buf, sizeof(r->buf));
+    if (readn <= 0) {
+        // EOF on stdin (or error), stop monitoring it
+        LOG_DEBUG("stdin closed (read %zd, errno=%d)", readn, errno);
+        ev_del(l, fd);
+        return 0;
+    }
+    LOG_DEBUG("Read %zd bytes from stdin, sending to child %s", readn, debug_data(&r->quoted, r->buf, readn));
+    ssize_t n = write_all(r->sessions[0].pty, r->buf, readn); // send to PTY
+    if (n < 0) {
+        LOG_ERROR("Error writing %zd vs %zd to PTY: %s", n, readn, strerror(errno));
+        return 1;
+    }
+    r->total_read += readn;
+    r->last_read = readn;
+    r->last_written = 0;
+    return output_with_hud(r, NULL, 0) ? 0 : 1;
+}
+
+int on_exit_wait(ev_loop *l, int id, int events, void *ctx) {
+    (void)l, (void)id, (void)events;
+    session *s = ctx;
+    if (!s->exited) {
+        LOG_INFO("Program '%s' closed its terminal but didn't exit, not waiting for it", s->program);
+        s->exited = true;
+    }
+    return 0;
+}
+
+void close_pty(session *s) {
+    ev_del(s->r->loop, s->pty);
+    close(s->pty);
+    s->pty = -1;
+}
+
+// Output from a child.
+int on_pty(ev_loop *l, int fd, int events, void *ctx) {
+    (void)events;
+    session *s = ctx;
+    recorder *r = s->r;
+    // Coalesce what's available (the PTY is non blocking).
+    size_t writen = 0;
+    bool eof = false;
+    while (writen < sizeof(r->buf)) {
+        ssize_t n = read(fd, r->buf + writen, sizeof(r->buf) - writen);
+        if (n > 0) {
+            writen += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EIO) {
+            LOG_ERROR("Error reading PTY %d: %s", s->n, strerror(errno));
+            return 1;
+        }
+        // PTY closed or EIO - child has ended
+        eof = n == 0 || errno == EIO;
+        break;
+    }
+    if (writen > 0) {
+        s->output = true;
+        s->total_written += writen;
+        LOG_DEBUG("Read %zu bytes from PTY %d: %s", writen, s->n, debug_data(&r->quoted, r->buf, writen));
+        if (s->out != NULL) {
+            if (r->queue != NULL) {
+                rec_queue_write(r->queue, s->out, r->buf, writen);
+            } else if (rec_write(s->out, r->buf, writen) < 0) {
+                s->status = 1;
+                return 1; // error already logged
+            }
+        }
+        if (r->ap != NULL) {
+            // Check if child output ends with complete ANSI sequence
+            // we don't even call / check if hud mode is off.
+            r->hud_ok = r->hud && !partial_end(&r->tok, r->buf, writen);
+            r->last_read = 0;
+            r->last_written = (ssize_t)writen;
+            if (!output_with_hud(r, r->buf, writen)) {
+                return 1;
+            }
         }
     }
-    if (last_esc == -1) {
-        // No ESC found, so no incomplete sequence
-        return false;
+    if (eof) {
+        LOG_DEBUG("PTY %d closed (errno=%d), child likely exited", s->n, errno);
+        close_pty(s);
+        ev_timer(l, now_ns() + CHILD_EXIT_WAIT_NS, on_exit_wait, s);
     }
-    // Check if there's a complete sequence end (letter) after the last ESC
-    for (size_t i = last_esc + 1; i < len; i++) {
-        unsigned char c = (unsigned char)buf[i];
-        // ANSI sequences typically end with a letter (A-Z, a-z)
-        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
-            return false; // found complete sequence ending
+    return 0;
+}
+
+// Terminal resize: forward to the child (interactive mode).
+int on_resize(ev_loop *l, int fd, int events, void *ctx) {
+    (void)l, (void)fd, (void)events;
+    recorder *r = ctx;
+    ap_t ap = r->ap;
+    if (!ap_check_resize(ap)) {
+        return 0;
+    }
+    struct winsize current_ws = {ap->h, ap->w, ap->xpixel, ap->ypixel};
+    if (ioctl(r->sessions[0].pty, TIOCSWINSZ, &current_ws) >= 0) {
+        LOG_DEBUG("Forwarded resize: %dx%d", current_ws.ws_col, current_ws.ws_row);
+    } else {
+        LOG_ERROR("Could not set PTY window size: %s", strerror(errno));
+    }
+    return 0;
+}
+
+int on_child(ev_loop *l, int sig, int events, void *ctx) {
+    (void)l, (void)sig, (void)events;
+    recorder *r = ctx;
+    int status;
+    pid_t wpid;
+    while ((wpid = waitpid(-1, &status, WNOHANG)) > 0) {
+        LOG_DEBUG("waitpid returned %d", wpid);
+        for (int i = 0; i < r->n_sessions; i++) {
+            session *s = &r->sessions[i];
+            if (s->pid != wpid) {
+                continue;
+            }
+            // Child exited, log it and finish once its output is drained.
+            if (WIFEXITED(status)) {
+                int status_code = WEXITSTATUS(status);
+                LOG_INFO("Program '%s' exited with status %d", s->program, status_code);
+                s->status = status_code ? 1 : 0;
+            } else if (WIFSIGNALED(status)) {
+                LOG_INFO("Program '%s' was killed by signal %d", s->program, WTERMSIG(status));
+                s->status = 2;
+            }
+            s->exited = true;
         }
     }
-    // Incomplete sequence (ESC followed by non-terminator chars, or nothing)
-    return true;
+    return 0;
+}
+
+int start_session(recorder *r, session *s, char **args, struct winsize *ws) {
+    char path[4096];
+    s->pid = forkpty(&s->pty, path, NULL, ws);
+    if (s->pid < 0) {
+        LOG_ERROR("Error forking process: %s", strerror(errno));
+        return -1;
+    }
+    if (s->pid == 0) {
+        // In child process: execute the requested program
+        LOG_INFO("In child process, executing program '%s' at %dx%d", s->program, ws->ws_col, ws->ws_row);
+        execvp(args[0], args);
+        LOG_ERROR("Error executing program '%s': %s", s->program, strerror(errno));
+        _exit(1);
+    }
+    fcntl(s->pty, F_SETFD, FD_CLOEXEC); // not inherited by the next sessions' children.
+    fcntl(s->pty, F_SETFL, fcntl(s->pty, F_GETFL) | O_NONBLOCK);
+    LOG_INFO("Started program '%s' with PID %d and path '%s'", s->program, s->pid, path);
+    return ev_add(r->loop, s->pty, EV_READ, on_pty, s);
 }
 
 int main(int argc, char **argv) {
     bool hud = false;
+    bool indexed = false;
+    bool multi = false;
+    bool writer_thread = false;
+    bool compress = false;
+    int hud_rate = DEFAULT_HUD_RATE;
     int opt;
     char *ofilename = NULL;
 
@@ -79,13 +331,18 @@ int main(int argc, char **argv) {
         {"help", no_argument, 0, 'h'},
         {"hud", no_argument, 0, 'H'},
         {"output", required_argument, 0, 'o'},
+        {"index", no_argument, 0, 'i'},
+        {"multi", no_argument, 0, 'm'},
+        {"writer-thread", no_argument, 0, 'W'},
+        {"hud-rate", required_argument, 0, 'R'},
+        {"compress", no_argument, 0, 'z'},
         // terminator
         {0, 0, 0, 0}
     };
 
     // Parse flags using getopt_long
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "hHo:", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hHimWzo:R:", long_options, &option_index)) != -1) {
         switch (opt) {
         case 'h':
             usage(argv[0]);
@@ -96,6 +353,21 @@ int main(int argc, char **argv) {
         case 'o': // --output
             ofilename = optarg;
             break;
+        case 'i': // --index
+            indexed = true;
+            break;
+        case 'm': // --multi
+            multi = true;
+            break;
+        case 'W': // --writer-thread
+            writer_thread = true;
+            break;
+        case 'z': // --compress
+            compress = indexed = writer_thread = true;
+            break;
+        case 'R': // --hud-rate
+            hud_rate = atoi(optarg);
+            break;
         default: // '?' for unknown option
             fprintf(stderr, "Error: unknown flag\n");
             usage(argv[0]);
@@ -109,179 +381,127 @@ int main(int argc, char **argv) {
         usage(argv[0]);
         return 1;
     }
-    FILE *ofile = NULL;
-    if (ofilename) {
-        // append mode to avoid overwriting existing file, and to allow multiple runs to log to the same file if
-        // desired.
-        ofile = fopen(ofilename, "a");
-        if (!ofile) {
-            LOG_ERROR("Error opening output file '%s': %s", ofilename, strerror(errno));
-            return 1;
-        }
-        LOG_INFO("Recording session output to '%s'", ofilename);
-    }
-    ap_t ap = ap_open();
-    if (ap == NULL) {
-        return 1; // error already logged
+    if (indexed && !ofilename) {
+        fprintf(stderr, "Error: --index and --compress require --output\n");
+        usage(argv[0]);
+        return 1;
     }
-    // Get the terminal size from ap for the parent terminal
-    struct winsize ws = {ap->h, ap->w, ap->xpixel, ap->ypixel};
-    LOG_INFO("Parent terminal size: %dx%d (%dx%d pixels)", ws.ws_col, ws.ws_row, ws.ws_xpixel, ws.ws_ypixel);
-    char *program = argv[optind];
-    char path[4096];
-    int fd;
-    pid_t pid = forkpty(&fd, path, NULL, &ws);
-    if (pid < 0) {
-        LOG_ERROR("Error forking process: %s", strerror(errno));
+    if (multi && (hud || !ofilename)) {
+        fprintf(stderr, "Error: --multi requires --output and can't be used with --hud\n");
+        usage(argv[0]);
         return 1;
     }
-    if (pid == 0) {
-        // In child process: execute the requested program
-        LOG_INFO("In child process, executing program '%s' at %dx%d", program, ws.ws_col, ws.ws_row);
-        int ret = execvp(program, argv + optind);
-        if (ret < 0) {
-            LOG_ERROR("Error executing program '%s': %s", program, strerror(errno));
-            return 1;
+    recorder r = {.hud = hud, .hud_ok = hud, .hud_timer = -1};
+    r.hud_interval = hud_rate > 0 ? 1000000000ULL / (uint64_t)hud_rate : 0;
+    r.n_sessions = multi ? argc - optind : 1;
+    r.sessions = calloc((size_t)r.n_sessions, sizeof(session));
+    struct winsize ws = {24, 80, 0, 0};
+    if (multi) {
+        // Headless: the sessions get our terminal size if there is one, 80x24 otherwise.
+        ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws);
+    } else {
+        r.ap = ap_open();
+        if (r.ap == NULL) {
+            return 1; // error already logged
         }
+        // Get the terminal size from ap for the parent terminal
+        ws = (struct winsize){r.ap->h, r.ap->w, r.ap->xpixel, r.ap->ypixel};
+        LOG_INFO("Parent terminal size: %dx%d (%dx%d pixels)", ws.ws_col, ws.ws_row, ws.ws_xpixel, ws.ws_ypixel);
     }
-    // In parent: bidirectional I/O using pselect with SIGCHLD handling
-    LOG_INFO("Started program '%s' with PID %d and path '%s'", program, pid, path);
-    char buf[4096];
-    fd_set readfds;
-    bool done = false;
-    bool stdin_closed = false;
-    sigset_t empty;
-    sigemptyset(&empty);
-    int ourStatus = 0;
-    buffer quoted = {0};
-    size_t totalRead = 0;
-    size_t totalWritten = 0;
-    // track if last child output ends with complete sequence and thus it's ok to
-    // update the HUD, ie to avoid corrupting mid utf8 or csi
-    bool hud_ok = hud;
-    while (!done) {
-        FD_ZERO(&readfds);
-        if (!stdin_closed) {
-            FD_SET(STDIN_FILENO, &readfds); // monitor stdin (parent's input)
+    for (int i = 0; i < r.n_sessions; i++) {
+        session *s = &r.sessions[i];
+        *s = (session){.r = &r, .n = i + 1, .pty = -1, .program = argv[optind + (multi ? i : 0)]};
+        if (ofilename == NULL) {
+            continue;
         }
-        FD_SET(fd, &readfds); // monitor PTY (child's output)
-        // pselect unmasks SIGCHLD (and SIGWINCH) atomically during select,
-        // so we wake on child exit or resize (or IOs).
-        int ret = pselect(fd + 1, &readfds, NULL, NULL, NULL, &empty);
-        LOG_DEBUG("pselect ret=%d, errno=%d, stdin_closed=%d", ret, errno, stdin_closed);
-        // Check for terminal resize (SIGWINCH is handled by ap, just poll size)
-        struct winsize current_ws;
-        if (ap->resized) {
-            ap->resized = false; // reset flag
-            current_ws.ws_col = ap->w;
-            current_ws.ws_row = ap->h;
-            current_ws.ws_xpixel = ap->xpixel;
-            current_ws.ws_ypixel = ap->ypixel;
-            if (ioctl(fd, TIOCSWINSZ, &current_ws) >= 0) {
-                LOG_DEBUG("Forwarded resize: %dx%d", current_ws.ws_col, current_ws.ws_row);
-            } else {
-                LOG_ERROR("Could not set PTY window size: %s", strerror(errno));
-            }
+        char name[4096];
+        if (multi) {
+            snprintf(name, sizeof(name), "%s.%d", ofilename, s->n);
+        } else {
+            snprintf(name, sizeof(name), "%s", ofilename);
         }
-        bool iodone = false; // track if we did I/O to skip waitpid check if so
-        ssize_t readn = 0;
-        ssize_t writen = 0;
-        if (ret < 0) {
-            if (errno != EINTR) {
-                LOG_ERROR("pselect error: %s", strerror(errno));
-                break;
-            }
+        // Raw output is appended to avoid overwriting existing file, and to allow
+        // multiple runs to log to the same file if desired.
+        if (compress) {
+            s->out = rec_create_compressed(name, ws.ws_col, ws.ws_row);
+        } else {
+            s->out = indexed ? rec_create(name, ws.ws_col, ws.ws_row) : rec_append(name);
         }
-        // If EINTR, fall through to check for other events
-        // Data available from stdin - send to child
-        if (!stdin_closed && ret > 0 && FD_ISSET(STDIN_FILENO, &readfds)) {
-            readn = read(STDIN_FILENO, buf, sizeof(buf));
-            if (readn > 0) {
-                LOG_DEBUG("Read %zd bytes from stdin, sending to child %s", readn, debug_data(&quoted, buf, readn));
-                ssize_t n = write_all(fd, buf, readn); // send to PTY
-                if (n < 0) {
-                    LOG_ERROR("Error writing %zd vs %zd to PTY: %s", n, readn, strerror(errno));
-                    done = true;
-                    break;
-                }
-                iodone = true;
-            } else if (readn == 0) {
-                // EOF on stdin, stop monitoring it
-                stdin_closed = true;
-            }
+        if (s->out == NULL) {
+            return 1; // error already logged
         }
-        // Data available from PTY - output from child
-        if (ret > 0 && FD_ISSET(fd, &readfds)) {
-            writen = read(fd, buf, sizeof(buf));
-            if (writen > 0) {
-                LOG_DEBUG("Read %zd bytes from PTY, outputting to stdout %s", writen, debug_data(&quoted, buf, writen));
-                ssize_t n = write_all(1, buf, writen);
-                if (n < 0) {
-                    LOG_ERROR("Error writing %zd vs %zd to stdout: %s", n, writen, strerror(errno));
-                    done = true;
-                    break;
-                }
-                if (ofile) {
-                    ssize_t saved = fwrite(buf, 1, writen, ofile);
-                    if (saved != writen) {
-                        LOG_ERROR("Error writing %zd vs %zd to output file: %s", saved, writen, strerror(errno));
-                        return 1;
-                    }
-                }
-                // Check if child output ends with complete ANSI sequence
-                // we don't even call / check if hud mode is off.
-                hud_ok = hud && !partial_end(buf, writen);
-                iodone = true;
-            } else if (writen == 0 || (writen < 0 && errno == EIO)) {
-                // PTY closed or EIO - child has ended
-                LOG_DEBUG("PTY closed (read %zd, errno=%d), child likely exited", writen, errno);
-                done = true;
-            }
+        LOG_INFO("Recording %ssession output to '%s'", compress ? "compressed " : indexed ? "indexed " : "", name);
+    }
+    if (writer_thread) {
+        r.queue = rec_queue_start();
+        if (r.queue == NULL) {
+            return 1; // error already logged
         }
-        if (iodone) {
-            totalRead += readn;
-            totalWritten += writen;
-            // Only update HUD if child output ended with a complete ANSI sequence
-            if (hud_ok) {
-                // If we did I/O, update the HUD with the latest child output
-                ap_save_cursor(ap);
-                ap_move_to(ap, 0, 0); // move to top
-                // Inverse colors for visibility, and show total read/written
-                ap_str(ap, STR("\033[7m")); // inverse colors
-                ap_str(ap, STR("R: "));
-                ap_itoa(ap, readn);
-                ap_str(ap, STR(" ("));
-                ap_itoa(ap, totalRead);
-                ap_str(ap, STR("), W: "));
-                ap_itoa(ap, writen);
-                ap_str(ap, STR(" ("));
-                ap_itoa(ap, totalWritten);
-                ap_str(ap, STR(") \033[m")); // reset colors
-                ap_restore_cursor(ap);
-                ap_flush(ap);
-            }
-            continue; // if we did I/O, skip waitpid check to the expense.
+    }
+    // Handlers are set before starting the children, so their exit can't be missed.
+    r.loop = ev_new();
+    if (r.loop == NULL || ev_signal(r.loop, SIGCHLD, on_child, &r) < 0) {
+        return 1; // error already logged
+    }
+    for (int i = 0; i < r.n_sessions; i++) {
+        session *s = &r.sessions[i];
+        char *shell_args[] = {"/bin/sh", "-c", (char *)s->program, NULL};
+        if (start_session(&r, s, multi ? shell_args : argv + optind, &ws) < 0) {
+            return 1; // error already logged
         }
-        // Check if child has exited (even if PTY still open)
-        int status;
-        pid_t wpid = waitpid(pid, &status, WNOHANG);
-        LOG_DEBUG("waitpid returned %d, errno=%d", wpid, errno);
-        if (wpid > 0) {
-            // Child exited, log it and close loop
-            if (WIFEXITED(status)) {
-                int status_code = WEXITSTATUS(status);
-                LOG_INFO("Program '%s' exited with status %d", program, status_code);
-                ourStatus = status_code ? 1 : 0;
-            } else if (WIFSIGNALED(status)) {
-                LOG_INFO("Program '%s' was killed by signal %d", program, WTERMSIG(status));
-                ourStatus = 2;
+    }
+    r.running = r.n_sessions;
+    // In parent: I/O, resizes and children exits all come through the event loop.
+    ansi_init(&r.tok, NULL, NULL); // no callback: only tracking the sequences state.
+    if (r.ap != NULL && (ev_add(r.loop, STDIN_FILENO, EV_READ, on_stdin, &r) < 0 ||
+                         ev_add(r.loop, r.ap->resize_fd, EV_READ, on_resize, &r) < 0)) {
+        return 1; // error already logged
+    }
+    while (r.running > 0) {
+        bool draining = false;
+        for (int i = 0; i < r.n_sessions; i++) {
+            r.sessions[i].output = false;
+            draining |= r.sessions[i].exited && !r.sessions[i].done;
+        }
+        // Once a child exited, only check (don't wait) for the output it left.
+        if (ev_run_once(r.loop, draining ? 0 : -1) != 0) {
+            break;
+        }
+        for (int i = 0; i < r.n_sessions; i++) {
+            session *s = &r.sessions[i];
+            if (s->done || !s->exited || s->output) {
+                continue;
             }
-            done = true; // force exit even if PTY still has data
+            if (s->pty >= 0) {
+                close_pty(s);
+            }
+            s->done = true;
+            r.running--;
+        }
+    }
+    int status = 0;
+    size_t total_written = 0;
+    for (int i = 0; i < r.n_sessions; i++) {
+        session *s = &r.sessions[i];
+        if (s->pty >= 0) {
+            close_pty(s);
+        }
+        status = s->status > status ? s->status : status;
+        total_written += s->total_written;
+    }
+    ev_free(r.loop);
+    if (r.queue != NULL && rec_queue_stop(r.queue) < 0) {
+        status = 1;
+    }
+    for (int i = 0; i < r.n_sessions; i++) {
+        if (r.sessions[i].out != NULL && rec_close_writer(r.sessions[i].out) < 0) {
+            status = 1;
         }
     }
-    close(fd);
-    LOG_INFO("Total read: %zu bytes, total written : %zu bytes", totalRead, totalWritten);
-    LOG_INFO("Exiting parent, cleaning up and exiting with %d", ourStatus);
-    free_buf(&quoted);
-    return ourStatus;
+    LOG_INFO("Total read: %zu bytes, total written : %zu bytes", r.total_read, total_written);
+    LOG_INFO("Exiting parent, cleaning up and exiting with %d", status);
+    ansi_free(&r.tok);
+    free_buf(&r.quoted);
+    free(r.sessions);
+    return status;
 }
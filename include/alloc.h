@@ -0,0 +1,39 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pluggable allocator for buffers (see new_buf_in()), NULL means the C heap.
+typedef struct buf_allocator {
+    // Allocates (ptr NULL) or grows a block of old_size bytes to new_size, keeping its content.
+    void *(*grow)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*release)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} buf_allocator;
+
+// Fixed size blocks from a single slab with a free list, e.g for the chunk
+// buffers of read loops. Buffers in a pool that grow past the block size
+// move to the heap.
+typedef struct pool {
+    char *slab;
+    size_t block, count;
+    void *free_list;
+    int in_use, peak;
+    int overflows;       // allocations when exhausted or too big (from the heap instead).
+    buf_allocator alloc; // for buffers in this pool.
+} pool;
+
+void pool_init(pool *p, size_t block, size_t count);
+void pool_free(pool *p);
+// Returns a block or NULL if all are in use.
+void *pool_get(pool *p);
+void pool_put(pool *p, void *block);
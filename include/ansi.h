@@ -0,0 +1,72 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "buf.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming ANSI tokenizer: a state machine fed arbitrary chunks (e.g as read()
+// returns them) that keeps its state across chunks so no byte is ever looked
+// at twice, and that emits tokens through a callback. Every byte of the stream
+// belongs to exactly one token (malformed sequences are ANSI_ESC with a 0 final).
+
+typedef enum ansi_token_type {
+    ANSI_TEXT,   // run of non escape bytes (including C0 controls like \r \n).
+    ANSI_ESC,    // ESC [intermediate] final, e.g ESC 7, ESC ( B, ESC =
+    ANSI_CSI,    // ESC [ [prefix] params [intermediate] final
+    ANSI_STRING, // OSC (ESC ]), DCS (ESC P), SOS/PM/APC (ESC X, ESC ^, ESC _) strings.
+} ansi_token_type;
+
+enum { ANSI_MAX_PARAMS = 16 };
+
+typedef struct ansi_token {
+    ansi_token_type type;
+    // Raw bytes of the whole token, only valid during the callback. They point
+    // into the fed chunk unless the sequence spanned chunks.
+    const char *data;
+    size_t size;
+    char final;        // CSI/ESC final byte, or the string introducer (']', 'P', 'X', '^' or '_').
+    char prefix;       // CSI private marker ('?', '>', '<', '=') or 0.
+    char intermediate; // last intermediate byte (0x20..0x2F) or 0, e.g '$' of DECRQM or '(' of SCS.
+    int n_params;
+    int params[ANSI_MAX_PARAMS]; // -1 for omitted (default) parameters, extra ones are dropped.
+    // String content, without introducer and terminator (BEL or ST).
+    const char *payload;
+    size_t payload_size;
+} ansi_token;
+
+// Returns non zero to stop ansi_feed() right after this token.
+typedef int (*ansi_callback)(void *ctx, const ansi_token *tok);
+
+typedef struct ansi_tokenizer {
+    int state;
+    ansi_token tok; // being built.
+    int cur;        // current CSI parameter, -1 when omitted so far.
+    bool has_params;
+    buffer seq; // raw bytes of a sequence started in a previous chunk.
+    ansi_callback cb;
+    void *ctx;
+} ansi_tokenizer;
+
+// cb can be NULL to just track whether the stream is in the middle of a sequence.
+void ansi_init(ansi_tokenizer *t, ansi_callback cb, void *ctx);
+void ansi_free(ansi_tokenizer *t);
+// Forgets any partial sequence.
+void ansi_reset(ansi_tokenizer *t);
+
+// Tokenizes the next n bytes of the stream. Returns the number of bytes used:
+// n unless the callback asked to stop, in which case the caller continues
+// later with the rest (data + returned value).
+size_t ansi_feed(ansi_tokenizer *t, const char *data, size_t n);
+
+// True when the bytes fed so far end in the middle of an escape sequence
+// (whose bytes so far are in t->seq when there is a callback).
+bool ansi_in_sequence(const ansi_tokenizer *t);
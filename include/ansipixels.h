@@ -9,10 +9,22 @@
  */
 #pragma once
 
+#include "ansi.h"
 #include "buf.h"
+#include "evloop.h"
+#include "grid.h"
+#include "image.h"
+#include "input.h"
+#include "iov.h"
 #include "log.h"
 #include "raw.h"
+#include "rec.h"
+#include "ring.h"
+#include "scan.h"
+#include "seq.h"
+#include "stats.h"
 #include "timer.h"
+#include "utf8.h"
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -22,30 +34,169 @@
 #include <sys/ioctl.h>
 #include <sys/select.h>
 
+// Capacity of the nonblocking output queue (see ap_nonblocking).
+enum { AP_PENDING_SIZE = 1 << 20 };
+
+// Input read size of ap_read_input (when no round trip probe is unanswered).
+enum { AP_INPUT_CHUNK = 1 << 16 };
+
+// Output instrumentation, always collected (see ap_stats_get). Counters are
+// totals since ap_open() or the last ap_stats_reset(), histograms are per frame
+// (per ap_end(), which ap_present() uses).
+typedef struct ap_stats {
+    uint64_t frames;
+    uint64_t bytes;          // written to the terminal.
+    uint64_t writes;         // write syscalls.
+    uint64_t partial_writes; // writes that didn't take everything (including would block).
+    uint64_t blocked_ns;     // total time spent in write syscalls.
+    int buf_allocs;          // (re)allocations of the batch buffer.
+    histogram build_ns;      // ap_start() to ap_end().
+    histogram frame_bytes;   // bytes flushed by ap_end().
+    histogram write_ns;      // time in write syscalls during ap_end().
+} ap_stats;
+
+// Terminal round trip latency, see ap_rtt_probe().
+enum { AP_RTT_MAX_INFLIGHT = 8 };
+
+typedef struct ap_rtt {
+    histogram hist; // round trip times in ns (min, mean, quantiles...).
+    uint64_t last;  // latest round trip time.
+    uint64_t sent[AP_RTT_MAX_INFLIGHT]; // now_ns() of the probes waiting for their answer (ring from head).
+    int head, inflight;
+    int stale; // answers still to come for timed out probes (stripped but not measured).
+} ap_rtt;
+
+enum { AP_FRAME_SEQ_MAX = 16 };
+
+// Terminal capabilities (ap->caps).
+enum {
+    AP_CAP_SYNC = 1 << 0,      // synchronized output (DEC mode 2026), frames are wrapped in it.
+    AP_CAP_PASTE = 1 << 1,     // bracketed paste (DEC mode 2004), ap_paste_on() is a no-op without it.
+    AP_CAP_TRUECOLOR = 1 << 2, // 24 bits colors, AP_COLOR_RGB ones are sent as the closest of 256 otherwise.
+    AP_CAP_KITTY_KEYBOARD = 1 << 3, // ap_kitty_keyboard_on() is a no-op without it.
+    AP_CAP_KITTY_GRAPHICS = 1 << 4,
+    AP_CAP_SIXEL = 1 << 5,
+    // Assumed until detected: what was always sent before.
+    AP_CAPS_DEFAULT = AP_CAP_SYNC | AP_CAP_PASTE | AP_CAP_TRUECOLOR | AP_CAP_KITTY_KEYBOARD,
+};
+
 typedef struct ap {
     int out;
     int h, w;
     int xpixel, ypixel;
     buffer buf;
     bool first_clear; // for ap_clear_screen
-    bool resized;
+    unsigned caps;    // AP_CAP_* the terminal supports (see ap_detect_caps).
+    bool probing;     // ap_detect_caps() is waiting for the answers...
+    unsigned probed;  // ...and these are the capabilities found so far.
+    // Sequences ap_start and ap_end wrap each frame with, built from caps.
+    uint8_t frame_prologue_len, frame_epilogue_len;
+    char frame_prologue[AP_FRAME_SEQ_MAX], frame_epilogue[AP_FRAME_SEQ_MAX];
+    bool resized;     // size changed, see ap_check_resize.
+    int resize_fd;    // readable when a resize (SIGWINCH) is pending, for select/poll loops.
+    int cx, cy; // cursor position as tracked within a batch (until ap_flush), -1 when unknown.
+    ap_style style; // rendition requested for the next text (see ap_fg etc...)
+    ap_style sgr;   // terminal's current rendition, when sgr_known.
+    bool sgr_known;
+    bool style_dirty; // style needs to be applied before the next text.
+    grid front; // what we believe is currently on screen
+    grid back;  // what the next ap_present will show
+    uint64_t *row_hashes; // scroll detection scratch of the rendering thread (2 per row).
+    int row_hashes_size;
+    // Nonblocking output (see ap_nonblocking).
+    bool nonblocking;
+    int out_blocking;   // original (blocking) out while nonblocking.
+    ring pending;       // flushed output the terminal didn't accept yet (AP_PENDING_SIZE).
+    iov_batch out_iov;  // ap_flush_after()'s writev batch.
+    int frames_skipped; // ap_present calls skipped because of backpressure.
+    struct ap_render *render; // render thread, NULL when rendering on the caller's thread.
+    // Input (see ap_read_input).
+    buffer input; // read by ap_read_input() and not consumed by the app yet.
+    ansi_tokenizer in_tok;
+    input_decoder in_dec;              // see ap_read_events.
+    bool mouse, focus, kitty_keyboard; // input reporting modes turned on (turned off at exit).
+    ap_rtt rtt;
+    sixel_encoder *sixel; // allocated by the first ap_sixel().
+    // Instrumentation (see ap_stats_get).
+    ap_stats stats;
+    uint64_t frame_start; // now_ns() at ap_start, 0 outside of a frame.
+    int stats_fd;
+    uint64_t stats_interval, stats_next; // ap_stats_every period (0 for none) and next deadline.
 } *ap_t;
 
 ap_t ap_open(void);
+// Headless ap writing to out (e.g /dev/null, a file or a pipe) with a fixed
+// w x h size: no raw mode, resize handling nor exit cleanup, release it with
+// ap_free(). For benchmarks and offscreen rendering.
+ap_t ap_new(int out, int w, int h);
+void ap_free(ap_t ap);
+
+// Processes pending resizes (the SIGWINCH handler only flags them) and returns
+// true if the size (ap->w, ap->h...) changed since the last call.
+bool ap_check_resize(ap_t ap);
 
 void ap_start(ap_t ap);
 void ap_end(ap_t ap);
 
 void ap_clear_screen(ap_t ap, bool immediate);
 
+// Detects the terminal capabilities (ap->caps), to call right after ap_open()
+// before turning modes on. The answers are cached in
+// $XDG_CACHE_HOME/ansipixels (or ~/.cache/ansipixels) per TERM, TERM_PROGRAM
+// and TERM_PROGRAM_VERSION when cache is true, so later launches don't wait for
+// them. Otherwise all the queries are sent at once followed by a DA1 (see
+// ap_rtt_probe) which every terminal answers last, waiting at most timeout_ns.
+// Returns 0, or -1 when there was no answer (caps are left unchanged).
+int ap_detect_caps(ap_t ap, uint64_t timeout_ns, bool cache);
+// Sets ap->caps, e.g to force or drop some of the detected ones.
+void ap_set_caps(ap_t ap, unsigned caps);
+
 void ap_paste_on(ap_t ap);
 void ap_paste_off(ap_t ap);
+// Mouse reporting (SGR encoding) of clicks, wheel and drags, and also of all
+// motions when motion is true.
+void ap_mouse_on(ap_t ap, bool motion);
+void ap_mouse_off(ap_t ap);
+// Focus in and out events.
+void ap_focus_on(ap_t ap);
+void ap_focus_off(ap_t ap);
+// Kitty keyboard protocol with the given flags (1 to disambiguate escape codes,
+// 2 for repeat and release events, 8 for all keys as escape codes, see its
+// spec): pushed on the terminal's stack, ap_kitty_keyboard_off() pops it.
+// Ignored by other terminals.
+void ap_kitty_keyboard_on(ap_t ap, int flags);
+void ap_kitty_keyboard_off(ap_t ap);
 
 void ap_itoa(ap_t ap, int n);
 
 void ap_move_to(ap_t ap, int x, int y);
 
 void ap_flush(ap_t ap);
+// Writes data (e.g other output passed through) and then the pending batch, in
+// a single writev() (e.g for overlays drawn on top of a child's output).
+void ap_flush_after(ap_t ap, const char *data, size_t n);
+
+// Opt-in nonblocking output: ap_flush() then never blocks, it writes whatever
+// the terminal accepts and queues the rest, and ap_present() skips frames
+// while output is still queued (the skipped changes are merged in the next
+// frame that does go out). Uses a separately opened tty so the O_NONBLOCK flag
+// isn't shared with stdin/stderr. The queue is a fixed AP_PENDING_SIZE ring:
+// output that doesn't fit waits for the terminal to make room (so a stuck
+// terminal can't grow memory). Turning it off waits for the queue to drain.
+// Returns 0 on success, -1 on error (e.g stdout isn't a tty, logged).
+int ap_nonblocking(ap_t ap, bool on);
+// Sends more of the queued output if the terminal accepts it and returns the
+// number of bytes still queued: non 0 means backpressure.
+size_t ap_pending(ap_t ap);
+
+// Copies the current statistics (safe to call while the render thread runs).
+void ap_stats_get(ap_t ap, ap_stats *s);
+void ap_stats_reset(ap_t ap);
+// Writes a one line summary of s (count, p50, p99 and max of the histograms) to fd.
+void ap_stats_print(const ap_stats *s, int fd);
+// Also prints the summary to fd every interval_ns, checked at the end of each
+// frame (0 to stop). Call before ap_render_start().
+void ap_stats_every(ap_t ap, int fd, uint64_t interval_ns);
 
 void ap_save_cursor(ap_t ap);
 void ap_restore_cursor(ap_t ap);
@@ -53,6 +204,130 @@ void ap_restore_cursor(ap_t ap);
 void ap_hide_cursor(ap_t ap);
 void ap_show_cursor(ap_t ap);
 
+// Round trip latency probes: ap_rtt_probe() sends a DA1 (primary device
+// attributes, CSI c) request, which terminals answer with a CSI ? ... c that
+// can't be confused with keys (unlike the DSR cursor position report, which
+// looks like a modified F3). Input must then be read with ap_read_input(),
+// which takes the answers out of the stream (timing them in ap->rtt when it
+// processes them, so call it as soon as stdin is readable) and keeps all the
+// rest, interleaved keystrokes included, in ap->input. The probe is written
+// right away (not batched). Returns 0, or -1 when AP_RTT_MAX_INFLIGHT probes
+// are already unanswered.
+int ap_rtt_probe(ap_t ap);
+// Reads the available input (one read() if stdin is readable, doesn't block)
+// and appends it to ap->input minus the probe answers. Returns the number of
+// bytes added (possibly 0), -1 on errors and end of file.
+ssize_t ap_read_input(ap_t ap);
+// Decoded input: returns up to max events from ap->input (see input_decode),
+// reading more with ap_read_input() only when it has no complete event left
+// (so the data of the returned events stays valid until the next call), and
+// deciding a trailing ESC is the Esc key when no more input is pending.
+// Returns the number of events (possibly 0, doesn't block), -1 on errors and end of file.
+int ap_read_events(ap_t ap, input_event *ev, int max);
+// Measures n round trips, one probe at a time, each waiting up to timeout_ns
+// for its answer (stops at the first timeout). Returns the number of answers.
+int ap_rtt_measure(ap_t ap, int n, uint64_t timeout_ns);
+
+// Non blocking check for pending input (one syscall per call: rate limit it in
+// hot loops, or wait for STDIN_FILENO in an ev_loop instead).
 bool ap_stdin_ready(ap_t ap);
 
 void ap_str(ap_t ap, string s);
+
+// Colors and attributes for the following ap_str/ap_itoa text. Changes are
+// applied lazily, skipped when the terminal already has that rendition, and
+// coalesced into a single SGR sequence with the shortest parameters.
+// Use AP_COLOR_DEFAULT, AP_COLOR_256(n) or AP_COLOR_RGB(r, g, b) for colors.
+void ap_fg(ap_t ap, ap_color c);
+void ap_bg(ap_t ap, ap_color c);
+// Sets the attributes (bit mask of AP_BOLD, AP_UNDERLINE, AP_INVERSE, etc...).
+void ap_attr(ap_t ap, uint16_t attr);
+void ap_set_style(ap_t ap, ap_style s);
+void ap_reset_style(ap_t ap);
+// Emits the pending style change now (done automatically before text and by ap_flush).
+void ap_apply_style(ap_t ap);
+
+// Retained mode drawing: ap_put* only update the back grid, nothing is sent
+// to the terminal until ap_present() which only emits the cells that changed
+// since the previous ap_present().
+void ap_put(ap_t ap, int x, int y, cell c);
+// Puts the UTF-8 string s starting at x,y with the given style (clipped, no wrapping),
+// one grapheme cluster per cell (two for wide ones, see utf8_grapheme).
+// Returns the x position after the last glyph.
+int ap_put_str(ap_t ap, int x, int y, string s, ap_color fg, ap_color bg, uint16_t attr);
+// Resets the back grid to blank cells.
+void ap_clear_grid(ap_t ap);
+// Forces the next ap_present() to redraw everything (e.g if something else wrote to the screen).
+// Also done when the terminal is resized.
+void ap_invalidate_all(ap_t ap);
+// Forces the next ap_present() to redraw the w x h cells at x,y (clipped). With
+// the render thread, same as ap_invalidate_all().
+void ap_invalidate(ap_t ap, int x, int y, int w, int h);
+// Diffs the back grid against the front grid and sends only the changes (in a sync/batch frame).
+// Only the cells written (ap_put* etc) since the previous ap_present() are compared, so
+// the cost is proportional to what was drawn rather than to the screen size.
+// With the render thread, only publishes a copy of the back grid for that thread to render.
+void ap_present(ap_t ap);
+
+// Pixel graphics (see image.h for images and encoders). Cell size in pixels
+// from the terminal's reported pixel size (ap->xpixel, ap->ypixel), 10x20 when unknown.
+void ap_cell_pixels(ap_t ap, int *cw, int *ch);
+// Draws img with its top left at cell x,y in the back grid (shown by
+// ap_present) as half blocks (1x2 pixels per cell) or quadrants (2x2).
+void ap_put_halfblocks(ap_t ap, int x, int y, const image *img);
+void ap_put_quadrants(ap_t ap, int x, int y, const image *img);
+// Appends img at cell x,y to the current batch (between ap_start and ap_end,
+// after the grid's ap_present as cells drawn later go over it) with the kitty
+// graphics protocol as image id (see kitty_encode), or as sixel with at most
+// colors colors.
+void ap_kitty(ap_t ap, int x, int y, const image *img, uint32_t id, bool zlib);
+void ap_kitty_place(ap_t ap, int x, int y, uint32_t id);
+void ap_kitty_delete(ap_t ap, uint32_t id);
+void ap_sixel(ap_t ap, int x, int y, const image *img, int colors);
+
+// Optional render thread: ap_present() then hands frames over (lock free,
+// latest wins) to a dedicated thread doing the diff, encoding and writes, so
+// the app thread can go on with the next frame. While it runs, the app thread
+// should only use the ap_put*, ap_clear_grid, ap_invalidate(_all), ap_present,
+// ap_check_resize and ap_stats_get/reset calls. Returns 0 on success, -1 on error (logged).
+int ap_render_start(ap_t ap);
+// Renders the last published frame and stops the render thread (also done by the exit cleanup).
+void ap_render_stop(ap_t ap);
+
+// Frame scheduler: ap_run() ticks at a fixed rate on absolute deadlines
+// (start + tick * period, so lateness doesn't accumulate and ticks missed by
+// more than a period are skipped, not bunched up). The input that arrived
+// since the previous tick is decoded and handed to update() in one batch;
+// render() only runs when update() asks for it (and for the first frame and
+// after a resize). When update() doesn't ask to keep animating,
+// ap_run() sleeps until the next input or resize instead of ticking.
+enum {
+    AP_RUN_RENDER = 1,  // something changed: render and present this tick.
+    AP_RUN_ANIMATE = 2, // keep ticking even without input.
+    AP_RUN_STOP = 4,    // return from ap_run().
+};
+
+typedef struct ap_frame {
+    uint64_t tick;     // ticks since ap_run() started.
+    uint64_t deadline; // now_ns() time the tick was due (the first tick after an idle wait is due at the wake up).
+    uint64_t now;      // now_ns() when the events were read.
+    int missed;        // ticks skipped before this one because the previous ones ran late.
+    bool resized;      // terminal size changed (the screen is then fully redrawn).
+    const input_event *events; // input since the previous tick (valid during the callbacks).
+    int n_events;
+} ap_frame;
+
+typedef struct ap_app {
+    double hz; // ticks per second, 0 for none in between (ticks back to back, e.g for benchmarks).
+    // Returns AP_RUN_* flags. NULL to always render and animate.
+    int (*update)(ap_t ap, const ap_frame *f, void *ctx);
+    // Outputs the frame: typically ap_put* then ap_present(), or a batch of its own.
+    void (*render)(ap_t ap, const ap_frame *f, void *ctx);
+    void *ctx;
+    // Filled by ap_run().
+    uint64_t ticks, renders, missed;
+    histogram late_ns; // how late the ticks started (timer and scheduling latency).
+} ap_app;
+
+// Runs app until update() returns AP_RUN_STOP (returns 0), or an input error or end of file (returns -1).
+int ap_run(ap_t ap, ap_app *app);
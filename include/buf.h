@@ -8,6 +8,7 @@
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #pragma once
+#include "alloc.h"
 #include "str.h"
 #include <stdbool.h>
 #include <unistd.h>
@@ -17,12 +18,16 @@ typedef struct buf {
     size_t start; // offset from data for start of current non consumed data
     size_t size;  // logical size of the data starting at data + start
     size_t cap;   // total allocated capacity starting at data
-#if DEBUG
-    int allocs; // for debugging reallocs
-#endif
+    int allocs;   // (re)allocations of this buffer (see also buf_heap_allocs()).
+    const buf_allocator *alloc; // NULL for the heap.
 } buffer;
 
+// New buffer with size bytes of (uninitialized) capacity from the heap.
 buffer new_buf(size_t size);
+// Same from the given allocator (e.g a pool's), NULL for the heap.
+buffer new_buf_in(size_t size, const buf_allocator *alloc);
+// Number of heap allocations and reallocations done for buffers so far (all threads).
+size_t buf_heap_allocs(void);
 void free_buf(buffer *b);
 void clear_buf(buffer *b);
 // Copy non overlapping data to start, resets start to 0 and keeps size unchanged.
@@ -42,22 +47,44 @@ ssize_t read_at_least(int fd, buffer *b, size_t min);
 // but will never read more than n.
 ssize_t read_n(int fd, buffer *b, size_t n);
 
+// Maps a whole regular file read only as a non owning (zero cap) view that
+// must be released with unmap_buf(). Returns false if fd can't be mapped
+// (e.g a pipe or a tty) in which case the caller should read() it instead.
+bool map_buf(int fd, buffer *b);
+void unmap_buf(buffer *b);
+
 ssize_t write_buf(int fd, buffer b);
 ssize_t write_all(int fd, const char *buf, ssize_t len);
+// Writes as much as a nonblocking (O_NONBLOCK) fd accepts right now. Returns
+// the number of bytes written (possibly 0), -1 on errors other than EAGAIN.
+ssize_t write_avail(int fd, const char *buf, size_t len);
+
+// Reserve/commit: reserve_buf makes sure there is room for at least n more bytes
+// and returns where to write them, commit_buf then adds the number of bytes
+// actually written (at most n). Lets callers do a single capacity check for
+// a whole sequence instead of one per append. The pointer is only valid until
+// the next operation that may grow the buffer.
+char *reserve_buf(buffer *b, size_t n);
+void commit_buf(buffer *b, size_t n);
 
 void append_data(buffer *dest, const char *data, size_t size);
 void append_buf(buffer *dest, buffer src);
 void append_str(buffer *dest, string src);
 void append_byte(buffer *dest, char byte);
+// Appends the decimal representation of n (see fmt.h for the raw pointer versions).
+void append_int(buffer *dest, int n);
 
 buffer slice_buf(buffer b, size_t start, size_t end);
 
 void quote_buf(buffer *b, const char *s, size_t size);
 buffer debug_quote(const char *s, size_t size);
+// Logs b's content and fields. Reuses a quote buffer kept per thread, so it can be
+// called from any thread (e.g filter -j workers).
 void debug_print_buf(buffer b);
 
 // mempbrk is like memchr but searches for any of the bytes in accept
 // and returns a pointer to the first occurrence in s, or NULL if not found.
+// Vectorized for up to 4 accept bytes (see scan.h).
 const char *mempbrk(const char *s, size_t n, const char *accept, size_t accept_len);
 
 void consume(buffer *b, size_t n);
@@ -0,0 +1,57 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Event loop: waits for fds, timers (now_ns() deadlines) and signals in a
+// single call. Uses epoll on Linux, kqueue on macOS/BSDs and poll() otherwise
+// (or when built with -DEV_USE_POLL=1).
+
+enum {
+    EV_READ = 1,
+    EV_WRITE = 2,
+    EV_HUP = 4, // hang up or error (reported with EV_READ when reading so the read sees EOF/EIO).
+    EV_TIMER = 8,
+    EV_SIGNAL = 16,
+};
+
+typedef struct ev_loop ev_loop;
+
+// Callback for all event kinds: id is the fd, the timer id or the signal
+// number and events the EV_* that happened. Returning non zero stops ev_run()
+// (which returns that value).
+typedef int (*ev_cb)(ev_loop *l, int id, int events, void *ctx);
+
+// Returns NULL on error (logged).
+ev_loop *ev_new(void);
+void ev_free(ev_loop *l);
+
+// Watches fd for events (EV_READ and/or EV_WRITE). Returns 0 or -1 on error (logged).
+int ev_add(ev_loop *l, int fd, int events, ev_cb cb, void *ctx);
+// Changes the events watched for fd (0 to pause it).
+int ev_set(ev_loop *l, int fd, int events);
+// Stops watching fd (call before closing it). Safe from callbacks.
+int ev_del(ev_loop *l, int fd);
+
+// One shot timer at deadline (now_ns() clock), returns its id (rearm by adding a new one).
+int ev_timer(ev_loop *l, uint64_t deadline, ev_cb cb, void *ctx);
+void ev_cancel(ev_loop *l, int id);
+
+// Delivers sig as an event (through a self-pipe, the callback runs outside of
+// signal context). Signals are process wide: only one loop can handle a given one.
+int ev_signal(ev_loop *l, int sig, ev_cb cb, void *ctx);
+
+// Waits up to timeout_ns (-1 for no limit besides timers, 0 to only check)
+// and dispatches the events. Returns the first non zero callback result, 0 or
+// -1 on error (logged).
+int ev_run_once(ev_loop *l, int64_t timeout_ns);
+// Runs until a callback returns non zero (returned) or an error (-1).
+int ev_run(ev_loop *l);
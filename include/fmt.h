@@ -0,0 +1,33 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Fast (table driven, two digits at a time) decimal formatting straight into
+// caller provided memory. None of these null terminate, they all return the
+// pointer just past the last byte written.
+
+// Max bytes written by fmt_uint and fmt_int.
+#define FMT_UINT_MAX 10
+#define FMT_INT_MAX 11
+// Max bytes written by fmt_u8, fmt_rgb and fmt_pair.
+#define FMT_U8_MAX 3
+#define FMT_RGB_MAX 11
+#define FMT_PAIR_MAX (2 * FMT_UINT_MAX + 1)
+
+char *fmt_uint(char *p, uint32_t n);
+char *fmt_int(char *p, int n);
+// 0..255, the common SGR parameter case.
+char *fmt_u8(char *p, uint8_t n);
+// "r;g;b" as used by truecolor SGR.
+char *fmt_rgb(char *p, uint8_t r, uint8_t g, uint8_t b);
+// "a;b" as used by CUP (row;col).
+char *fmt_pair(char *p, uint32_t a, uint32_t b);
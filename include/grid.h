@@ -0,0 +1,101 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Colors are packed in 32 bits: the top byte is the kind (default, 256 palette or RGB)
+// and the lower 24 bits are either the palette index or 8 bits each of red, green and blue.
+typedef uint32_t ap_color;
+
+enum { AP_COLOR_KIND_DEFAULT = 0, AP_COLOR_KIND_256 = 1, AP_COLOR_KIND_RGB = 2 };
+
+#define AP_COLOR_DEFAULT ((ap_color)0)
+#define AP_COLOR_256(n) ((ap_color)(AP_COLOR_KIND_256 << 24) | ((uint32_t)(n) & 0xFF))
+#define AP_COLOR_RGB(r, g, b)                                                                                          \
+    ((ap_color)(AP_COLOR_KIND_RGB << 24) | (((uint32_t)(r) & 0xFF) << 16) | (((uint32_t)(g) & 0xFF) << 8) |           \
+     ((uint32_t)(b) & 0xFF))
+#define AP_COLOR_KIND(c) ((c) >> 24)
+
+// Attributes bit mask (SGR rendition).
+enum {
+    AP_BOLD = 1 << 0,
+    AP_DIM = 1 << 1,
+    AP_ITALIC = 1 << 2,
+    AP_UNDERLINE = 1 << 3,
+    AP_BLINK = 1 << 4,
+    AP_INVERSE = 1 << 5,
+    AP_STRIKE = 1 << 6,
+};
+
+// Rendition (SGR state) of text: colors and attributes.
+typedef struct ap_style {
+    ap_color fg, bg;
+    uint16_t attr;
+} ap_style;
+
+#define DEFAULT_STYLE ((ap_style){AP_COLOR_DEFAULT, AP_COLOR_DEFAULT, 0})
+
+// Cell flags: a glyph 2 columns wide (see glyph_width) takes its cell
+// (AP_CELL_WIDE) and the next one (AP_CELL_CONT, glyph 0, not drawn).
+enum { AP_CELL_WIDE = 1 << 0, AP_CELL_CONT = 1 << 1 };
+
+// One screen cell, fixed size (16 bytes) so rows can be compared with memcmp.
+typedef struct cell {
+    uint32_t glyph; // unicode code point or interned grapheme cluster (see utf8.h), 0 is treated as a space.
+    ap_color fg, bg;
+    uint16_t attr;
+    uint16_t flags; // AP_CELL_*, set by grid_put.
+} cell;
+
+#define BLANK_CELL ((cell){' ', AP_COLOR_DEFAULT, AP_COLOR_DEFAULT, 0, 0})
+
+// Columns [lo, hi) of a row that were written, empty when lo >= hi.
+typedef struct grid_span {
+    int lo, hi;
+} grid_span;
+
+// Each row tracks the span of cells written since the last grid_clean() so
+// a diff only needs to look at those. A new, resized or filled grid is all dirty.
+typedef struct grid {
+    int w, h;
+    cell *cells;      // w*h cells, row major.
+    grid_span *dirty; // h spans.
+} grid;
+
+grid new_grid(int w, int h);
+void free_grid(grid *g);
+// Changes the size of the grid keeping the overlapping content, new cells are blank.
+void resize_grid(grid *g, int w, int h);
+void fill_grid(grid *g, cell c);
+
+bool cell_eq(const cell *a, const cell *b);
+// Returns NULL if x,y is outside of the grid. Writes through the returned
+// pointer must be marked with grid_touch() and keep wide glyphs whole (prefer grid_put).
+cell *grid_at(grid *g, int x, int y);
+
+static inline grid_span span_union(grid_span a, grid_span b) {
+    return (grid_span){a.lo < b.lo ? a.lo : b.lo, a.hi > b.hi ? a.hi : b.hi};
+}
+// Marks the n cells from x,y (in bounds) as written.
+static inline void grid_touch(grid *g, int x, int y, int n) {
+    g->dirty[y] = span_union(g->dirty[y], (grid_span){x, x + n});
+}
+// Puts c at x,y (clipped) keeping wide glyphs whole: overwriting either half
+// of one blanks the other half, and a wide glyph also takes x+1 (a wide glyph
+// that doesn't fit at the right edge is replaced by a blank). Returns false if
+// x,y is outside of the grid.
+bool grid_put(grid *g, int x, int y, cell c);
+// Marks the w x h rectangle at x,y (clipped) as written.
+void grid_invalidate(grid *g, int x, int y, int w, int h);
+// Clears all the dirty spans.
+void grid_clean(grid *g);
@@ -0,0 +1,59 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "buf.h"
+#include "grid.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// RGBA image: 4 bytes per pixel (r, g, b, a), rows without padding.
+typedef struct image {
+    int w, h;
+    uint8_t *data;
+} image;
+
+// Zeroed (transparent) w x h image, empty (0x0) if w or h isn't positive or
+// if the allocation fails (logged).
+image new_image(int w, int h);
+void free_image(image *img);
+static inline uint8_t *image_at(const image *img, int x, int y) {
+    return img->data + ((size_t)y * (size_t)img->w + (size_t)x) * 4;
+}
+// Nearest neighbor scaling of src to dst's size.
+void image_scale(image *dst, const image *src);
+
+// Cell encoders, drawn in g with the top left pixel at cell x,y (clipped).
+// Pixels with alpha < 128 are transparent: the default color.
+
+// Half blocks: each cell shows 1x2 pixels as an upper half block (fg top, bg bottom).
+void image_halfblocks(grid *g, int x, int y, const image *img);
+// Quadrants: each cell shows 2x2 pixels with the quadrant block glyph of the
+// pixels brighter than their mean in the average of those and the rest as background.
+void image_quadrants(grid *g, int x, int y, const image *img);
+
+// Kitty graphics protocol: appends the transmission of img (RGBA, base64 in
+// 4096 bytes chunks, zlib compressed when compress and built with ZLIB=1) as
+// image id (replacing a previous one with that id, 0 for none), displayed at
+// the cursor without moving it. Replies are suppressed.
+void kitty_encode(buffer *out, const image *img, uint32_t id, bool compress);
+// Displays the already transmitted image id again at the cursor.
+void kitty_place(buffer *out, uint32_t id);
+// Deletes the image id (its placements and data).
+void kitty_delete(buffer *out, uint32_t id);
+
+// Sixel: quantizes to at most max_colors (2..255) with a median cut of a 15
+// bits color histogram and appends the DCS sequence. Transparent pixels are
+// left untouched on screen. The encoder keeps its scratch memory between images.
+typedef struct sixel_encoder sixel_encoder;
+
+sixel_encoder *sixel_new(void);
+void sixel_free(sixel_encoder *e);
+void sixel_encode(sixel_encoder *e, buffer *out, const image *img, int max_colors);
@@ -0,0 +1,96 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "buf.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Terminal input decoder: turns raw input (keys, legacy xterm and kitty
+// keyboard protocol CSI u sequences, SGR mouse reports, focus events and
+// bracketed paste) into an array of events, in one pass over the buffer it
+// was read in. Pasted text is returned as slices of that buffer, not per
+// character events.
+
+typedef enum input_event_type {
+    INPUT_KEY,
+    INPUT_MOUSE,
+    INPUT_PASTE, // pasted text, in one or more chunks (as it arrives).
+    INPUT_FOCUS_IN,
+    INPUT_FOCUS_OUT,
+    INPUT_OTHER, // any other sequence, e.g terminal answers (see data).
+} input_event_type;
+
+// Keys that aren't characters, numbered like the kitty keyboard protocol does
+// (so CSI u codes map directly, legacy sequences are translated).
+enum {
+    INPUT_KEY_TAB = 9,
+    INPUT_KEY_ENTER = 13,
+    INPUT_KEY_ESCAPE = 27,
+    INPUT_KEY_BACKSPACE = 127,
+    INPUT_KEY_INSERT = 57348,
+    INPUT_KEY_DELETE,
+    INPUT_KEY_LEFT,
+    INPUT_KEY_RIGHT,
+    INPUT_KEY_UP,
+    INPUT_KEY_DOWN,
+    INPUT_KEY_PAGE_UP,
+    INPUT_KEY_PAGE_DOWN,
+    INPUT_KEY_HOME,
+    INPUT_KEY_END,
+    INPUT_KEY_F1 = 57364, // F1 to F35 are consecutive.
+};
+
+// Modifier bits (the xterm/kitty modifier parameter minus 1).
+enum { INPUT_SHIFT = 1, INPUT_ALT = 2, INPUT_CTRL = 4, INPUT_SUPER = 8 };
+
+typedef enum input_action { INPUT_PRESS, INPUT_REPEAT, INPUT_RELEASE, INPUT_MOTION } input_action;
+
+// Mouse buttons (the SGR report's button bits): 128 + n for the extra buttons 8 + n.
+enum {
+    INPUT_BUTTON_LEFT,
+    INPUT_BUTTON_MIDDLE,
+    INPUT_BUTTON_RIGHT,
+    INPUT_BUTTON_NONE, // motion without any button down.
+    INPUT_WHEEL_UP = 64,
+    INPUT_WHEEL_DOWN,
+    INPUT_WHEEL_LEFT,
+    INPUT_WHEEL_RIGHT,
+};
+
+typedef struct input_event {
+    input_event_type type;
+    // INPUT_KEY: code point or INPUT_KEY_*. Control characters are reported as
+    // their key with INPUT_CTRL (Ctrl-C is 'c'), a key after ESC gets INPUT_ALT.
+    uint32_t key;
+    uint8_t mods;   // INPUT_SHIFT, INPUT_ALT... of keys and mouse events.
+    uint8_t action; // input_action: keys are pressed unless the kitty protocol reports event types.
+    uint8_t button; // INPUT_MOUSE: INPUT_BUTTON_* or INPUT_WHEEL_*.
+    bool paste_end; // INPUT_PASTE: last chunk of the paste.
+    int x, y;       // INPUT_MOUSE: 0 based cell.
+    // Pasted text for INPUT_PASTE, raw bytes of the event otherwise. Points
+    // into the decoded buffer: valid until it's next written to.
+    const char *data;
+    size_t size;
+} input_event;
+
+typedef struct input_decoder {
+    bool in_paste;
+} input_decoder;
+
+// Decodes the complete events at the start of in into ev[0..max) and consumes
+// their bytes. Returns the number of events. Incomplete sequences are left in
+// in for when the rest arrives. An ESC at the end may be the Esc key or the
+// start of a sequence split across reads: final tells no more input is
+// pending, making it the key (and ESC plus an introducer like P or [ an Alt +
+// key, as do ones still incomplete after 4KB). Pasted text is returned as it comes: the end of
+// a long paste may be in later chunks (see paste_end).
+int input_decode(input_decoder *d, buffer *in, input_event *ev, int max, bool final);
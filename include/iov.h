@@ -0,0 +1,42 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "buf.h"
+
+// Output batch sent with writev(): ranges referenced in place (e.g from a
+// mapped file or a read buffer) and small copied pieces, so pass-through data
+// is never copied. Adjacent ranges are coalesced.
+
+typedef struct iov_entry {
+    const char *ref; // NULL for data in the copy buffer (at off).
+    size_t off;
+    size_t len;
+} iov_entry;
+
+typedef struct iov_batch {
+    iov_entry *entries;
+    int n, cap;
+    buffer copy;
+    size_t size; // total bytes queued.
+    // writev() calls made by iov_flush() and the ones that wrote less than
+    // asked (e.g for stats, they're only ever incremented).
+    int writes, partial_writes;
+} iov_batch;
+
+void iov_init(iov_batch *b);
+void iov_free(iov_batch *b);
+// Queues a reference to data which must stay valid until the next iov_flush().
+void iov_ref(iov_batch *b, const char *data, size_t len);
+// Queues a copy of data.
+void iov_copy(iov_batch *b, const char *data, size_t len);
+// Writes everything queued (retrying partial writes) and empties the batch.
+// Returns the number of bytes written, -1 if nothing could be written.
+ssize_t iov_flush(iov_batch *b, int fd);
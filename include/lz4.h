@@ -0,0 +1,29 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+// compression and decompression, without the frame format nor dictionaries:
+// greedy single hash matching (like lz4's default level), for terminal output
+// which is very repetitive (same sequences, runs of spaces...).
+
+// Maximum compressed size of n bytes (incompressible input).
+static inline size_t lz4_bound(size_t n) { return n + n / 255 + 16; }
+
+// Compresses src[0..n) into dst which must have lz4_bound(n) bytes, returns
+// the compressed size.
+size_t lz4_compress(const char *src, size_t n, char *dst);
+
+// Decompresses the n bytes block at src into dst[0..cap). Returns the
+// decompressed size, or -1 if the block is malformed or doesn't fit.
+ssize_t lz4_decompress(const char *src, size_t n, char *dst, size_t cap);
@@ -0,0 +1,159 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "ansi.h"
+#include "buf.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Indexed recording container (all integers little endian):
+//   header:  "APREC001", u16 version, u16 width, u16 height, u16 reserved, u64 start (unix epoch ns)
+//   chunks:  u64 timestamp (ns since start, monotonic), u32 length, length bytes of terminal output
+//   index:   rec_frame entries (u64 chunk offset, u32 skip, u32 kind, u64 timestamp)
+//   footer:  u64 index offset, u64 entries count, "APRECIDX"
+// The index and footer are written when the recording is closed, a recording
+// without them (e.g interrupted) is reindexed by scanning its chunks.
+// Compressed recordings (version 2) have the same header and footer but the
+// chunks are in LZ4 blocks (u32 compressed size, u32 size, the block, stored
+// as is when the compressed size is the same), starting at clear screen
+// frames when possible so seeking decompresses only what's shown. Their
+// index chunk offsets are in the uncompressed stream of chunks (as if the
+// file wasn't compressed).
+
+enum {
+    REC_HEADER_SIZE = 24,
+    REC_CHUNK_HEADER_SIZE = 12,
+    REC_FRAME_SIZE = 24,
+    REC_FOOTER_SIZE = 24,
+    REC_BLOCK_HEADER_SIZE = 8,
+    REC_BLOCK_SIZE = 1 << 18, // compressed blocks are cut after that much data...
+    REC_BLOCK_MIN = 1 << 15,  // ...and at clear screens after that much.
+};
+
+typedef enum rec_frame_kind {
+    REC_FRAME_CLEAR = 1, // starts with a clear screen (CSI J) sequence.
+    REC_FRAME_SYNC = 2,  // starts right after an end of synchronized output (CSI ?2026l).
+} rec_frame_kind;
+
+typedef struct rec_frame {
+    uint64_t chunk_offset; // offset of the header of the chunk where the frame starts (see compressed recordings).
+    uint32_t skip;         // offset of the frame start in that chunk data.
+    uint32_t kind;         // rec_frame_kind.
+    uint64_t ts;           // timestamp of that chunk.
+} rec_frame;
+
+// Finds the frame boundaries in the chunks fed to it.
+typedef struct rec_indexer {
+    ansi_tokenizer tok;
+    uint64_t pos;      // stream offset of the next token.
+    uint64_t chunk_in; // stream offset of the current chunk data.
+    struct {
+        uint64_t offset, stream, ts;
+    } chunks[16]; // recent chunks to locate frames starting in a previous one.
+    int n_chunks;
+    rec_frame *frames;
+    size_t n_frames, cap_frames;
+} rec_indexer;
+
+void rec_indexer_init(rec_indexer *ix);
+void rec_indexer_free(rec_indexer *ix);
+// Feeds the data of the chunk whose header is at file offset offset.
+void rec_indexer_feed(rec_indexer *ix, uint64_t offset, uint64_t ts, const char *data, size_t len);
+
+typedef struct rec_writer {
+    FILE *f;
+    bool raw;        // plain output file (rec_append), no container.
+    bool lz4;        // compressed recording (rec_create_compressed).
+    uint64_t offset; // current file offset (chunks stream offset when compressed).
+    uint64_t start;  // now_ns() at creation.
+    rec_indexer ix;
+    // Compressed recordings.
+    buffer block;         // chunks of the block being built.
+    buffer packed;        // its compressed version.
+    uint64_t file_offset; // where the block goes.
+    uint64_t packed_bytes;
+} rec_writer;
+
+// Creates (truncating) the recording file, returns NULL (error logged) on failure.
+rec_writer *rec_create(const char *path, int width, int height);
+// Same with LZ4 compressed chunks: the compression happens in rec_write, so
+// in the rec_queue thread when using one.
+rec_writer *rec_create_compressed(const char *path, int width, int height);
+// Opens path for appending the raw terminal output (no timestamps nor index).
+rec_writer *rec_append(const char *path);
+// Appends a chunk of terminal output timestamped now. Returns -1 on error.
+int rec_write(rec_writer *w, const char *data, size_t len);
+// Same as rec_write() for a chunk read at now (now_ns() clock).
+int rec_write_at(rec_writer *w, uint64_t now, const char *data, size_t len);
+// Writes the index and footer and closes the file. Returns -1 on error.
+int rec_close_writer(rec_writer *w);
+
+// Background writer shared by many recordings: rec_queue_write() only copies
+// the (timestamped) chunk, a thread writes them in batches at most every
+// REC_QUEUE_INTERVAL_NS. The writers must not be used directly meanwhile.
+enum { REC_QUEUE_INTERVAL_NS = 10 * 1000 * 1000 };
+typedef struct rec_queue rec_queue;
+
+// Returns NULL on error (logged).
+rec_queue *rec_queue_start(void);
+void rec_queue_write(rec_queue *q, rec_writer *w, const char *data, size_t len);
+// Writes everything queued and stops the thread (close the writers after).
+// Returns -1 if any write failed (logged).
+int rec_queue_stop(rec_queue *q);
+
+typedef struct rec_block {
+    uint64_t offset; // chunks stream offset.
+    uint64_t file;   // file offset of the block's data.
+    uint32_t size, packed;
+} rec_block;
+
+typedef struct rec_reader {
+    int fd;
+    int width, height;
+    uint64_t start;
+    bool indexed; // index read from the footer (vs rebuilt by scanning).
+    bool lz4;     // compressed recording: the offsets below are in the chunks stream.
+    rec_block *blocks;
+    size_t n_blocks;
+    size_t cur;      // index of the block in block (n_blocks when none).
+    buffer block;    // the current decompressed block.
+    buffer packed;   // its compressed data.
+    rec_frame *frames;
+    size_t n_frames;
+    uint64_t data_end; // end of the chunks.
+    uint64_t next;     // file offset of the next chunk header.
+    uint64_t at;       // file offset of the next data byte in the current chunk.
+    uint32_t left;     // bytes left in the current chunk.
+    uint32_t skip;     // bytes to skip at the start of the next chunk (after a seek).
+    uint64_t ts;       // timestamp of the current chunk.
+} rec_reader;
+
+// Returns NULL if fd is not a (seekable) recording or can't be read (error
+// logged, errno set). Uses pread() so the fd offset is left untouched.
+rec_reader *rec_open(int fd);
+// Another reader of the same recording (e.g for another thread), without
+// reading its index again.
+rec_reader *rec_clone(const rec_reader *r);
+// Frees the reader, doesn't close fd.
+void rec_close_reader(rec_reader *r);
+// Reads up to n bytes of terminal output (read_n() like). Returns 0 at the end, -1 on error.
+ssize_t rec_read(rec_reader *r, buffer *b, size_t n);
+// Next rec_read() starts at that frame.
+void rec_seek(rec_reader *r, const rec_frame *frame);
+// Appends the terminal output from frame from up to frame to (NULL for the
+// end) to b. Returns the number of bytes read, -1 on error.
+ssize_t rec_read_frames(rec_reader *r, buffer *b, const rec_frame *from, const rec_frame *to);
+// Returns the nth (from 0) clear screen frame, or NULL if there aren't that many.
+const rec_frame *rec_find_clear(const rec_reader *r, size_t nth);
+// Returns the last clear screen frame at or before ts (ns since start), or NULL if none.
+const rec_frame *rec_find_time(const rec_reader *r, uint64_t ts);
+// Number of clear screen frames before frame.
+size_t rec_clear_count(const rec_reader *r, const rec_frame *frame);
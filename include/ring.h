@@ -0,0 +1,55 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "buf.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed capacity circular byte queue: bounded memory and no compaction
+// copies for streaming (read, parse, write) paths. When possible the storage
+// is mapped twice back to back (mirrored) so the whole readable data and the
+// whole free room are always contiguous; otherwise spans stop at the wrap
+// point and the _fd helpers below do the two parts.
+typedef struct ring {
+    char *data;
+    size_t cap;          // power of 2 (a multiple of the page size when mirrored).
+    uint64_t head, tail; // read and write positions (never wrap), size is tail - head.
+    bool mirrored;
+} ring;
+
+// Allocates a ring of at least min_cap bytes. Returns false on error (logged).
+bool ring_init(ring *r, size_t min_cap);
+void ring_free(ring *r);
+
+static inline size_t ring_size(const ring *r) { return (size_t)(r->tail - r->head); }
+static inline size_t ring_room(const ring *r) { return r->cap - ring_size(r); }
+static inline void ring_clear(ring *r) { r->head = r->tail = 0; }
+
+// Contiguous readable data as a non owning (zero cap) buffer: everything
+// when mirrored, up to the wrap point otherwise. Valid until the next consume.
+buffer ring_view(const ring *r);
+void ring_consume(ring *r, size_t n);
+
+// Reserve/commit: returns where the next bytes go and sets *n to how many
+// fit contiguously (0 when full), ring_commit then adds the bytes written.
+char *ring_reserve(ring *r, size_t *n);
+void ring_commit(ring *r, size_t n);
+// Appends all of data or nothing (returns false) if there isn't enough room.
+bool ring_append(ring *r, const char *data, size_t n);
+
+// Reads as much as fits (one read() when mirrored). Returns bytes read, 0 at
+// end of file, -1 on error (ENOBUFS when full).
+ssize_t ring_read(int fd, ring *r);
+// Writes and consumes as much as the (possibly nonblocking) fd accepts right
+// now, see write_avail(). Returns bytes written, -1 on error.
+ssize_t ring_write_avail(int fd, ring *r);
+// Moves up to n bytes to the end of dest. Returns how many were moved.
+size_t ring_transfer(buffer *dest, ring *src, size_t n);
@@ -0,0 +1,32 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stddef.h>
+
+// Vectorized (SSE2/AVX2/NEON with scalar fallback) scanning for the bytes
+// that matter when parsing ANSI sequences. All return a pointer to the
+// first (or last) matching byte of s[0..n), or NULL if there is none.
+
+// Name of the implementation compiled in ("avx2", "sse2", "neon" or "scalar").
+const char *scan_impl(void);
+
+// ESC (0x1b).
+const char *scan_esc(const char *s, size_t n);
+// ESC or BEL: OSC string terminators (BEL or ST, ie ESC \).
+const char *scan_esc_or_bel(const char *s, size_t n);
+// CSI final byte (0x40..0x7E).
+const char *scan_csi_final(const char *s, size_t n);
+// Any of the up to 4 accept bytes (use mempbrk for more).
+const char *scan_any4(const char *s, size_t n, const char *accept, size_t accept_len);
+// First byte >= 0x80 (UTF-8 multi byte sequences).
+const char *scan_non_ascii(const char *s, size_t n);
+// Last ESC, scanning backwards.
+const char *scan_last_esc(const char *s, size_t n);
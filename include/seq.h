@@ -0,0 +1,54 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+// Escape sequences as string literals, so compound ones are concatenated at
+// compile time and emitted with a single copy (e.g append_str(b, STR(SEQ_CLEAR_HOME))).
+
+#define SEQ_CSI "\033["
+
+#define SEQ_SYNC_START SEQ_CSI "?2026h" // synchronized output (DEC mode 2026).
+#define SEQ_SYNC_END SEQ_CSI "?2026l"
+#define SEQ_CURSOR_HIDE SEQ_CSI "?25l"
+#define SEQ_CURSOR_SHOW SEQ_CSI "?25h"
+#define SEQ_CURSOR_SAVE "\0337" // DECSC, also saves the rendition.
+#define SEQ_CURSOR_RESTORE "\0338"
+#define SEQ_HOME SEQ_CSI "H"
+#define SEQ_CLEAR_ALL SEQ_CSI "2J"
+#define SEQ_CLEAR_BELOW SEQ_CSI "0J"
+#define SEQ_MARGINS_RESET SEQ_CSI "r"
+#define SEQ_DA1 SEQ_CSI "c" // primary device attributes request.
+
+#define SEQ_PASTE_ON SEQ_CSI "?2004h"
+#define SEQ_PASTE_OFF SEQ_CSI "?2004l"
+#define SEQ_MOUSE_SGR_ON SEQ_CSI "?1006h"
+#define SEQ_MOUSE_DRAG_ON SEQ_CSI "?1002h"
+#define SEQ_MOUSE_ANY_ON SEQ_CSI "?1003h"
+#define SEQ_MOUSE_ANY_OFF SEQ_CSI "?1003l"
+#define SEQ_MOUSE_DRAG_OFF SEQ_CSI "?1002l"
+#define SEQ_MOUSE_SGR_OFF SEQ_CSI "?1006l"
+#define SEQ_FOCUS_ON SEQ_CSI "?1004h"
+#define SEQ_FOCUS_OFF SEQ_CSI "?1004l"
+#define SEQ_KITTY_KEYBOARD_POP SEQ_CSI "<u"
+
+// Capability queries.
+#define SEQ_QUERY_SYNC SEQ_CSI "?2026$p" // DECRQM, answered with CSI ? 2026 ; state $ y
+#define SEQ_QUERY_PASTE SEQ_CSI "?2004$p"
+#define SEQ_QUERY_KITTY_KEYBOARD SEQ_CSI "?u" // answered with CSI ? flags u
+// A 1x1 RGB image query, answered with APC G i=31;OK ST (or an error).
+#define SEQ_QUERY_KITTY_GRAPHICS "\033_Gi=31,s=1,v=1,a=q,t=d,f=24;AAAA\033\\"
+
+// Compound sequences.
+#define SEQ_CLEAR_FIRST SEQ_CLEAR_ALL SEQ_HOME   // pushes the old content to the scrollback.
+#define SEQ_CLEAR_HOME SEQ_HOME SEQ_CLEAR_BELOW  // doesn't pile up on the scrollback.
+#define SEQ_MOUSE_DRAG SEQ_MOUSE_DRAG_ON SEQ_MOUSE_SGR_ON // buttons, wheel and drags.
+#define SEQ_MOUSE_ANY SEQ_MOUSE_ANY_ON SEQ_MOUSE_SGR_ON   // also all motions.
+#define SEQ_MOUSE_OFF SEQ_MOUSE_ANY_OFF SEQ_MOUSE_DRAG_OFF SEQ_MOUSE_SGR_OFF
+#define SEQ_QUERY_CAPS SEQ_QUERY_SYNC SEQ_QUERY_PASTE SEQ_QUERY_KITTY_KEYBOARD SEQ_QUERY_KITTY_GRAPHICS
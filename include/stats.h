@@ -0,0 +1,34 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Log-linear histogram of non negative integer samples (e.g nanoseconds or
+// bytes): 8 linear sub-buckets per power of 2, so quantiles are within 12.5%
+// and adding a sample is a few instructions without any allocation.
+enum {
+    HIST_SUB_BITS = 3,
+    HIST_BUCKETS = (48 - HIST_SUB_BITS + 1) << HIST_SUB_BITS, // samples up to 2^48, larger ones are clamped.
+};
+
+typedef struct histogram {
+    uint64_t count, sum, min, max;
+    uint64_t buckets[HIST_BUCKETS];
+} histogram;
+
+void hist_add(histogram *h, uint64_t v);
+void hist_reset(histogram *h);
+// Merges src's samples into dst.
+void hist_merge(histogram *dst, const histogram *src);
+// Value at quantile q (0..1, e.g 0.99), the upper bound of the bucket it falls in
+// (but not more than max). 0 without samples.
+uint64_t hist_quantile(const histogram *h, double q);
+static inline uint64_t hist_mean(const histogram *h) { return h->count ? h->sum / h->count : 0; }
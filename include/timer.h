@@ -13,4 +13,5 @@
 
 void time_init(void);
 uint64_t now_ns(void);
+// Sleeps until the now_ns() time deadline (clock_nanosleep TIMER_ABSTIME where available).
 void sleep_until_ns(uint64_t deadline);
@@ -0,0 +1,66 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#pragma once
+
+#include "str.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Decodes the code point at s (n > 0 bytes) and sets *len to its length.
+// Invalid sequences (bad or missing continuation bytes, overlongs, surrogates,
+// above U+10FFFF) decode as U+FFFD consuming 1 byte.
+uint32_t utf8_decode(const unsigned char *s, size_t n, size_t *len);
+// Length of the longest valid UTF-8 prefix of s (ASCII runs are skipped with
+// the vectorized scan_non_ascii).
+size_t utf8_valid(const char *s, size_t n);
+// Number of bytes (0..3) at the end of s that are the start of a valid but
+// not yet complete multi byte sequence: 0 when s ends on a complete code point
+// (or on invalid bytes more input wouldn't fix).
+size_t utf8_partial(const char *s, size_t n);
+
+// Display width of code point c: 0 for combining and other zero width code
+// points, 2 for East Asian wide and fullwidth ones (which include the emoji
+// with emoji presentation), 1 otherwise. Two level table generated by
+// scripts/gen_utf8_width.py.
+int utf8_width(uint32_t c);
+// Length in bytes of the grapheme cluster at s (n > 0; a simplified UAX #29:
+// a base and its combining marks, variation selectors, emoji modifiers and
+// zero width joiner sequences, or a pair of regional indicators making a
+// flag), and sets *width to its display width (2 with a VS16 emoji
+// presentation selector or for a flag, 0 for stray combining marks).
+size_t utf8_grapheme(const char *s, size_t n, int *width);
+// Display width of s, the sum of its grapheme clusters'.
+int utf8_str_width(string s);
+
+// Grapheme clusters of more than one code point are interned process wide
+// (never freed) so a cell's glyph stays a fixed size 32 bits value: code points
+// are below 0x110000, interned clusters have the CLUSTER_GLYPH bit, CLUSTER_WIDE
+// when 2 columns wide, and their id in the low bits.
+#define CLUSTER_GLYPH 0x40000000u
+#define CLUSTER_WIDE 0x20000000u
+// Longest cluster (in bytes) that can be interned.
+#define CLUSTER_MAX 31
+
+// Returns the glyph for the cluster s[0..n) of the given width, 0 if it's too
+// long or the table is full (logged once).
+uint32_t cluster_intern(const char *s, size_t n, int width);
+// The UTF-8 bytes of an interned cluster glyph (valid forever, thread safe).
+string cluster_string(uint32_t glyph);
+
+// Columns taken by a cell glyph (code point or interned cluster).
+static inline int glyph_width(uint32_t glyph) {
+    if (glyph < 0x300) {
+        return 1; // ASCII, Latin-1 and the other alphabets before the first combining marks.
+    }
+    if (glyph & CLUSTER_GLYPH) {
+        return glyph & CLUSTER_WIDE ? 2 : 1;
+    }
+    return utf8_width(glyph);
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Generates src/utf8_width.h, the two level display width table used by
+# utf8_width(), from the Unicode data of the running python (unicodedata).
+# (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+# No warranty implied or expressly granted. Licensed under Apache 2.0 (see LICENSE).
+# Ran from parent directory via `make utf8-width`.
+import unicodedata
+
+MAX = 0x110000
+BLOCK = 256
+
+# Visible format characters (prepended concatenation marks) and the soft hyphen.
+VISIBLE_CF = {0x00AD, 0x0600, 0x0601, 0x0602, 0x0603, 0x0604, 0x0605, 0x06DD, 0x070F, 0x0890, 0x0891, 0x08E2,
+              0x110BD, 0x110CD}
+
+
+def width(c):
+    if 0x1160 <= c <= 0x11FF or 0xD7B0 <= c <= 0xD7FF:
+        return 0  # Hangul jamo vowels and finals combine with the leading consonant.
+    if 0x1F3FB <= c <= 0x1F3FF:
+        return 0  # emoji skin tone modifiers extend the previous emoji.
+    cat = unicodedata.category(chr(c))
+    if cat in ("Mn", "Me") or (cat == "Cf" and c not in VISIBLE_CF):
+        return 0
+    if unicodedata.east_asian_width(chr(c)) in ("W", "F"):
+        return 2
+    if 0x20000 <= c <= 0x2FFFD or 0x30000 <= c <= 0x3FFFD:
+        return 2  # CJK ideograph planes, including unassigned code points.
+    return 1
+
+
+blocks, index = [], []
+seen = {}
+for b in range(MAX // BLOCK):
+    packed = bytearray(BLOCK // 4)
+    for i in range(BLOCK):
+        packed[i // 4] |= width(b * BLOCK + i) << (2 * (i % 4))
+    packed = bytes(packed)
+    if packed not in seen:
+        seen[packed] = len(blocks)
+        blocks.append(packed)
+    index.append(seen[packed])
+
+header = open("scripts/header.txt").read().rstrip("\n")
+out = [header, f"// Generated by scripts/gen_utf8_width.py from Unicode {unicodedata.unidata_version}, do not edit.",
+       "// Display width (0, 1 or 2) of code point c: 2 bits at",
+       "// utf8_width_blocks[utf8_width_index[c >> 8]][(c & 0xFF) >> 2] >> (2 * (c & 3)).",
+       "",
+       f"static const uint8_t utf8_width_index[{len(index)}] = {{"]
+for i in range(0, len(index), 24):
+    out.append("    " + ", ".join(str(v) for v in index[i:i + 24]) + ",")
+out.append("};")
+out.append("")
+out.append(f"static const uint8_t utf8_width_blocks[{len(blocks)}][{BLOCK // 4}] = {{")
+for blk in blocks:
+    out.append("    {")
+    for i in range(0, len(blk), 16):
+        out.append("        " + ", ".join("0x%02X" % v for v in blk[i:i + 16]) + ",")
+    out.append("    },")
+out.append("};")
+open("src/utf8_width.h", "w").write("\n".join(out) + "\n")
+print(f"{len(blocks)} blocks, {len(index) + len(blocks) * BLOCK // 4} bytes")
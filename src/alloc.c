@@ -0,0 +1,105 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "alloc.h"
+#include "log.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *xmalloc(size_t n) {
+    void *p = malloc(n);
+    if (p == NULL) {
+        LOG_ERROR("Failed to allocate %zu bytes: %s", n, strerror(errno));
+        abort();
+    }
+    return p;
+}
+
+static inline size_t align16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+// --- Pool
+
+static inline bool in_pool(const pool *p, const void *ptr) {
+    const char *c = ptr;
+    return c >= p->slab && c < p->slab + p->block * p->count;
+}
+
+static void *pool_grow(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    pool *p = ctx;
+    if (ptr != NULL && !in_pool(p, ptr)) {
+        return realloc(ptr, new_size); // already moved to the heap.
+    }
+    if (new_size <= p->block) {
+        if (ptr != NULL) {
+            return ptr; // the block is big enough.
+        }
+        void *b = pool_get(p);
+        if (b != NULL) {
+            return b;
+        }
+    }
+    p->overflows++;
+    void *n = xmalloc(new_size);
+    if (ptr != NULL) {
+        memcpy(n, ptr, old_size);
+        pool_put(p, ptr);
+    }
+    return n;
+}
+
+static void pool_release(void *ctx, void *ptr, size_t size) {
+    (void)size;
+    pool *p = ctx;
+    if (in_pool(p, ptr)) {
+        pool_put(p, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+void pool_init(pool *p, size_t block, size_t count) {
+    *p = (pool){0};
+    p->block = align16(block < sizeof(void *) ? sizeof(void *) : block);
+    p->count = count;
+    p->slab = xmalloc(p->block * count);
+    for (size_t i = count; i-- > 0;) {
+        void **b = (void **)(p->slab + i * p->block);
+        *b = p->free_list;
+        p->free_list = b;
+    }
+    p->alloc = (buf_allocator){pool_grow, pool_release, p};
+}
+
+void pool_free(pool *p) {
+    if (p->in_use != 0) {
+        LOG_ERROR("Freeing pool with %d blocks still in use", p->in_use);
+    }
+    free(p->slab);
+    *p = (pool){0};
+}
+
+void *pool_get(pool *p) {
+    void **b = p->free_list;
+    if (b == NULL) {
+        return NULL;
+    }
+    p->free_list = *b;
+    p->in_use++;
+    p->peak = p->in_use > p->peak ? p->in_use : p->peak;
+    return b;
+}
+
+void pool_put(pool *p, void *block) {
+    void **b = block;
+    *b = p->free_list;
+    p->free_list = b;
+    p->in_use--;
+}
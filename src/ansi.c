@@ -0,0 +1,237 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "ansi.h"
+#include "scan.h"
+
+enum {
+    ST_GROUND,
+    ST_ESC,       // after ESC
+    ST_ESC_INTER, // after ESC and intermediate(s), waiting for the final byte
+    ST_CSI,       // after ESC [
+    ST_STRING,    // in an OSC/DCS/SOS/PM/APC string
+    ST_STRING_ESC // ESC in a string, ST if followed by backslash
+};
+
+enum { MAX_PARAM = 99999 }; // saturate instead of overflowing on silly inputs.
+
+static void start_seq(ansi_tokenizer *t) {
+    t->state = ST_ESC;
+    t->tok.final = 0;
+    t->tok.prefix = 0;
+    t->tok.intermediate = 0;
+    t->tok.n_params = 0;
+    t->tok.payload = NULL;
+    t->tok.payload_size = 0;
+    t->cur = -1;
+    t->has_params = false;
+}
+
+void ansi_init(ansi_tokenizer *t, ansi_callback cb, void *ctx) {
+    *t = (ansi_tokenizer){.state = ST_GROUND, .cb = cb, .ctx = ctx};
+    t->seq = new_buf(64);
+}
+
+void ansi_free(ansi_tokenizer *t) { free_buf(&t->seq); }
+
+void ansi_reset(ansi_tokenizer *t) {
+    t->state = ST_GROUND;
+    clear_buf(&t->seq);
+}
+
+bool ansi_in_sequence(const ansi_tokenizer *t) { return t->state != ST_GROUND; }
+
+static inline void push_param(ansi_tokenizer *t) {
+    if (t->tok.n_params < ANSI_MAX_PARAMS) {
+        t->tok.params[t->tok.n_params++] = t->cur;
+    }
+    t->cur = -1;
+}
+
+// Emits the sequence ending at end (exclusive) that started at seq_start, or at
+// the start of the chunk data if it spanned chunks (its beginning then being
+// in t->seq). Returns true if the callback asked to stop.
+static bool emit_seq(ansi_tokenizer *t, ansi_token_type type, const char *seq_start, const char *end, int term_len) {
+    t->state = ST_GROUND;
+    if (t->cb == NULL) {
+        return false;
+    }
+    ansi_token *tok = &t->tok;
+    tok->type = type;
+    if (t->seq.size > 0) {
+        append_data(&t->seq, seq_start, (size_t)(end - seq_start));
+        tok->data = t->seq.data + t->seq.start;
+        tok->size = t->seq.size;
+    } else {
+        tok->data = seq_start;
+        tok->size = (size_t)(end - seq_start);
+    }
+    if (type == ANSI_STRING) {
+        tok->payload = tok->data + 2;
+        tok->payload_size = tok->size - 2 - (size_t)term_len;
+    }
+    int stop = t->cb(t->ctx, tok);
+    clear_buf(&t->seq);
+    return stop != 0;
+}
+
+// Malformed (e.g ESC followed by a control character or a CSI interrupted by
+// another ESC): emitted as an ESC token with a 0 final, the byte that
+// interrupted it is then processed normally. So tokens always cover the stream.
+static bool emit_aborted(ansi_tokenizer *t, const char *seq_start, const char *end) {
+    t->tok.final = 0;
+    return emit_seq(t, ANSI_ESC, seq_start, end, 0);
+}
+
+size_t ansi_feed(ansi_tokenizer *t, const char *data, size_t n) {
+    const char *p = data;
+    const char *end = data + n;
+    const char *seq_start = data; // start of the current sequence in this chunk.
+    while (p < end) {
+        unsigned char c;
+        switch (t->state) {
+        case ST_GROUND: {
+            const char *esc = scan_esc(p, (size_t)(end - p));
+            const char *stop = esc != NULL ? esc : end;
+            if (stop > p && t->cb != NULL) {
+                t->tok.type = ANSI_TEXT;
+                t->tok.final = t->tok.prefix = t->tok.intermediate = 0;
+                t->tok.n_params = 0;
+                t->tok.data = p;
+                t->tok.size = (size_t)(stop - p);
+                if (t->cb(t->ctx, &t->tok)) {
+                    return (size_t)(stop - data);
+                }
+            }
+            if (esc == NULL) {
+                return n;
+            }
+            start_seq(t);
+            seq_start = esc;
+            p = esc + 1;
+            break;
+        }
+        case ST_ESC:
+            c = (unsigned char)*p++;
+            switch (c) {
+            case '[':
+                t->state = ST_CSI;
+                break;
+            case ']':
+            case 'P':
+            case 'X':
+            case '^':
+            case '_':
+                t->tok.final = (char)c;
+                t->state = ST_STRING;
+                break;
+            default:
+                if (c >= 0x20 && c <= 0x2F) {
+                    t->tok.intermediate = (char)c;
+                    t->state = ST_ESC_INTER;
+                } else if (c >= 0x30 && c <= 0x7E) {
+                    t->tok.final = (char)c;
+                    if (emit_seq(t, ANSI_ESC, seq_start, p, 0)) {
+                        return (size_t)(p - data);
+                    }
+                } else {
+                    p--;
+                    if (emit_aborted(t, seq_start, p)) {
+                        return (size_t)(p - data);
+                    }
+                }
+            }
+            break;
+        case ST_ESC_INTER:
+            c = (unsigned char)*p++;
+            if (c >= 0x20 && c <= 0x2F) {
+                t->tok.intermediate = (char)c;
+            } else if (c >= 0x30 && c <= 0x7E) {
+                t->tok.final = (char)c;
+                if (emit_seq(t, ANSI_ESC, seq_start, p, 0)) {
+                    return (size_t)(p - data);
+                }
+            } else {
+                p--;
+                if (emit_aborted(t, seq_start, p)) {
+                    return (size_t)(p - data);
+                }
+            }
+            break;
+        case ST_CSI:
+            while (p < end && t->state == ST_CSI) {
+                c = (unsigned char)*p++;
+                if (c >= '0' && c <= '9') {
+                    t->cur = t->cur < 0 ? c - '0' : t->cur * 10 + (c - '0');
+                    if (t->cur > MAX_PARAM) {
+                        t->cur = MAX_PARAM;
+                    }
+                    t->has_params = true;
+                } else if (c == ';' || c == ':') {
+                    push_param(t);
+                    t->has_params = true;
+                } else if (c >= '<' && c <= '?') {
+                    if (!t->has_params && t->tok.prefix == 0 && t->tok.intermediate == 0) {
+                        t->tok.prefix = (char)c;
+                    }
+                } else if (c >= 0x20 && c <= 0x2F) {
+                    t->tok.intermediate = (char)c;
+                } else if (c >= 0x40 && c <= 0x7E) {
+                    if (t->has_params) {
+                        push_param(t);
+                    }
+                    t->tok.final = (char)c;
+                    if (emit_seq(t, ANSI_CSI, seq_start, p, 0)) {
+                        return (size_t)(p - data);
+                    }
+                } else if (c == 0x1b) {
+                    // Interrupted CSI, a new sequence starts.
+                    p--;
+                    if (emit_aborted(t, seq_start, p)) {
+                        return (size_t)(p - data);
+                    }
+                }
+                // Other (C0 controls, 0x7F and above) are ignored and kept in the raw bytes.
+            }
+            break;
+        case ST_STRING: {
+            size_t left = (size_t)(end - p);
+            const char *term = t->tok.final == ']' ? scan_esc_or_bel(p, left) : scan_esc(p, left);
+            if (term == NULL) {
+                p = end;
+            } else if (*term == '\a') {
+                p = term + 1;
+                if (emit_seq(t, ANSI_STRING, seq_start, p, 1)) {
+                    return (size_t)(p - data);
+                }
+            } else {
+                p = term + 1;
+                t->state = ST_STRING_ESC;
+            }
+            break;
+        }
+        case ST_STRING_ESC:
+            if (*p == '\\') {
+                p++;
+                if (emit_seq(t, ANSI_STRING, seq_start, p, 2)) {
+                    return (size_t)(p - data);
+                }
+            } else {
+                // Not ST, part of the payload.
+                t->state = ST_STRING;
+            }
+            break;
+        }
+    }
+    if (t->state != ST_GROUND && t->cb != NULL) {
+        // Chunk ends in the middle of a sequence: keep its bytes for when it completes.
+        append_data(&t->seq, seq_start, (size_t)(end - seq_start));
+    }
+    return n;
+}
@@ -8,9 +8,20 @@
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #include "ansipixels.h"
+#include "fmt.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
 static ap_t global_ap = NULL;
 
+// SIGWINCH only sets this flag and writes to the self-pipe (so it can be
+// waited on), the size itself is read outside of signal context by ap_poll_size().
+static atomic_int winch_pending;
+static int winch_pipe[2] = {-1, -1};
+
 static void ap_update_size(ap_t ap) {
     struct winsize ws;
     if (ioctl(ap->out, TIOCGWINSZ, &ws) < 0) {
@@ -37,28 +48,123 @@ static void ap_update_size(ap_t ap) {
     ap->xpixel = ws.ws_xpixel;
     ap->ypixel = ws.ws_ypixel;
     ap->resized = true;
+    // Even at the same size (e.g. back and forth) the terminal may have reflowed the content.
+    ap_invalidate_all(ap);
 }
 
 static void handle_winch(int sig) {
-    LOG_DEBUG("Signal: received signal %d", sig);
-    if (global_ap) {
-        ap_update_size(global_ap);
+    (void)sig;
+    int saved_errno = errno;
+    atomic_store(&winch_pending, 1);
+    char c = 0;
+    if (write(winch_pipe[1], &c, 1) < 0) {
+        // pipe full: a wakeup is already pending.
+    }
+    errno = saved_errno;
+}
+
+// Processes a pending SIGWINCH: updates the size and sets ap->resized if it changed.
+static void ap_poll_size(ap_t ap) {
+    if (atomic_load(&winch_pending) == 0) {
+        return;
+    }
+    // Drain first: a signal arriving after this leaves both the flag and a byte.
+    char drain[64];
+    while (read(winch_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+    if (atomic_exchange(&winch_pending, 0)) {
+        LOG_DEBUG("Processing SIGWINCH");
+        ap_update_size(ap);
     }
 }
 
+bool ap_check_resize(ap_t ap) {
+    ap_poll_size(ap);
+    bool resized = ap->resized;
+    ap->resized = false;
+    return resized;
+}
+
+// Render thread: the app thread copies its back grid into a triple buffer slot
+// and publishes it by swapping it with the middle slot, the render thread swaps
+// the middle slot with its own when there is a fresh one. Neither ever waits
+// for the other, and frames the render thread didn't get to are just replaced.
+enum { SLOT_FRESH = 4 }; // flag on the middle slot index: published but not taken yet.
+
+struct ap_render {
+    pthread_t thread;
+    grid slots[3];
+    atomic_int middle;    // index of the middle slot | SLOT_FRESH.
+    int produce, consume; // slots owned by the app and render threads.
+    atomic_bool stop;
+    atomic_bool invalidate; // ap_invalidate_all() request.
+    // Union of the back grid's dirty spans since the last publish known to be
+    // taken (acc_w x acc_h, all dirty after a size change).
+    grid_span *acc;
+    int acc_w, acc_h;
+    int wake[2];            // self-pipe to wake the render thread.
+    atomic_int rendered;    // frames rendered.
+    // The render thread's ap->stats as of its last frame, for ap_stats_get().
+    pthread_mutex_t stats_lock;
+    ap_stats stats;
+    atomic_bool stats_reset; // ap_stats_reset() request.
+};
+
+static void ap_render_stop_internal(ap_t ap);
+
+static void ap_release(ap_t ap) {
+    free_buf(&ap->buf);
+    free_buf(&ap->input);
+    ansi_free(&ap->in_tok);
+    sixel_free(ap->sixel);
+    ring_free(&ap->pending);
+    iov_free(&ap->out_iov);
+    free_grid(&ap->front);
+    free_grid(&ap->back);
+    free(ap->row_hashes);
+    free(ap);
+}
+
 void ap_cleanup(void) {
     if (!global_ap) {
         return; // nothing to clean up
     }
+    ap_render_stop_internal(global_ap);
     ap_show_cursor(global_ap);
     ap_end(global_ap);
     ap_paste_off(global_ap);
+    ap_mouse_off(global_ap);
+    ap_focus_off(global_ap);
+    ap_kitty_keyboard_off(global_ap);
+    ap_nonblocking(global_ap, false);
     term_restore();
-    free_buf(&global_ap->buf);
-    free(global_ap);
+    ap_release(global_ap);
     global_ap = NULL;
 }
 
+ap_t ap_new(int out, int w, int h) {
+    time_init();
+    ap_t ap = calloc(1, sizeof(struct ap));
+    if (!ap) {
+        LOG_ERROR("Failed to allocate ap struct (%s)", strerror(errno));
+        return NULL;
+    }
+    ap->out = out;
+    ap->w = w;
+    ap->h = h;
+    ap->first_clear = true;
+    ap->cx = ap->cy = -1; // cursor position unknown
+    ap->resize_fd = -1;
+    ap_set_caps(ap, AP_CAPS_DEFAULT);
+    return ap;
+}
+
+void ap_free(ap_t ap) {
+    ap_render_stop_internal(ap);
+    ap_nonblocking(ap, false);
+    ap_release(ap);
+}
+
 #if DEBUGGER_WAIT
 volatile int wait_for_debugger = 1;
 #endif
@@ -74,19 +180,26 @@ ap_t ap_open(void) {
         sleep(1);
     }
 #endif
-    time_init();
-    ap_t ap = calloc(1, sizeof(struct ap));
+    ap_t ap = ap_new(STDOUT_FILENO, 0, 0);
     if (!ap) {
-        LOG_ERROR("Failed to allocate ap struct (%s)", strerror(errno));
         return NULL;
     }
-    ap->out = STDOUT_FILENO;
-    ap->first_clear = true;
     if (term_raw() != 0) {
         LOG_ERROR("Failed to enter raw mode (%s)", strerror(errno));
         return NULL;
     }
     ap_update_size(ap); // get the initial size.
+    if (winch_pipe[0] < 0) {
+        if (pipe(winch_pipe) != 0) {
+            LOG_ERROR("Failed to create resize pipe (%s)", strerror(errno));
+            return NULL;
+        }
+        for (int i = 0; i < 2; i++) {
+            fcntl(winch_pipe[i], F_SETFL, fcntl(winch_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(winch_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+    ap->resize_fd = winch_pipe[0];
     // Set up SIGWINCH handler without SA_RESTART so read() gets interrupted
     struct sigaction sa = {0};
     sa.sa_handler = handle_winch;
@@ -98,97 +211,1757 @@ ap_t ap_open(void) {
     return ap;
 }
 
+// Single write() to the terminal, accounted in ap->stats.
+static ssize_t ap_out(ap_t ap, const char *data, size_t n) {
+    uint64_t start = now_ns();
+    ssize_t w = write(ap->out, data, n);
+    ap->stats.blocked_ns += now_ns() - start;
+    ap->stats.writes++;
+    if (w > 0) {
+        ap->stats.bytes += (uint64_t)w;
+    }
+    if (w < (ssize_t)n) {
+        ap->stats.partial_writes++;
+    }
+    return w;
+}
+
+// Writes all of data, or in nonblocking mode as much as the terminal accepts
+// right now. Same returns as write_all() and write_avail().
+static ssize_t ap_out_all(ap_t ap, const char *data, size_t n) {
+    size_t total = 0;
+    while (total < n) {
+        ssize_t w = ap_out(ap, data + total, n - total);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (ap->nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        total += (size_t)w;
+    }
+    return (ssize_t)total;
+}
+
+// Sends as much of the queued output as the terminal accepts, -1 on error.
+static ssize_t ap_drain(ap_t ap) {
+    size_t total = 0;
+    while (ring_size(&ap->pending) > 0) {
+        buffer v = ring_view(&ap->pending);
+        ssize_t w = ap_out_all(ap, v.data, v.size);
+        if (w < 0) {
+            return total ? (ssize_t)total : -1;
+        }
+        ring_consume(&ap->pending, (size_t)w);
+        total += (size_t)w;
+        if ((size_t)w < v.size) {
+            break; // terminal is full.
+        }
+    }
+    return (ssize_t)total;
+}
+
+// Writes to the terminal now, or queues behind pending output in nonblocking
+// mode (waiting for the terminal to make room when the queue is full).
+static void ap_write(ap_t ap, const char *data, size_t n) {
+    if (!ap->nonblocking) {
+        ap_out_all(ap, data, n);
+        return;
+    }
+    if (ap_pending(ap) == 0) {
+        ssize_t w = ap_out_all(ap, data, n);
+        if (w < 0) {
+            LOG_ERROR("Error writing to terminal: %s", strerror(errno));
+            return;
+        }
+        data += w;
+        n -= (size_t)w;
+    }
+    while (n > 0) {
+        size_t room = ring_room(&ap->pending);
+        size_t c = n < room ? n : room;
+        ring_append(&ap->pending, data, c);
+        data += c;
+        n -= c;
+        if (n == 0) {
+            break;
+        }
+        struct pollfd pfd = {.fd = ap->out, .events = POLLOUT};
+        if ((poll(&pfd, 1, -1) < 0 && errno != EINTR) || ap_drain(ap) < 0) {
+            LOG_ERROR("Error writing to terminal: %s", strerror(errno));
+            return;
+        }
+    }
+}
+
+static inline void ap_write_str(ap_t ap, string s) { ap_write(ap, s.data, s.size); }
+
+size_t ap_pending(ap_t ap) {
+    if (ring_size(&ap->pending) > 0) {
+        ap_drain(ap);
+    }
+    return ring_size(&ap->pending);
+}
+
+int ap_nonblocking(ap_t ap, bool on) {
+    if (on == ap->nonblocking) {
+        return 0;
+    }
+    if (on) {
+        const char *tty = ttyname(ap->out);
+        int fd = tty != NULL ? open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK) : -1;
+        if (fd < 0) {
+            LOG_ERROR("Can't open the terminal for nonblocking output: %s", strerror(errno));
+            return -1;
+        }
+        if (ap->pending.cap == 0 && !ring_init(&ap->pending, AP_PENDING_SIZE)) {
+            close(fd);
+            return -1;
+        }
+        ap->out_blocking = ap->out;
+        ap->out = fd;
+        ap->nonblocking = true;
+        return 0;
+    }
+    // Give the queue a chance to drain (but don't hang forever on a stuck terminal).
+    struct pollfd pfd = {.fd = ap->out, .events = POLLOUT};
+    while (ap_pending(ap) > 0 && poll(&pfd, 1, 1000) > 0) {
+    }
+    if (ring_size(&ap->pending) > 0) {
+        LOG_ERROR("Dropping %zu bytes of output the terminal didn't accept", ring_size(&ap->pending));
+        ring_clear(&ap->pending);
+    }
+    close(ap->out);
+    ap->out = ap->out_blocking;
+    ap->nonblocking = false;
+    return 0;
+}
+
 void ap_paste_on(ap_t ap) {
+    if (!(ap->caps & AP_CAP_PASTE)) {
+        return;
+    }
     LOG_DEBUG("Enabling paste mode");
-    write_str(ap->out, STR("\033[?2004h"));
+    ap_write_str(ap, STR(SEQ_PASTE_ON));
 }
 
 void ap_paste_off(ap_t ap) {
+    if (!(ap->caps & AP_CAP_PASTE)) {
+        return;
+    }
     LOG_DEBUG("Disabling paste mode");
-    write_str(ap->out, STR("\033[?2004l"));
+    ap_write_str(ap, STR(SEQ_PASTE_OFF));
+}
+
+void ap_mouse_on(ap_t ap, bool motion) {
+    LOG_DEBUG("Enabling mouse reporting (motion %d)", motion);
+    // Button events with drags, or any motion, in the SGR encoding (no 223 columns limit).
+    ap_write_str(ap, motion ? STR(SEQ_MOUSE_ANY) : STR(SEQ_MOUSE_DRAG));
+    ap->mouse = true;
+}
+
+void ap_mouse_off(ap_t ap) {
+    if (!ap->mouse) {
+        return;
+    }
+    LOG_DEBUG("Disabling mouse reporting");
+    ap_write_str(ap, STR(SEQ_MOUSE_OFF));
+    ap->mouse = false;
+}
+
+void ap_focus_on(ap_t ap) {
+    ap_write_str(ap, STR(SEQ_FOCUS_ON));
+    ap->focus = true;
+}
+
+void ap_focus_off(ap_t ap) {
+    if (ap->focus) {
+        ap_write_str(ap, STR(SEQ_FOCUS_OFF));
+        ap->focus = false;
+    }
+}
+
+void ap_kitty_keyboard_on(ap_t ap, int flags) {
+    if (!(ap->caps & AP_CAP_KITTY_KEYBOARD)) {
+        return;
+    }
+    LOG_DEBUG("Pushing kitty keyboard flags %d", flags);
+    char seq[16] = SEQ_CSI ">";
+    char *p = fmt_int(seq + 3, flags);
+    *p++ = 'u';
+    ap_write(ap, seq, (size_t)(p - seq));
+    ap->kitty_keyboard = true;
+}
+
+void ap_kitty_keyboard_off(ap_t ap) {
+    if (ap->kitty_keyboard) {
+        ap_write_str(ap, STR(SEQ_KITTY_KEYBOARD_POP));
+        ap->kitty_keyboard = false;
+    }
 }
 
+// Appends a sequence that doesn't move the cursor (unlike ap_str which may).
+static inline void ap_seq(ap_t ap, string s) { append_data(&ap->buf, s.data, s.size); }
+
+static inline void ap_cursor_unknown(ap_t ap) { ap->cx = ap->cy = -1; }
+
+static void ap_sgr_unknown(ap_t ap);
+
 void ap_clear_screen(ap_t ap, bool immediate) {
     // First time we clear the screen, we use 2J to push old content to the
     // scrollback buffer, otherwise we use H+0J to not pile up on the scrollback.
-    string what = ap->first_clear ? STR("\033[2J\033[H") : STR("\033[H\033[0J");
+    string what = ap->first_clear ? STR(SEQ_CLEAR_FIRST) : STR(SEQ_CLEAR_HOME);
     ap->first_clear = false;
     if (immediate) {
-        write_str(ap->out, what);
+        ap_write_str(ap, what);
         return;
     }
-    ap_str(ap, what);
+    ap_seq(ap, what);
+    ap->cx = ap->cy = 0; // both variants end at home.
+}
+
+// Rebuilds the frame prologue and epilogue after a capability change.
+static void ap_frame_seqs(ap_t ap) {
+    bool sync = ap->caps & AP_CAP_SYNC;
+    string pro = sync ? STR(SEQ_SYNC_START) : STR("");
+    string epi = sync ? STR(SEQ_SYNC_END) : STR("");
+    memcpy(ap->frame_prologue, pro.data, pro.size);
+    ap->frame_prologue_len = (uint8_t)pro.size;
+    memcpy(ap->frame_epilogue, epi.data, epi.size);
+    ap->frame_epilogue_len = (uint8_t)epi.size;
+}
+
+void ap_set_caps(ap_t ap, unsigned caps) {
+    ap->caps = caps;
+    ap_frame_seqs(ap);
 }
 
 void ap_start(ap_t ap) {
+    ap->frame_start = now_ns();
     clear_buf(&ap->buf);            // reset buffer for new batch of commands
-    ap_str(ap, STR("\033[?2026h")); // start sync/batch mode
+    ap_cursor_unknown(ap); // anything could have been written since the last batch.
+    append_data(&ap->buf, ap->frame_prologue, ap->frame_prologue_len);
+}
+
+// Frame accounting at the end of ap_end(): built is when the batch was
+// complete, bytes its size and blocked the write time before flushing it.
+static void ap_frame_done(ap_t ap, uint64_t built, size_t bytes, uint64_t blocked) {
+    ap_stats *s = &ap->stats;
+    struct ap_render *r = ap->render;
+    if (r != NULL && atomic_exchange(&r->stats_reset, false)) {
+        *s = (ap_stats){0};
+        blocked = 0;
+    }
+    s->frames++;
+    if (ap->frame_start != 0) {
+        hist_add(&s->build_ns, built - ap->frame_start);
+        ap->frame_start = 0;
+    }
+    hist_add(&s->frame_bytes, bytes);
+    hist_add(&s->write_ns, s->blocked_ns - blocked);
+    s->buf_allocs = ap->buf.allocs;
+    if (r != NULL) {
+        pthread_mutex_lock(&r->stats_lock);
+        r->stats = *s;
+        pthread_mutex_unlock(&r->stats_lock);
+    }
+    if (ap->stats_interval != 0 && built >= ap->stats_next) {
+        ap_stats_print(s, ap->stats_fd);
+        ap->stats_next = built + ap->stats_interval;
+    }
 }
 
 void ap_end(ap_t ap) {
-    ap_str(ap, STR("\033[?2026l")); // end sync/batch mode
+    ap_apply_style(ap);
+    append_data(&ap->buf, ap->frame_epilogue, ap->frame_epilogue_len);
+    uint64_t built = now_ns();
+    size_t bytes = ap->buf.size;
+    uint64_t blocked = ap->stats.blocked_ns;
     ap_flush(ap);
+    ap_frame_done(ap, built, bytes, blocked);
+}
+
+void ap_stats_get(ap_t ap, ap_stats *s) {
+    struct ap_render *r = ap->render;
+    if (r == NULL) {
+        *s = ap->stats;
+        s->buf_allocs = ap->buf.allocs;
+        return;
+    }
+    pthread_mutex_lock(&r->stats_lock);
+    *s = r->stats;
+    pthread_mutex_unlock(&r->stats_lock);
+}
+
+void ap_stats_reset(ap_t ap) {
+    if (ap->render != NULL) {
+        atomic_store(&ap->render->stats_reset, true); // done by the render thread at its next frame.
+        return;
+    }
+    ap->stats = (ap_stats){0};
+}
+
+void ap_stats_every(ap_t ap, int fd, uint64_t interval_ns) {
+    ap->stats_fd = fd;
+    ap->stats_interval = interval_ns;
+    ap->stats_next = now_ns() + interval_ns;
+}
+
+static inline double us(uint64_t ns) { return (double)ns / 1e3; }
+
+void ap_stats_print(const ap_stats *s, int fd) {
+    const histogram *b = &s->build_ns, *n = &s->frame_bytes, *w = &s->write_ns;
+    dprintf(
+        fd,
+        "frames %llu build us p50 %.1f p99 %.1f max %.1f, bytes/frame p50 %llu p99 %llu max %llu, "
+        "writes %llu partial %llu blocked ms %.3f (us/frame p50 %.1f p99 %.1f max %.1f), buf allocs %d\n",
+        (unsigned long long)s->frames,
+        us(hist_quantile(b, .5)),
+        us(hist_quantile(b, .99)),
+        us(b->max),
+        (unsigned long long)hist_quantile(n, .5),
+        (unsigned long long)hist_quantile(n, .99),
+        (unsigned long long)n->max,
+        (unsigned long long)s->writes,
+        (unsigned long long)s->partial_writes,
+        (double)s->blocked_ns / 1e6,
+        us(hist_quantile(w, .5)),
+        us(hist_quantile(w, .99)),
+        us(w->max),
+        s->buf_allocs
+    );
 }
 
 void ap_itoa(ap_t ap, int n) {
-    char buf[16];
-    int sign = n < 0 ? -1 : 1;
-    char *end = buf + sizeof buf - 1;
-    char *p = end;
-    do {
-        *p-- = '0' + sign * (n % 10);
-        n /= 10;
-    } while (n);
-    if (sign < 0) {
-        *p-- = '-';
+    ap_apply_style(ap);
+    append_int(&ap->buf, n);
+    ap_cursor_unknown(ap); // it's text being output.
+}
+
+// Cursor motion: when we know where the cursor is (within a batch) we pick
+// the shortest of the absolute CUP and the relative moves. This relies on
+// the ONLCR output mode set by term_raw(), making \n go to the start of the next line.
+
+static inline int min_int(int a, int b) { return a < b ? a : b; }
+
+static inline int digits(int n) { return n < 10 ? 1 : n < 100 ? 2 : n < 1000 ? 3 : n < 10000 ? 4 : 10; }
+
+// Cost of CSI n <final>, n being omitted when 1 (the default).
+static inline int csi_n_cost(int n) { return 3 + (n == 1 ? 0 : digits(n)); }
+
+// The sequence writers below write at p, which has been reserved (see plan.cost), and
+// return the new end.
+
+static char *csi_n(char *p, int n, char final) {
+    *p++ = '\033';
+    *p++ = '[';
+    if (n != 1) {
+        p = fmt_uint(p, n);
+    }
+    *p++ = final;
+    return p;
+}
+
+// Absolute CUP, omitting default (1) parameters.
+static inline int cup_cost(int x, int y) {
+    if (x == 0) {
+        return 3 + (y == 0 ? 0 : digits(y + 1));
+    }
+    return 4 + (y == 0 ? 0 : digits(y + 1)) + digits(x + 1);
+}
+
+static char *cup(char *p, int x, int y) {
+    *p++ = '\033';
+    *p++ = '[';
+    // ANSI rows and columns are 1-based
+    if (x != 0) {
+        if (y != 0) {
+            p = fmt_pair(p, y + 1, x + 1);
+        } else {
+            *p++ = ';';
+            p = fmt_uint(p, x + 1);
+        }
+    } else if (y != 0) {
+        p = fmt_uint(p, y + 1);
+    }
+    *p++ = 'H';
+    return p;
+}
+
+typedef enum hmove_kind { H_NONE, H_CR, H_CHA, H_CUF, H_BS, H_CUB } hmove_kind;
+
+// Cheapest way to go from column from to column to on the same row.
+static int hmove_cost(int from, int to, hmove_kind *kind) {
+    if (from == to) {
+        *kind = H_NONE;
+        return 0;
+    }
+    if (to == 0) {
+        *kind = H_CR;
+        return 1;
+    }
+    *kind = H_CHA;
+    int best = csi_n_cost(to + 1);
+    if (to > from) {
+        int c = csi_n_cost(to - from);
+        if (c < best) {
+            *kind = H_CUF;
+            best = c;
+        }
+    } else {
+        int c = min_int(from - to, csi_n_cost(from - to));
+        if (c < best) {
+            *kind = (from - to) == c ? H_BS : H_CUB;
+            best = c;
+        }
+    }
+    return best;
+}
+
+static char *hmove(char *p, int from, int to, hmove_kind kind) {
+    switch (kind) {
+    case H_NONE:
+        break;
+    case H_CR:
+        *p++ = '\r';
+        break;
+    case H_CHA:
+        p = csi_n(p, to + 1, 'G');
+        break;
+    case H_CUF:
+        p = csi_n(p, to - from, 'C');
+        break;
+    case H_BS:
+        memset(p, '\b', from - to);
+        p += from - to;
+        break;
+    case H_CUB:
+        p = csi_n(p, from - to, 'D');
+        break;
     }
-    append_data(&ap->buf, p + 1, (size_t)(end - p));
+    return p;
+}
+
+typedef enum vmove_kind { V_NONE, V_CUD, V_CUU, V_LF, V_CR, V_CR_CUD, V_CR_CUU, V_CUP } vmove_kind;
+
+typedef struct move_plan {
+    vmove_kind v;
+    hmove_kind h;
+    int from_x; // column after the vertical part, start of the horizontal one.
+    int cost;   // exact number of bytes.
+} move_plan;
+
+// Computes the cheapest way to move the cursor to x,y. Returns its cost in bytes.
+static int plan_move(ap_t ap, int x, int y, move_plan *plan) {
+    *plan = (move_plan){V_CUP, H_NONE, x, cup_cost(x, y)};
+    if (ap->cx < 0 || ap->cy < 0) {
+        return plan->cost;
+    }
+    int dy = y - ap->cy;
+    // Vertical moves keeping the column:
+    vmove_kind keep = dy == 0 ? V_NONE : dy > 0 ? V_CUD : V_CUU;
+    int keep_cost = dy == 0 ? 0 : csi_n_cost(dy > 0 ? dy : -dy);
+    // Vertical moves ending in column 0:
+    vmove_kind zero = dy == 0 ? V_CR : dy > 0 ? V_CR_CUD : V_CR_CUU;
+    int zero_cost = dy == 0 ? 1 : 1 + csi_n_cost(dy > 0 ? dy : -dy);
+    if (dy > 0 && dy <= zero_cost) {
+        zero = V_LF;
+        zero_cost = dy;
+    }
+    hmove_kind hk;
+    int c = keep_cost + hmove_cost(ap->cx, x, &hk);
+    if (c < plan->cost) {
+        *plan = (move_plan){keep, hk, ap->cx, c};
+    }
+    c = zero_cost + hmove_cost(0, x, &hk);
+    if (c < plan->cost) {
+        *plan = (move_plan){zero, hk, 0, c};
+    }
+    return plan->cost;
+}
+
+static void do_move(ap_t ap, int x, int y, move_plan plan) {
+    int n = y - ap->cy;
+    char *start = reserve_buf(&ap->buf, plan.cost);
+    char *p = start;
+    switch (plan.v) {
+    case V_NONE:
+        break;
+    case V_CUP:
+        p = cup(p, x, y);
+        break;
+    case V_CUD:
+        p = csi_n(p, n, 'B');
+        break;
+    case V_CUU:
+        p = csi_n(p, -n, 'A');
+        break;
+    case V_LF:
+        for (int i = 0; i < n; i++) { // only planned for small downward moves.
+            *p++ = '\n';
+        }
+        break;
+    case V_CR:
+        *p++ = '\r';
+        break;
+    case V_CR_CUD:
+        *p++ = '\r';
+        p = csi_n(p, n, 'B');
+        break;
+    case V_CR_CUU:
+        *p++ = '\r';
+        p = csi_n(p, -n, 'A');
+        break;
+    }
+    p = hmove(p, plan.from_x, x, plan.h);
+    commit_buf(&ap->buf, p - start); // DEBUG builds will catch a cost underestimate.
+    ap->cx = x;
+    ap->cy = y;
 }
 
 void ap_move_to(ap_t ap, int x, int y) {
-    ap_str(ap, STR("\033["));
-    ap_itoa(ap, y + 1); // ANSI rows are 1-based
-    append_byte(&ap->buf, ';');
-    ap_itoa(ap, x + 1); // ANSI columns are 1-based
-    append_byte(&ap->buf, 'H');
+    if (x == ap->cx && y == ap->cy) {
+        return;
+    }
+    move_plan plan;
+    plan_move(ap, x, y, &plan);
+    do_move(ap, x, y, plan);
 }
 
 void ap_flush(ap_t ap) {
-    write_buf(ap->out, ap->buf);
+    ap_apply_style(ap);
+    ap_write(ap, ap->buf.data + ap->buf.start, ap->buf.size);
     clear_buf(&ap->buf);
+    // Other code may write to the terminal between our batches.
+    ap_cursor_unknown(ap);
+    ap_sgr_unknown(ap);
+}
+
+void ap_flush_after(ap_t ap, const char *data, size_t n) {
+    ap_apply_style(ap);
+    if (ap->nonblocking) {
+        ap_write(ap, data, n);
+        ap_flush(ap);
+        return;
+    }
+    // The child output and our batch (e.g a HUD drawn over it) in one writev().
+    iov_batch *b = &ap->out_iov;
+    size_t total = n + ap->buf.size;
+    iov_ref(b, data, n);
+    iov_ref(b, ap->buf.data + ap->buf.start, ap->buf.size);
+    int writes = b->writes, partial_writes = b->partial_writes;
+    uint64_t start = now_ns();
+    ssize_t w = iov_flush(b, ap->out);
+    ap->stats.blocked_ns += now_ns() - start;
+    ap->stats.writes += (uint64_t)(b->writes - writes);
+    ap->stats.partial_writes += (uint64_t)(b->partial_writes - partial_writes);
+    if (w > 0) {
+        ap->stats.bytes += (uint64_t)w;
+    }
+    if (w < (ssize_t)total) {
+        LOG_ERROR("Error writing to terminal: %s", strerror(errno));
+    }
+    clear_buf(&ap->buf);
+    ap_cursor_unknown(ap);
+    ap_sgr_unknown(ap);
 }
 
 void ap_save_cursor(ap_t ap) {
-    ap_str(ap, STR("\0337")); // save cursor position
+    ap_seq(ap, STR(SEQ_CURSOR_SAVE));
 }
 
 void ap_restore_cursor(ap_t ap) {
-    ap_str(ap, STR("\0338")); // restore cursor position
+    ap_seq(ap, STR(SEQ_CURSOR_RESTORE));
+    // DECRC also restores the rendition (to whatever it was at DECSC time).
+    ap_cursor_unknown(ap);
+    ap_sgr_unknown(ap);
 }
 
 void ap_hide_cursor(ap_t ap) {
-    ap_str(ap, STR("\033[?25l")); // hide cursor
+    ap_seq(ap, STR(SEQ_CURSOR_HIDE));
 }
 
 void ap_show_cursor(ap_t ap) {
-    ap_str(ap, STR("\033[?25h")); // show cursor
+    ap_seq(ap, STR(SEQ_CURSOR_SHOW));
 }
 
 // Poll stdin without changing file status flags (which may be shared with stdout/stderr on a tty).
 bool ap_stdin_ready(ap_t _) {
     (void)_; // mark as unused for now.
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(STDIN_FILENO, &rfds);
-    struct timeval tv = {0, 0};
-    int r = select(STDIN_FILENO + 1, &rfds, NULL, NULL, &tv);
+    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+    int r = poll(&pfd, 1, 0);
     if (r < 0) {
         if (errno != EINTR) {
             LOG_ERROR("Error polling stdin: %s", strerror(errno));
         }
         return false;
     }
-    return r > 0 && FD_ISSET(STDIN_FILENO, &rfds);
+    return r > 0 && (pfd.revents & POLLIN);
+}
+
+// --- Input and round trip probes.
+
+int ap_rtt_probe(ap_t ap) {
+    ap_rtt *r = &ap->rtt;
+    if (r->inflight == AP_RTT_MAX_INFLIGHT) {
+        LOG_DEBUG("Already %d round trip probes unanswered", r->inflight);
+        return -1;
+    }
+    r->sent[(r->head + r->inflight) % AP_RTT_MAX_INFLIGHT] = now_ns();
+    r->inflight++;
+    ap_write_str(ap, STR(SEQ_DA1)); // not batched.
+    return 0;
+}
+
+static void ap_rtt_answer(ap_t ap) {
+    ap_rtt *r = &ap->rtt;
+    if (r->stale > 0) {
+        r->stale--;
+        return;
+    }
+    r->last = now_ns() - r->sent[r->head];
+    r->head = (r->head + 1) % AP_RTT_MAX_INFLIGHT;
+    r->inflight--;
+    hist_add(&r->hist, r->last);
+}
+
+static inline bool ap_rtt_expected(const ap_t ap) { return ap->rtt.inflight + ap->rtt.stale > 0; }
+
+// Records (and strips) the answers to the ap_detect_caps() queries.
+static bool ap_caps_answer(ap_t ap, const ansi_token *t) {
+    if (t->type == ANSI_STRING) {
+        // Kitty graphics answer to the query's image id 31: OK or an error message.
+        static const char id[] = "Gi=31;";
+        size_t n = sizeof(id) - 1;
+        if (t->final != '_' || t->payload_size < n || memcmp(t->payload, id, n) != 0) {
+            return false;
+        }
+        if (t->payload_size == n + 2 && memcmp(t->payload + n, "OK", 2) == 0) {
+            ap->probed |= AP_CAP_KITTY_GRAPHICS;
+        }
+        return true;
+    }
+    if (t->type != ANSI_CSI || t->prefix != '?') {
+        return false;
+    }
+    if (t->final == 'y' && t->intermediate == '$' && t->n_params == 2) {
+        // DECRPM: 0 is not recognized, 4 permanently reset.
+        bool on = t->params[1] >= 1 && t->params[1] <= 3;
+        if (t->params[0] == 2026 && on) {
+            ap->probed |= AP_CAP_SYNC;
+        } else if (t->params[0] == 2004 && !on) {
+            ap->probed &= ~AP_CAP_PASTE;
+        }
+        return true;
+    }
+    if (t->final == 'u' && t->intermediate == 0) {
+        ap->probed |= AP_CAP_KITTY_KEYBOARD;
+        return true;
+    }
+    if (t->final == 'c' && t->intermediate == 0) {
+        for (int i = 1; i < t->n_params; i++) {
+            if (t->params[i] == 4) { // DA1 attributes after the level, 4 is sixel graphics.
+                ap->probed |= AP_CAP_SIXEL;
+            }
+        }
+    }
+    return false; // DA1 is for ap_rtt_answer.
+}
+
+// Tokenizer callback: strips the DA1 (and capabilities) answers and keeps everything else.
+static int ap_input_token(void *ctx, const ansi_token *t) {
+    ap_t ap = ctx;
+    if (ap->probing && ap_caps_answer(ap, t)) {
+        return 0;
+    }
+    if (t->type == ANSI_CSI && t->final == 'c' && t->prefix == '?' && t->intermediate == 0 && ap_rtt_expected(ap)) {
+        ap_rtt_answer(ap);
+        return 0;
+    }
+    append_data(&ap->input, t->data, t->size);
+    return 0;
+}
+
+// Could the start of a sequence left at the end of a read be an answer's?
+static bool answer_prefix(const ap_t ap, const buffer *seq) {
+    static const char start[] = "\033[?", apc[] = "\033_";
+    size_t n = seq->size < 3 ? seq->size : 3;
+    const char *s = seq->data + seq->start;
+    return memcmp(s, start, n) == 0 || (ap->probing && memcmp(s, apc, n < 2 ? n : 2) == 0);
+}
+
+ssize_t ap_read_input(ap_t ap) {
+    if (ap->in_tok.cb == NULL) {
+        ansi_init(&ap->in_tok, ap_input_token, ap);
+    }
+    if (!ap_stdin_ready(ap)) {
+        return 0;
+    }
+    // Without answers to take out, read straight into ap->input, in large chunks (for pastes).
+    bool direct = !ap_rtt_expected(ap) && !ansi_in_sequence(&ap->in_tok);
+    char buf[4096];
+    ssize_t n = direct ? read_at_least(STDIN_FILENO, &ap->input, AP_INPUT_CHUNK) : read(STDIN_FILENO, buf, sizeof(buf));
+    if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+            return 0;
+        }
+        LOG_DEBUG("Input read returned %zd: %s", n, n < 0 ? strerror(errno) : "eof");
+        return -1;
+    }
+    if (direct) {
+        return n;
+    }
+    size_t before = ap->input.size;
+    ansi_feed(&ap->in_tok, buf, (size_t)n);
+    // Don't hold on to the start of a sequence (e.g a lone Esc key press)
+    // unless it may be an answer split across reads.
+    if (ansi_in_sequence(&ap->in_tok) && !(ap_rtt_expected(ap) && answer_prefix(ap, &ap->in_tok.seq))) {
+        append_buf(&ap->input, ap->in_tok.seq);
+        ansi_reset(&ap->in_tok);
+    }
+    return (ssize_t)(ap->input.size - before);
+}
+
+int ap_read_events(ap_t ap, input_event *ev, int max) {
+    int n = input_decode(&ap->in_dec, &ap->input, ev, max, false);
+    if (n > 0) {
+        return n;
+    }
+    if (ap_read_input(ap) < 0) {
+        return -1;
+    }
+    n = input_decode(&ap->in_dec, &ap->input, ev, max, false);
+    if (n == 0 && ap->input.size > 0 && !ap_stdin_ready(ap)) {
+        n = input_decode(&ap->in_dec, &ap->input, ev, max, true); // nothing more pending: ESC is the key.
+    }
+    return n;
+}
+
+int ap_rtt_measure(ap_t ap, int n, uint64_t timeout_ns) {
+    int answers = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t count = ap->rtt.hist.count;
+        if (ap_rtt_probe(ap) != 0) {
+            break;
+        }
+        uint64_t deadline = now_ns() + timeout_ns;
+        while (ap->rtt.hist.count == count) {
+            uint64_t now = now_ns();
+            if (now >= deadline) {
+                LOG_DEBUG("Round trip probe timed out after %.1fms", (double)timeout_ns / 1e6);
+                ap->rtt.stale += ap->rtt.inflight; // the answers may still come: drop them then.
+                ap->rtt.inflight = 0;
+                return answers;
+            }
+            struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+            int ms = (int)((deadline - now + 999999) / 1000000);
+            int r = poll(&pfd, 1, ms);
+            if (r > 0 && (ap_read_input(ap) < 0 || !(pfd.revents & POLLIN))) {
+                return answers; // error, end of file or hang up.
+            }
+        }
+        answers++;
+    }
+    return answers;
+}
+
+// --- Terminal capabilities.
+
+// Appends s to p (up to end) with what isn't safe in a file name replaced.
+static char *caps_key_part(char *p, const char *end, const char *s) {
+    for (; s != NULL && *s && p < end; s++) {
+        char c = *s;
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '-';
+        *p++ = safe ? c : '_';
+    }
+    return p;
+}
+
+// Cache file of the current terminal's capabilities, creating its directory
+// when create is true. False without TERM or a cache directory.
+static bool caps_cache_path(char *path, size_t size, bool create) {
+    const char *term = getenv("TERM"), *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    if (term == NULL || *term == 0) {
+        return false;
+    }
+    int n;
+    if (xdg != NULL && *xdg) {
+        n = snprintf(path, size, "%s", xdg);
+    } else if (home != NULL && *home) {
+        n = snprintf(path, size, "%s/.cache", home);
+    } else {
+        return false;
+    }
+    if (n < 0 || (size_t)n + 128 > size) {
+        return false;
+    }
+    if (create) {
+        mkdir(path, 0700); // usually exists already.
+    }
+    memcpy(path + n, "/ansipixels", 12);
+    n += 11;
+    if (create && mkdir(path, 0700) != 0 && errno != EEXIST) {
+        LOG_DEBUG("Can't create capabilities cache directory %s: %s", path, strerror(errno));
+        return false;
+    }
+    char *p = path + n, *end = path + size - 1;
+    memcpy(p, "/caps-", 6);
+    const char *parts[] = {term, getenv("TERM_PROGRAM"), getenv("TERM_PROGRAM_VERSION")};
+    p += 6;
+    for (int i = 0; i < 3; i++) {
+        if (i > 0 && p < end) {
+            *p++ = ',';
+        }
+        p = caps_key_part(p, end, parts[i]);
+    }
+    *p = 0;
+    return true;
+}
+
+static bool caps_load(const char *path, unsigned *caps) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fscanf(f, "%x", caps) == 1;
+    fclose(f);
+    return ok;
+}
+
+// Written aside and renamed so concurrent launches never read a partial file.
+static void caps_save(const char *path, unsigned caps) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        LOG_DEBUG("Can't write capabilities cache %s: %s", tmp, strerror(errno));
+        return;
+    }
+    bool ok = fprintf(f, "%x\n", caps) > 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        LOG_DEBUG("Can't save capabilities cache %s: %s", path, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+// There is no query for 24 bits colors: terminals advertise them in COLORTERM
+// (not always forwarded by ssh or sudo), and those with kitty protocols have them.
+static unsigned caps_with_truecolor(unsigned caps) {
+    const char *c = getenv("COLORTERM");
+    bool truecolor = c != NULL && (strcmp(c, "truecolor") == 0 || strcmp(c, "24bit") == 0);
+    if (truecolor || (caps & (AP_CAP_KITTY_KEYBOARD | AP_CAP_KITTY_GRAPHICS))) {
+        caps |= AP_CAP_TRUECOLOR;
+    }
+    return caps;
+}
+
+int ap_detect_caps(ap_t ap, uint64_t timeout_ns, bool cache) {
+    char path[1024];
+    unsigned caps;
+    if (cache && caps_cache_path(path, sizeof(path), false) && caps_load(path, &caps)) {
+        LOG_DEBUG("Terminal capabilities 0x%x from %s", caps, path);
+        ap_set_caps(ap, caps_with_truecolor(caps & ~AP_CAP_TRUECOLOR));
+        return 0;
+    }
+    // Bracketed paste predates DECRQM: only dropped when the terminal says it doesn't know the mode.
+    ap->probed = AP_CAP_PASTE;
+    ap->probing = true;
+    ap_write_str(ap, STR(SEQ_QUERY_CAPS));
+    int answers = ap_rtt_measure(ap, 1, timeout_ns);
+    ap->probing = false;
+    if (answers != 1) {
+        LOG_INFO("No answer to the capabilities queries in %.1fms, keeping the defaults", (double)timeout_ns / 1e6);
+        return -1;
+    }
+    LOG_DEBUG("Terminal capabilities 0x%x detected in %.1fms", ap->probed, (double)ap->rtt.last / 1e6);
+    if (cache && caps_cache_path(path, sizeof(path), true)) {
+        caps_save(path, ap->probed);
+    }
+    ap_set_caps(ap, caps_with_truecolor(ap->probed));
+    return 0;
+}
+
+void ap_str(ap_t ap, string s) {
+    ap_apply_style(ap);
+    append_data(&ap->buf, s.data, s.size);
+    ap_cursor_unknown(ap); // we don't know the width of arbitrary text (or sequences).
+}
+
+// Grid (retained mode) rendering.
+
+// Makes sure the back grid matches the current terminal size. When it doesn't
+// the next render does a full redraw (front and back grid sizes differ) as we
+// can't know what the terminal did with the content (reflow etc...).
+static void ap_size_grids(ap_t ap) {
+    ap_poll_size(ap);
+    if (ap->back.w == ap->w && ap->back.h == ap->h) {
+        return;
+    }
+    resize_grid(&ap->back, ap->w, ap->h);
+}
+
+void ap_put(ap_t ap, int x, int y, cell c) {
+    ap_size_grids(ap);
+    grid_put(&ap->back, x, y, c);
+}
+
+int ap_put_str(ap_t ap, int x, int y, string s, ap_color fg, ap_color bg, uint16_t attr) {
+    const char *p = s.data;
+    size_t n = s.size;
+    while (n > 0 && x < ap->w) {
+        int width;
+        size_t len = utf8_grapheme(p, n, &width), cp_len;
+        uint32_t glyph = utf8_decode((const unsigned char *)p, len, &cp_len);
+        if (cp_len < len) {
+            uint32_t cluster = cluster_intern(p, len, width);
+            glyph = cluster ? cluster : glyph; // else just the first code point.
+        }
+        if (width > 0) { // stray combining marks have nothing to combine with.
+            ap_put(ap, x, y, (cell){glyph, fg, bg, attr, 0});
+            x += width;
+        }
+        p += len;
+        n -= len;
+    }
+    return x < ap->w ? x : ap->w;
+}
+
+void ap_clear_grid(ap_t ap) {
+    ap_size_grids(ap);
+    fill_grid(&ap->back, BLANK_CELL);
+}
+
+void ap_invalidate_all(ap_t ap) {
+    if (ap->render != NULL) {
+        atomic_store(&ap->render->invalidate, true); // the front grid belongs to the render thread.
+        return;
+    }
+    free_grid(&ap->front);
+}
+
+// Never equal to a back grid cell (not a code point): forces the cell to be sent again.
+static const cell unknown_cell = {UINT32_MAX, AP_COLOR_DEFAULT, AP_COLOR_DEFAULT, 0, 0};
+
+void ap_invalidate(ap_t ap, int x, int y, int w, int h) {
+    ap_size_grids(ap);
+    if (ap->render != NULL) {
+        ap_invalidate_all(ap); // rare enough to not be worth passing rectangles to the render thread.
+        return;
+    }
+    // Whatever wrote there also moved the cursor and may have changed the rendition.
+    ap_cursor_unknown(ap);
+    ap->sgr_known = false;
+    if (ap->front.w != ap->back.w || ap->front.h != ap->back.h) {
+        return; // full redraw already.
+    }
+    int x0 = x < 0 ? 0 : x, x1 = x + w > ap->w ? ap->w : x + w, y1 = y + h > ap->h ? ap->h : y + h;
+    for (int r = y < 0 ? 0 : y; r < y1 && x0 < x1; r++) {
+        // Include the whole of the wide glyphs on the edges: they're drawn at once.
+        const cell *b = ap->back.cells + (size_t)r * ap->w;
+        int c0 = x0 > 0 && (b[x0].flags & AP_CELL_CONT) ? x0 - 1 : x0;
+        int c1 = x1 < ap->w && (b[x1 - 1].flags & AP_CELL_WIDE) ? x1 + 1 : x1;
+        grid_touch(&ap->back, c0, r, c1 - c0);
+        if (ap->row_hashes != NULL) {
+            ap->row_hashes[r] = 0;
+        }
+        for (int c = c0; c < c1; c++) {
+            ap->front.cells[(size_t)r * ap->w + c] = unknown_cell;
+        }
+    }
+}
+
+// Outputs the glyph of cell at the current cursor position and advances it (by 2 for wide ones).
+static void ap_glyph(ap_t ap, const cell *cell) {
+    if (ap->cx >= 0 && (ap->cx += cell->flags & AP_CELL_WIDE ? 2 : 1) >= ap->front.w) {
+        ap_cursor_unknown(ap); // pending wrap state at the right margin, let the next move be absolute.
+    }
+    uint32_t c = cell->glyph;
+    if (c == 0) {
+        c = ' ';
+    }
+    if (c & CLUSTER_GLYPH) {
+        string s = cluster_string(c);
+        append_data(&ap->buf, s.data, s.size);
+        return;
+    }
+    if (c < 0x80) {
+        append_byte(&ap->buf, (char)c);
+        return;
+    }
+    char *u = reserve_buf(&ap->buf, 4);
+    size_t n;
+    if (c < 0x800) {
+        u[0] = (char)(0xC0 | (c >> 6));
+        n = 2;
+    } else if (c < 0x10000) {
+        u[0] = (char)(0xE0 | (c >> 12));
+        u[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        n = 3;
+    } else {
+        u[0] = (char)(0xF0 | (c >> 18));
+        u[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+        n = 4;
+    }
+    u[n - 1] = (char)(0x80 | (c & 0x3F));
+    commit_buf(&ap->buf, n);
+}
+
+// SGR (colors and attributes) state cache.
+
+static inline bool same_style(const ap_style *a, const ap_style *b) {
+    return a->fg == b->fg && a->bg == b->bg && a->attr == b->attr;
+}
+
+static inline ap_style cell_style(const cell *c) { return (ap_style){c->fg, c->bg, c->attr}; }
+
+// SGR parameters being built, for a single CSI ... m.
+typedef struct sgr_params {
+    char data[96]; // enough for all attributes and two RGB colors.
+    int n;
+} sgr_params;
+
+static inline void param_sep(sgr_params *p) {
+    if (p->n) {
+        p->data[p->n++] = ';';
+    }
+}
+
+// All SGR parameters we use are in 0..255.
+static inline void param_int(sgr_params *p, int v) {
+    param_sep(p);
+    p->n = fmt_u8(p->data + p->n, (uint8_t)v) - p->data;
+}
+
+// base is 30 for foreground and 40 for background.
+static void param_color(sgr_params *p, ap_color c, int base) {
+    int v = c & 0xFF;
+    switch (AP_COLOR_KIND(c)) {
+    case AP_COLOR_KIND_256:
+        if (v < 8) {
+            param_int(p, base + v); // 30-37 / 40-47
+        } else if (v < 16) {
+            param_int(p, base + 60 + v - 8); // 90-97 / 100-107
+        } else {
+            param_int(p, base + 8);
+            param_int(p, 5);
+            param_int(p, v);
+        }
+        break;
+    case AP_COLOR_KIND_RGB:
+        param_int(p, base + 8);
+        param_int(p, 2);
+        param_sep(p);
+        p->n = fmt_rgb(p->data + p->n, (c >> 16) & 0xFF, (c >> 8) & 0xFF, v) - p->data;
+        break;
+    default:
+        param_int(p, base + 9); // 39 / 49
+        break;
+    }
+}
+
+static const int attr_on[] = {1, 2, 3, 4, 5, 7, 9};         // same order as AP_BOLD...AP_STRIKE
+static const int attr_off[] = {22, 22, 23, 24, 25, 27, 29}; // 22 is both bold and dim off.
+
+// Reset based parameters for the given rendition (empty for the default one).
+static void sgr_full(sgr_params *p, ap_style to) {
+    if (same_style(&to, &DEFAULT_STYLE)) {
+        return;
+    }
+    param_int(p, 0);
+    for (size_t i = 0; i < sizeof(attr_on) / sizeof(attr_on[0]); i++) {
+        if (to.attr & (1 << i)) {
+            param_int(p, attr_on[i]);
+        }
+    }
+    if (to.fg != AP_COLOR_DEFAULT) {
+        param_color(p, to.fg, 30);
+    }
+    if (to.bg != AP_COLOR_DEFAULT) {
+        param_color(p, to.bg, 40);
+    }
+}
+
+// Parameters for the change from one rendition to another. Returns true when
+// the result can't be longer than the reset based one (only additions).
+static bool sgr_incremental(sgr_params *p, ap_style from, ap_style to) {
+    uint16_t removed = from.attr & ~to.attr;
+    uint16_t added = to.attr & ~from.attr;
+    bool only_additions = removed == 0;
+    if (removed & (AP_BOLD | AP_DIM)) {
+        // 22 turns off both, so add back the one we keep if any.
+        param_int(p, 22);
+        removed &= ~(AP_BOLD | AP_DIM);
+        added |= to.attr & (AP_BOLD | AP_DIM);
+    }
+    for (size_t i = 0; i < sizeof(attr_on) / sizeof(attr_on[0]); i++) {
+        if (removed & (1 << i)) {
+            param_int(p, attr_off[i]);
+        }
+        if (added & (1 << i)) {
+            param_int(p, attr_on[i]);
+        }
+    }
+    if (to.fg != from.fg) {
+        param_color(p, to.fg, 30);
+        only_additions = only_additions && to.fg != AP_COLOR_DEFAULT;
+    }
+    if (to.bg != from.bg) {
+        param_color(p, to.bg, 40);
+        only_additions = only_additions && to.bg != AP_COLOR_DEFAULT;
+    }
+    return only_additions;
+}
+
+// Closest xterm 256 colors palette entry of an RGB color (others are returned as is):
+// of the 6x6x6 cube (levels 0, 95, 135... 255) or of the 24 grays (8 to 238).
+static ap_color color_to_256(ap_color c) {
+    if (AP_COLOR_KIND(c) != AP_COLOR_KIND_RGB) {
+        return c;
+    }
+    int rgb[3] = {(c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF};
+    int cube = 0, dist = 0, sum = 0;
+    for (int i = 0; i < 3; i++) {
+        int v = rgb[i], l = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40, d = v - (l ? 55 + 40 * l : 0);
+        cube = 6 * cube + l;
+        dist += d * d;
+        sum += v;
+    }
+    int avg = sum / 3, g = avg < 8 ? 0 : avg > 238 ? 23 : (avg - 8 + 5) / 10, gv = 8 + 10 * g, gdist = 0;
+    for (int i = 0; i < 3; i++) {
+        gdist += (rgb[i] - gv) * (rgb[i] - gv);
+    }
+    return AP_COLOR_256(gdist < dist ? 232 + g : 16 + cube);
+}
+
+// Switches the terminal to the given rendition using a single sequence: the shorter of
+// the incremental change from the current one (when known) and the reset based one.
+static void ap_sgr(ap_t ap, ap_style to) {
+    if (!(ap->caps & AP_CAP_TRUECOLOR)) {
+        to.fg = color_to_256(to.fg);
+        to.bg = color_to_256(to.bg);
+    }
+    if (ap->sgr_known && same_style(&ap->sgr, &to)) {
+        return;
+    }
+    sgr_params inc, full;
+    inc.n = full.n = 0;
+    sgr_params *best = &full;
+    if (!ap->sgr_known) {
+        sgr_full(&full, to);
+    } else if (sgr_incremental(&inc, ap->sgr, to)) {
+        best = &inc;
+    } else {
+        sgr_full(&full, to);
+        if (inc.n < full.n) {
+            best = &inc;
+        }
+    }
+    char *p = reserve_buf(&ap->buf, best->n + 3);
+    p[0] = '\033';
+    p[1] = '[';
+    memcpy(p + 2, best->data, best->n);
+    p[best->n + 2] = 'm';
+    commit_buf(&ap->buf, best->n + 3);
+    ap->sgr = to;
+    ap->sgr_known = true;
+}
+
+// The terminal's rendition changed behind our back (or may have).
+static void ap_sgr_unknown(ap_t ap) {
+    ap->sgr_known = false;
+    // Only re-apply non default styles, no need for spurious resets for code not using styles at all.
+    ap->style_dirty = !same_style(&ap->style, &DEFAULT_STYLE);
+}
+
+void ap_apply_style(ap_t ap) {
+    if (ap->style_dirty) {
+        ap_sgr(ap, ap->style);
+        ap->style_dirty = false;
+    }
+}
+
+void ap_fg(ap_t ap, ap_color c) {
+    ap->style.fg = c;
+    ap->style_dirty = true;
+}
+
+void ap_bg(ap_t ap, ap_color c) {
+    ap->style.bg = c;
+    ap->style_dirty = true;
+}
+
+void ap_attr(ap_t ap, uint16_t attr) {
+    ap->style.attr = attr;
+    ap->style_dirty = true;
+}
+
+void ap_set_style(ap_t ap, ap_style s) {
+    ap->style = s;
+    ap->style_dirty = true;
+}
+
+void ap_reset_style(ap_t ap) { ap_set_style(ap, DEFAULT_STYLE); }
+
+// Moves to x,y for drawing there with the given current style: when the cursor is
+// a few cells before on the same row, re-sending the glyphs (unchanged, in the same
+// style) in between can be cheaper than any cursor motion sequence.
+static void ap_move_over(ap_t ap, int x, int y) {
+    if (x == ap->cx && y == ap->cy) {
+        return;
+    }
+    move_plan plan;
+    int cost = plan_move(ap, x, y, &plan);
+    if (ap->sgr_known && y == ap->cy && x > ap->cx && x - ap->cx <= cost) {
+        const cell *f = grid_at(&ap->front, ap->cx, y);
+        bool ok = true;
+        for (int i = 0; ok && i < x - ap->cx; i++) {
+            ap_style st = cell_style(&f[i]);
+            ok = f[i].glyph < 0x80 && f[i].glyph != 0x7F && (f[i].glyph >= ' ' || f[i].glyph == 0) &&
+                 f[i].flags == 0 && same_style(&ap->sgr, &st);
+        }
+        if (ok) {
+            char *p = reserve_buf(&ap->buf, x - ap->cx);
+            for (int i = 0; i < x - ap->cx; i++) {
+                p[i] = f[i].glyph ? (char)f[i].glyph : ' ';
+            }
+            commit_buf(&ap->buf, x - ap->cx);
+            ap->cx = x;
+            return;
+        }
+    }
+    do_move(ap, x, y, plan);
+}
+
+enum { CMP_BLOCK = 4 }; // cells compared at once: 64 bytes, a couple of vector compares.
+
+// Index of the first cell differing between a and b from i (< n), n if none.
+static inline int first_diff(const cell *a, const cell *b, int i, int n) {
+    for (; i + CMP_BLOCK <= n && memcmp(a + i, b + i, CMP_BLOCK * sizeof(cell)) == 0; i += CMP_BLOCK) {
+    }
+    for (; i < n && cell_eq(a + i, b + i); i++) {
+    }
+    return i;
+}
+
+// Scrolling: when a band of back's rows is front's rows shifted by k (e.g a log
+// view), moving them in the terminal with DECSTBM margins and SU/SD is a few
+// bytes instead of redrawing them all. Rows are matched by hash: ap->row_hashes
+// caches the front rows' (0 when unknown, reset by whatever changes the row)
+// followed by the back rows' of the current frame (0 when same as front).
+enum {
+    SCROLL_MIN_ROWS = 2,  // rows saved for a scroll to be worth it.
+    SCROLL_CANDIDATES = 8 // distinct shifts evaluated per frame at most.
+};
+
+static inline uint64_t hash_mix(uint64_t h, const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    h = (h ^ v) * 0xFF51AFD7ED558CCDull;
+    return h ^ (h >> 32);
+}
+
+// 4 independent lanes (a cell is 2 words) so the multiplies pipeline.
+static uint64_t row_hash(const cell *row, int w) {
+    uint64_t h[4] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull};
+    const unsigned char *p = (const unsigned char *)row;
+    int x = 0;
+    for (; x + 2 <= w; x += 2, p += 2 * sizeof(cell)) {
+        for (int i = 0; i < 4; i++) {
+            h[i] = hash_mix(h[i], p + i * sizeof(uint64_t));
+        }
+    }
+    if (x < w) {
+        h[0] = hash_mix(h[0], p);
+        h[1] = hash_mix(h[1], p + sizeof(uint64_t));
+    }
+    return (h[0] ^ (h[1] * 3) ^ (h[2] * 5) ^ (h[3] * 7)) | 1; // never 0.
+}
+
+// Forgets the front grid rows' hashes, sized for the current front grid.
+static void ap_reset_row_hashes(ap_t ap) {
+    int size = 2 * ap->front.h;
+    if (ap->row_hashes_size != size) {
+        free(ap->row_hashes);
+        ap->row_hashes = calloc((size_t)size, sizeof(uint64_t));
+        ap->row_hashes_size = ap->row_hashes == NULL ? 0 : size;
+        return;
+    }
+    memset(ap->row_hashes, 0, (size_t)size * sizeof(uint64_t));
+}
+
+static inline uint64_t front_hash(ap_t ap, int y) {
+    if (ap->row_hashes[y] == 0) {
+        ap->row_hashes[y] = row_hash(ap->front.cells + (size_t)y * ap->front.w, ap->front.w);
+    }
+    return ap->row_hashes[y];
+}
+
+static inline uint64_t back_hash(ap_t ap, int y) {
+    uint64_t h = ap->row_hashes[ap->front.h + y];
+    return h != 0 ? h : front_hash(ap, y);
+}
+
+// Longest run of back rows y.. within lo..hi equal to the front rows y+k..,
+// counting in *saved those that would otherwise have to be redrawn.
+static int scroll_run(ap_t ap, int lo, int hi, int k, int *first, int *saved) {
+    int best_len = 0, len = 0, n = 0;
+    *saved = 0;
+    int start = k < 0 ? lo - k : lo, end = k > 0 ? hi - k : hi;
+    for (int y = start; y <= end + 1; y++) {
+        if (y <= end && back_hash(ap, y) == front_hash(ap, y + k)) {
+            len++;
+            n += ap->row_hashes[ap->front.h + y] != 0;
+            continue;
+        }
+        if (n > *saved) {
+            *saved = n;
+            *first = y - len;
+            best_len = len;
+        }
+        len = n = 0;
+    }
+    return best_len;
+}
+
+// Looks for the best vertical shift among back's dirty rows (the ones an app
+// scrolling a pane redraws: both the source and the destination of the move),
+// applies it to the terminal and the front grid, and sets *top..*bot to the
+// rows it exposed (blank in front, to be diffed in full). Returns false if no
+// shift saves at least SCROLL_MIN_ROWS rows.
+static bool ap_scroll(ap_t ap, const grid *back, int *top, int *bot) {
+    int w = back->w, lo = back->h, hi = -1, changed = 0;
+    if (ap->row_hashes == NULL) {
+        return false;
+    }
+    uint64_t *bh = ap->row_hashes + back->h;
+    cell *f = ap->front.cells;
+    for (int y = 0; y < back->h; y++) {
+        bh[y] = 0;
+        const grid_span *d = &back->dirty[y];
+        if (d->lo >= d->hi) {
+            continue;
+        }
+        lo = y < lo ? y : lo;
+        hi = y;
+        const cell *b = back->cells + (size_t)y * w;
+        if (memcmp(b + d->lo, f + (size_t)y * w + d->lo, (size_t)(d->hi - d->lo) * sizeof(cell)) != 0) {
+            bh[y] = row_hash(b, w);
+            changed++;
+        }
+    }
+    if (changed < SCROLL_MIN_ROWS) {
+        return false;
+    }
+    // Candidate shifts: where changed rows are found in front.
+    int ks[SCROLL_CANDIDATES], nk = 0;
+    for (int y = lo; y <= hi && nk < SCROLL_CANDIDATES; y++) {
+        for (int src = lo; bh[y] != 0 && src <= hi && nk < SCROLL_CANDIDATES; src++) {
+            if (src == y || front_hash(ap, src) != bh[y]) {
+                continue;
+            }
+            int i = 0;
+            for (; i < nk && ks[i] != src - y; i++) {
+            }
+            if (i == nk) {
+                ks[nk++] = src - y;
+            }
+        }
+    }
+    int k = 0, a = 0, rows = 0, best_saved = SCROLL_MIN_ROWS - 1;
+    for (int i = 0; i < nk; i++) {
+        int first = 0, saved;
+        int len = scroll_run(ap, lo, hi, ks[i], &first, &saved);
+        if (saved > best_saved) {
+            k = ks[i];
+            a = first;
+            rows = len;
+            best_saved = saved;
+        }
+    }
+    if (k == 0) {
+        return false;
+    }
+    for (int y = a; y < a + rows; y++) {
+        if (memcmp(back->cells + (size_t)y * w, f + (size_t)(y + k) * w, (size_t)w * sizeof(cell)) != 0) {
+            return false; // hash collision.
+        }
+    }
+    // Scroll up by k the margins a..a+rows-1+k, exposing the bottom k rows, or down by -k a+k..a+rows-1.
+    int mtop = k > 0 ? a : a + k, mbot = k > 0 ? a + rows - 1 + k : a + rows - 1;
+    ap_sgr(ap, DEFAULT_STYLE); // the exposed lines get the current background.
+    char *p = reserve_buf(&ap->buf, 2 * (3 + FMT_PAIR_MAX) + 3);
+    char *start = p;
+    *p++ = '\033';
+    *p++ = '[';
+    p = fmt_pair(p, (uint32_t)mtop + 1, (uint32_t)mbot + 1);
+    *p++ = 'r';
+    p = csi_n(p, k > 0 ? k : -k, k > 0 ? 'S' : 'T');
+    memcpy(p, SEQ_MARGINS_RESET, sizeof(SEQ_MARGINS_RESET) - 1);
+    commit_buf(&ap->buf, p + sizeof(SEQ_MARGINS_RESET) - 1 - start);
+    ap->cx = ap->cy = 0; // DECSTBM homes the cursor.
+    memmove(f + (size_t)a * w, f + (size_t)(a + k) * w, (size_t)rows * w * sizeof(cell));
+    memmove(ap->row_hashes + a, ap->row_hashes + a + k, (size_t)rows * sizeof(uint64_t));
+    *top = k > 0 ? a + rows : mtop;
+    *bot = k > 0 ? mbot : a - 1;
+    for (int i = *top * w; i < (*bot + 1) * w; i++) {
+        f[i] = BLANK_CELL;
+    }
+    for (int y = *top; y <= *bot; y++) {
+        ap->row_hashes[y] = 0;
+    }
+    return true;
+}
+
+// Diffs back against the front grid and sends the changes (in a sync/batch
+// frame), only looking at back's dirty spans unless it's a full redraw.
+static void ap_render(ap_t ap, const grid *back) {
+    if (ap->front.w != back->w || ap->front.h != back->h) {
+        free_grid(&ap->front);
+    }
+    ap_start(ap);
+    bool full = ap->front.cells == NULL;
+    if (full) {
+        // Full redraw: start from a cleared screen, which is all blank cells.
+        ap->front = new_grid(back->w, back->h);
+        ap_reset_row_hashes(ap);
+        ap_clear_screen(ap, false);
+    }
+    int top = 0, bot = -1; // rows exposed by a scroll.
+    if (!full) {
+        ap_scroll(ap, back, &top, &bot);
+    }
+    for (int y = 0; y < back->h; y++) {
+        grid_span s = full || (y >= top && y <= bot) ? (grid_span){0, back->w} : back->dirty[y];
+        cell *f = ap->front.cells + (size_t)y * back->w;
+        const cell *b = back->cells + (size_t)y * back->w;
+        int x = first_diff(f, b, s.lo, s.hi);
+        if (x < s.hi && ap->row_hashes != NULL) {
+            ap->row_hashes[y] = 0; // the front row changes.
+        }
+        for (; x < s.hi; x = first_diff(f, b, x + 1, s.hi)) {
+            if (!(b[x].flags & AP_CELL_CONT)) { // the right half of a wide glyph is drawn with its left half.
+                ap_move_over(ap, x, y);
+                ap_sgr(ap, cell_style(&b[x]));
+                ap_glyph(ap, &b[x]);
+            }
+            f[x] = b[x];
+        }
+    }
+    // Get back to the text style so non grid output isn't affected by the last cell's.
+    ap->style_dirty = true;
+    ap_end(ap);
+}
+
+// --- Pixel graphics
+
+void ap_cell_pixels(ap_t ap, int *cw, int *ch) {
+    bool known = ap->xpixel > 0 && ap->ypixel > 0 && ap->w > 0 && ap->h > 0;
+    *cw = known ? ap->xpixel / ap->w : 10;
+    *ch = known ? ap->ypixel / ap->h : 20;
+}
+
+void ap_put_halfblocks(ap_t ap, int x, int y, const image *img) {
+    ap_size_grids(ap);
+    image_halfblocks(&ap->back, x, y, img);
+}
+
+void ap_put_quadrants(ap_t ap, int x, int y, const image *img) {
+    ap_size_grids(ap);
+    image_quadrants(&ap->back, x, y, img);
+}
+
+void ap_kitty(ap_t ap, int x, int y, const image *img, uint32_t id, bool zlib) {
+    ap_move_to(ap, x, y);
+    kitty_encode(&ap->buf, img, id, zlib); // doesn't move the cursor.
+}
+
+void ap_kitty_place(ap_t ap, int x, int y, uint32_t id) {
+    ap_move_to(ap, x, y);
+    kitty_place(&ap->buf, id);
+}
+
+void ap_kitty_delete(ap_t ap, uint32_t id) { kitty_delete(&ap->buf, id); }
+
+void ap_sixel(ap_t ap, int x, int y, const image *img, int colors) {
+    if (ap->sixel == NULL && (ap->sixel = sixel_new()) == NULL) {
+        return;
+    }
+    ap_move_to(ap, x, y);
+    sixel_encode(ap->sixel, &ap->buf, img, colors);
+    ap_cursor_unknown(ap); // left below or at the end of the image depending on the terminal.
+}
+
+static void render_wake(struct ap_render *r) {
+    char c = 0;
+    if (write(r->wake[1], &c, 1) < 0) {
+        // pipe full: a wakeup is already pending.
+    }
+}
+
+static void *render_loop(void *arg) {
+    ap_t ap = arg;
+    struct ap_render *r = ap->render;
+    bool have = false; // a taken frame not rendered yet.
+    for (;;) {
+        if (atomic_load(&r->middle) & SLOT_FRESH) {
+            r->consume = atomic_exchange(&r->middle, r->consume) & ~SLOT_FRESH;
+            have = true;
+        }
+        // With nonblocking output, only render (the latest frame) once the terminal caught up.
+        bool behind = ap->nonblocking && ap_pending(ap) > 0;
+        if (have && !behind) {
+            if (atomic_exchange(&r->invalidate, false)) {
+                free_grid(&ap->front);
+            }
+            ap_render(ap, &r->slots[r->consume]);
+            atomic_fetch_add(&r->rendered, 1);
+            have = false;
+            continue;
+        }
+        if (atomic_load(&r->stop) && !have) {
+            break;
+        }
+        struct pollfd pfd[2] = {{.fd = r->wake[0], .events = POLLIN}, {.fd = ap->out, .events = POLLOUT}};
+        if (poll(pfd, behind ? 2 : 1, -1) < 0 && errno != EINTR) {
+            LOG_ERROR("Render thread poll error: %s", strerror(errno));
+            break;
+        }
+        char drain[64];
+        while (read(r->wake[0], drain, sizeof(drain)) > 0) {
+        }
+        if (atomic_load(&r->stop) && behind) {
+            break; // don't wait on a stuck terminal when asked to stop.
+        }
+    }
+    return NULL;
+}
+
+int ap_render_start(ap_t ap) {
+    if (ap->render != NULL) {
+        return 0;
+    }
+    struct ap_render *r = calloc(1, sizeof(struct ap_render));
+    if (r == NULL || pipe(r->wake) != 0) {
+        LOG_ERROR("Failed to set up render thread: %s", strerror(errno));
+        free(r);
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(r->wake[i], F_SETFL, fcntl(r->wake[i], F_GETFL) | O_NONBLOCK);
+        fcntl(r->wake[i], F_SETFD, FD_CLOEXEC);
+    }
+    for (int i = 0; i < 3; i++) {
+        r->slots[i] = new_grid(0, 0);
+    }
+    pthread_mutex_init(&r->stats_lock, NULL);
+    r->stats = ap->stats;
+    r->produce = 0;
+    atomic_init(&r->middle, 1);
+    r->consume = 2;
+    ap->render = r;
+    // The thread inherits a fully blocked mask: signals (SIGWINCH, SIGCHLD...) stay with the app thread.
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&r->thread, NULL, render_loop, ap);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        LOG_ERROR("Failed to start render thread: %s", strerror(err));
+        ap->render = NULL;
+        close(r->wake[0]);
+        close(r->wake[1]);
+        pthread_mutex_destroy(&r->stats_lock);
+        free(r);
+        return -1;
+    }
+    return 0;
+}
+
+static void ap_render_stop_internal(ap_t ap) {
+    struct ap_render *r = ap->render;
+    if (r == NULL) {
+        return;
+    }
+    atomic_store(&r->stop, true);
+    render_wake(r);
+    pthread_join(r->thread, NULL);
+    ap->render = NULL;
+    LOG_DEBUG("Render thread stopped after %d frames", atomic_load(&r->rendered));
+    close(r->wake[0]);
+    close(r->wake[1]);
+    for (int i = 0; i < 3; i++) {
+        free_grid(&r->slots[i]);
+    }
+    free(r->acc);
+    pthread_mutex_destroy(&r->stats_lock);
+    free(r);
 }
 
-void ap_str(ap_t ap, string s) { append_data(&ap->buf, s.data, s.size); }
+void ap_render_stop(ap_t ap) { ap_render_stop_internal(ap); }
+
+// The render thread can skip frames, so a slot's dirty spans are the changes
+// since the last published frame known to be rendered (one was taken when the
+// middle slot we get back isn't fresh): a superset of what it needs to diff.
+static void ap_publish(ap_t ap) {
+    struct ap_render *r = ap->render;
+    grid *back = &ap->back;
+    grid *slot = &r->slots[r->produce];
+    if (slot->w != back->w || slot->h != back->h) {
+        free_grid(slot);
+        *slot = new_grid(back->w, back->h);
+    }
+    if (r->acc_w != back->w || r->acc_h != back->h) {
+        free(r->acc);
+        r->acc = malloc((size_t)back->h * sizeof(grid_span));
+        if (r->acc == NULL && back->h > 0) {
+            LOG_ERROR("Failed to allocate %d dirty spans", back->h);
+            abort();
+        }
+        for (int y = 0; y < back->h; y++) {
+            r->acc[y] = (grid_span){0, back->w};
+        }
+        r->acc_w = back->w;
+        r->acc_h = back->h;
+    }
+    memcpy(slot->cells, back->cells, (size_t)slot->w * (size_t)slot->h * sizeof(cell));
+    for (int y = 0; y < back->h; y++) {
+        slot->dirty[y] = span_union(r->acc[y], back->dirty[y]);
+    }
+    int old = atomic_exchange(&r->middle, r->produce | SLOT_FRESH);
+    r->produce = old & ~SLOT_FRESH;
+    memcpy(r->acc, (old & SLOT_FRESH) ? slot->dirty : back->dirty, (size_t)back->h * sizeof(grid_span));
+    grid_clean(back);
+    render_wake(r);
+}
+
+void ap_present(ap_t ap) {
+    ap_size_grids(ap);
+    if (ap->render != NULL) {
+        ap_publish(ap);
+        return;
+    }
+    if (ap->nonblocking && ap_pending(ap) > 0) {
+        // The terminal is behind: don't queue a stale frame, the front grid
+        // still matches what was sent so the next frame includes these changes.
+        ap->frames_skipped++;
+        return;
+    }
+    ap_render(ap, &ap->back);
+    grid_clean(&ap->back);
+}
+
+// --- Frame scheduler
+
+// Input read per tick at most: a longer paste goes on at the next ticks.
+enum { AP_RUN_MAX_READ = 16 * AP_INPUT_CHUNK };
+
+// Reads what's available then decodes all of it into *evs (grown as needed):
+// reading after decoding could move the input the events point to.
+static int ap_run_input(ap_t ap, input_event **evs, int *cap) {
+    for (size_t added = 0; added < AP_RUN_MAX_READ;) {
+        ssize_t r = ap_read_input(ap);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        added += (size_t)r;
+    }
+    int n = 0;
+    bool final = false;
+    for (;;) {
+        if (n == *cap) {
+            int new_cap = *cap ? 2 * *cap : 64;
+            input_event *grown = realloc(*evs, (size_t)new_cap * sizeof(input_event));
+            if (grown == NULL) {
+                LOG_ERROR("Failed to allocate %d input events", new_cap);
+                return -1;
+            }
+            *evs = grown;
+            *cap = new_cap;
+        }
+        int got = input_decode(&ap->in_dec, &ap->input, *evs + n, *cap - n, final);
+        n += got;
+        if (got == 0) {
+            if (final || ap->input.size == 0 || ap_stdin_ready(ap)) {
+                return n;
+            }
+            final = true; // nothing more pending: a lone ESC is the Esc key.
+        }
+    }
+}
+
+// Blocks until stdin is readable or the terminal is resized.
+static void ap_wait_input(ap_t ap) {
+    struct pollfd pfds[2] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = ap->resize_fd, .events = POLLIN}};
+    while (poll(pfds, ap->resize_fd >= 0 ? 2 : 1, -1) < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR("Error polling input: %s", strerror(errno));
+            return; // let the read report the error.
+        }
+    }
+}
+
+int ap_run(ap_t ap, ap_app *app) {
+    uint64_t period = app->hz > 0 ? (uint64_t)(1e9 / app->hz) : 0;
+    input_event *evs = NULL;
+    int cap = 0, missed = 0, ret = 0;
+    uint64_t start = now_ns(), tick = 0; // deadlines are start + tick * period.
+    bool first = true, idle = false;
+    for (;;) {
+        uint64_t deadline = start + tick * period;
+        if (idle) {
+            ap_wait_input(ap);
+            start = deadline = now_ns(); // new time base from the wake up.
+            tick = 0;
+        } else if (period > 0) {
+            sleep_until_ns(deadline);
+        } else {
+            deadline = now_ns();
+        }
+        uint64_t now = now_ns();
+        hist_add(&app->late_ns, now - deadline);
+        int n = ap_run_input(ap, &evs, &cap);
+        if (n < 0) {
+            ret = -1;
+            break;
+        }
+        bool resized = ap_check_resize(ap);
+        ap_frame f = {
+            .tick = app->ticks++,
+            .deadline = deadline,
+            .now = now,
+            .missed = missed,
+            .resized = resized,
+            .events = evs,
+            .n_events = n,
+        };
+        int r = app->update != NULL ? app->update(ap, &f, app->ctx) : AP_RUN_RENDER | AP_RUN_ANIMATE;
+        if (r & AP_RUN_STOP) {
+            break;
+        }
+        if (((r & AP_RUN_RENDER) || resized || first) && app->render != NULL) {
+            app->render(ap, &f, app->ctx);
+            app->renders++;
+        }
+        first = false;
+        idle = !(r & AP_RUN_ANIMATE);
+        // Skip to the latest tick already due when running more than a period late.
+        tick++;
+        missed = 0;
+        uint64_t due = period > 0 ? (now_ns() - start) / period : 0;
+        if (due > tick) {
+            missed = (int)(due - tick);
+            app->missed += (uint64_t)missed;
+            tick = due;
+        }
+    }
+    free(evs);
+    return ret;
+}
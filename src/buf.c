@@ -8,23 +8,46 @@
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #include "buf.h"
+#include "fmt.h"
 #include "log.h"
+#include "scan.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-buffer new_buf(size_t size) {
-    return (buffer){
-        calloc(1, size),
-        0,
-        0,
-        size
-#if DEBUG
-        ,
-        1
-#endif
-    };
+static atomic_size_t heap_allocs;
+
+size_t buf_heap_allocs(void) { return atomic_load_explicit(&heap_allocs, memory_order_relaxed); }
+
+// Grows (or first allocates) b's storage to new_cap.
+static void *buf_grow(buffer *b, size_t new_cap) {
+    b->allocs++;
+    if (b->alloc != NULL) {
+        return b->alloc->grow(b->alloc->ctx, b->data, b->start + b->size, new_cap);
+    }
+    atomic_fetch_add_explicit(&heap_allocs, 1, memory_order_relaxed);
+    void *p = realloc(b->data, new_cap);
+    if (p == NULL) {
+        LOG_ERROR("Failed to allocate %zu bytes buffer: %s", new_cap, strerror(errno));
+        abort();
+    }
+    return p;
+}
+
+buffer new_buf(size_t size) { return new_buf_in(size, NULL); }
+
+buffer new_buf_in(size_t size, const buf_allocator *alloc) {
+    // Not zero filled: only the first size bytes from start are ever read.
+    buffer b = {.alloc = alloc};
+    if (size > 0) {
+        b.data = buf_grow(&b, size);
+        b.cap = size;
+    }
+    return b;
 }
 
 void free_buf(buffer *b) {
@@ -34,7 +57,11 @@ void free_buf(buffer *b) {
     if (b->cap == 0) {
         return; // nothing to free
     }
-    free(b->data);
+    if (b->alloc != NULL) {
+        b->alloc->release(b->alloc->ctx, b->data, b->cap);
+    } else {
+        free(b->data);
+    }
     b->start = 0;
     b->cap = 0;
     b->size = 0;
@@ -139,39 +166,51 @@ void ensure_cap(buffer *dest, size_t new_cap) {
     }
     new_cap = max(new_cap,
                   dest->cap * 2); // double capacity to reduce future reallocs
-    dest->data = realloc(dest->data, new_cap);
+    dest->data = buf_grow(dest, new_cap);
     dest->cap = new_cap;
+}
+
+char *reserve_buf(buffer *b, size_t n) {
+    size_t current_end = b->start + b->size;
+    if (current_end + n > b->cap) {
+        ensure_cap(b, current_end + n);
+    }
+    return b->data + current_end;
+}
+
+void commit_buf(buffer *b, size_t n) {
 #if DEBUG
-    dest->allocs++;
+    if (b->start + b->size + n > b->cap) {
+        LOG_ERROR("commit_buf beyond capacity: %zu + %zu > %zu", b->start + b->size, n, b->cap);
+        abort();
+    }
 #endif
+    b->size += n;
 }
 
 void append_data(buffer *dest, const char *data, size_t size) {
-    size_t current_end = dest->start + dest->size;
-    ensure_cap(dest, current_end + size);
-    memcpy(dest->data + current_end, data, size);
+    memcpy(reserve_buf(dest, size), data, size);
     dest->size += size;
 }
 
 void append_str(buffer *dest, string src) { append_data(dest, src.data, src.size); }
 
-void append_byte(buffer *dest, char byte) { append_data(dest, &byte, 1); }
+void append_byte(buffer *dest, char byte) {
+    *reserve_buf(dest, 1) = byte;
+    dest->size++;
+}
+
+void append_int(buffer *dest, int n) {
+    char *p = reserve_buf(dest, FMT_INT_MAX);
+    dest->size += fmt_int(p, n) - p;
+}
 
 buffer slice_buf(buffer b, size_t start, size_t end) {
     if (end > b.size) {
         end = b.size; // allow slice end to be after end of buffer but clamp it to buffer size to avoid out of bounds
                       // access
     }
-    return (buffer){
-        b.data + b.start + start,
-        0,
-        end - start,
-        0
-#if DEBUG
-        ,
-        0
-#endif
-    }; // 0 cap for subslice
+    return (buffer){b.data + b.start + start, 0, end - start, 0, 0, NULL}; // 0 cap for subslice
 }
 
 char to_hex_digit(int c) {
@@ -200,41 +239,53 @@ const char *debug_data(buffer *shared_buf, const char *data, size_t size) {
 }
 
 void quote_buf(buffer *b, const char *s, size_t size) {
-    append_byte(b, '"');
+    // Worst case is every byte as \xHH, plus the 2 quotes and the null terminator.
+    char *start = reserve_buf(b, 4 * size + 3);
+    char *p = start;
+    *p++ = '"';
     for (size_t i = 0; i < size; i++) {
         char c = s[i];
         switch (c) {
         case '\n':
-            append_str(b, STR("\\n"));
+            *p++ = '\\';
+            *p++ = 'n';
             break;
         case '\r':
-            append_str(b, STR("\\r"));
+            *p++ = '\\';
+            *p++ = 'r';
             break;
         case '\t':
-            append_str(b, STR("\\t"));
+            *p++ = '\\';
+            *p++ = 't';
             break;
         case '\\':
-            append_str(b, STR("\\\\"));
+            *p++ = '\\';
+            *p++ = '\\';
             break;
         case '"':
-            append_str(b, STR("\\\""));
+            *p++ = '\\';
+            *p++ = '"';
             break;
         default:
             if (c < 32 || c >= 127) {
-                append_str(b, STR("\\x"));
-                append_byte(b, to_hex_digit((c >> 4) & 0xF));
-                append_byte(b, to_hex_digit(c & 0xF));
+                *p++ = '\\';
+                *p++ = 'x';
+                *p++ = to_hex_digit((c >> 4) & 0xF);
+                *p++ = to_hex_digit(c & 0xF);
             } else {
-                append_byte(b, c);
+                *p++ = c;
             }
         }
     }
-    append_byte(b, '"');
-    append_byte(b, '\0'); // null-terminate for printing
+    *p++ = '"';
+    *p++ = '\0'; // null-terminate for printing
+    commit_buf(b, p - start);
 }
 
 void debug_print_buf(buffer b) {
-    buffer quoted = debug_quote(b.data + b.start, b.size);
+    static _Thread_local buffer quoted; // reused (and kept) across calls, per thread.
+    clear_buf(&quoted);
+    quote_buf(&quoted, b.data + b.start, b.size);
     fprintf(
         stderr,
         GREEN "INF buffer { data: %p = %s, start: %zu, size: %zu, cap: %zu, allocs: %d/%d "
@@ -244,18 +295,15 @@ void debug_print_buf(buffer b) {
         b.start,
         b.size,
         b.cap,
-#if DEBUG
         b.allocs,
         quoted.allocs
-#else
-        -1,
-        -1
-#endif
     );
-    free_buf(&quoted);
 }
 
 const char *mempbrk(const char *s, size_t n, const char *accept, size_t accept_len) {
+    if (accept_len <= 4) {
+        return scan_any4(s, n, accept, accept_len); // vectorized, no table to build.
+    }
     unsigned char table[256] = {0};
     for (size_t i = 0; i < accept_len; i++) {
         table[((unsigned char *)accept)[i]] = 1;
@@ -269,6 +317,27 @@ const char *mempbrk(const char *s, size_t n, const char *accept, size_t accept_l
     return NULL;
 }
 
+bool map_buf(int fd, buffer *b) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    *b = slice_buf((buffer){.data = data, .size = (size_t)st.st_size}, 0, (size_t)st.st_size);
+    return true;
+}
+
+void unmap_buf(buffer *b) {
+    if (b->data != NULL) {
+        munmap(b->data, b->start + b->size);
+    }
+    *b = slice_buf((buffer){0}, 0, 0);
+}
+
 ssize_t write_all(int fd, const char *buf, ssize_t len) {
     if (len <= 0) {
         return len; // nothing to write
@@ -287,4 +356,22 @@ ssize_t write_all(int fd, const char *buf, ssize_t len) {
     return total;
 }
 
+ssize_t write_avail(int fd, const char *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = write(fd, buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
 ssize_t write_buf(int fd, buffer b) { return write_all(fd, b.data + b.start, b.size); }
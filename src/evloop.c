@@ -0,0 +1,420 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "evloop.h"
+#include "log.h"
+#include "timer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef EV_USE_POLL
+#define EV_USE_POLL 0
+#endif
+#if !EV_USE_POLL && defined(__linux__)
+#define EV_EPOLL 1
+#include <sys/epoll.h>
+#elif !EV_USE_POLL && (defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__))
+#define EV_KQUEUE 1
+#include <sys/event.h>
+#else
+#include <poll.h>
+#endif
+
+enum {
+    EV_MAX_SIGNAL = 64,
+    EV_BATCH = 64, // events per wait.
+};
+
+typedef struct ev_watch {
+    int fd; // -1 for a free slot.
+    int events;
+    ev_cb cb;
+    void *ctx;
+} ev_watch;
+
+typedef struct ev_timer_entry {
+    uint64_t deadline;
+    int id;
+    ev_cb cb;
+    void *ctx;
+} ev_timer_entry;
+
+typedef struct ev_handler {
+    ev_cb cb;
+    void *ctx;
+} ev_handler;
+
+struct ev_loop {
+    int backend; // epoll/kqueue fd, -1 with poll.
+    // Watches are referred to by slot (the index) in the backend's event data.
+    ev_watch *watches;
+    int n_watches, cap_watches;
+    bool dispatching; // don't reuse slots: the current batch may still refer to them.
+    // Few timers are expected, they're just scanned for the earliest.
+    ev_timer_entry *timers;
+    int n_timers, cap_timers;
+    int next_timer_id;
+    ev_handler signals[EV_MAX_SIGNAL];
+#if !EV_EPOLL && !EV_KQUEUE
+    struct pollfd *pfds;
+    int *pfd_slots;
+    int cap_pfds;
+#endif
+};
+
+// Self-pipe for signals, the handler writes the signal number.
+static int sig_pipe[2] = {-1, -1};
+static ev_loop *sig_loop = NULL;
+
+static void sig_handler(int sig) {
+    int saved_errno = errno;
+    unsigned char c = (unsigned char)sig;
+    if (write(sig_pipe[1], &c, 1) < 0) {
+        // pipe full: signals are coalesced anyway.
+    }
+    errno = saved_errno;
+}
+
+static ev_watch *find_watch(ev_loop *l, int fd) {
+    for (int i = 0; i < l->n_watches; i++) {
+        if (l->watches[i].fd == fd) {
+            return &l->watches[i];
+        }
+    }
+    return NULL;
+}
+
+// Backend registration changes for a slot going from old to new events.
+static int backend_update(ev_loop *l, int slot, int old, int new) {
+    int fd = l->watches[slot].fd;
+#if EV_EPOLL
+    struct epoll_event ev = {0};
+    ev.events = ((new & EV_READ) ? EPOLLIN : 0) | ((new & EV_WRITE) ? EPOLLOUT : 0);
+    ev.data.u32 = (uint32_t)slot;
+    // Removed while paused: epoll would still report hang ups.
+    int op = old == 0 ? EPOLL_CTL_ADD : (new == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (old == 0 && new == 0) {
+        return 0;
+    }
+    if (epoll_ctl(l->backend, op, fd, &ev) < 0) {
+        LOG_ERROR("epoll_ctl(%d, fd %d) failed: %s", op, fd, strerror(errno));
+        return -1;
+    }
+#elif EV_KQUEUE
+    struct kevent ch[2];
+    int n = 0;
+    if ((old ^ new) & EV_READ) {
+        EV_SET(&ch[n++], fd, EVFILT_READ, (new & EV_READ) ? EV_ADD : EV_DELETE, 0, 0, (void *)(intptr_t)slot);
+    }
+    if ((old ^ new) & EV_WRITE) {
+        EV_SET(&ch[n++], fd, EVFILT_WRITE, (new & EV_WRITE) ? EV_ADD : EV_DELETE, 0, 0, (void *)(intptr_t)slot);
+    }
+    if (n > 0 && kevent(l->backend, ch, n, NULL, 0, NULL) < 0) {
+        LOG_ERROR("kevent(fd %d) failed: %s", fd, strerror(errno));
+        return -1;
+    }
+#else
+    (void)l, (void)slot, (void)old, (void)new, (void)fd; // pollfds are rebuilt for each wait.
+#endif
+    return 0;
+}
+
+ev_loop *ev_new(void) {
+    ev_loop *l = calloc(1, sizeof(ev_loop));
+    if (l == NULL) {
+        LOG_ERROR("Failed to allocate event loop: %s", strerror(errno));
+        return NULL;
+    }
+    l->backend = -1;
+#if EV_EPOLL
+    l->backend = epoll_create1(EPOLL_CLOEXEC);
+#elif EV_KQUEUE
+    l->backend = kqueue();
+    if (l->backend >= 0) {
+        fcntl(l->backend, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+#if EV_EPOLL || EV_KQUEUE
+    if (l->backend < 0) {
+        LOG_ERROR("Failed to create event loop: %s", strerror(errno));
+        free(l);
+        return NULL;
+    }
+#endif
+    return l;
+}
+
+void ev_free(ev_loop *l) {
+    if (l == NULL) {
+        return;
+    }
+    if (sig_loop == l) {
+        for (int sig = 1; sig < EV_MAX_SIGNAL; sig++) {
+            if (l->signals[sig].cb != NULL) {
+                signal(sig, SIG_DFL);
+            }
+        }
+        sig_loop = NULL;
+    }
+    if (l->backend >= 0) {
+        close(l->backend);
+    }
+    free(l->watches);
+    free(l->timers);
+#if !EV_EPOLL && !EV_KQUEUE
+    free(l->pfds);
+    free(l->pfd_slots);
+#endif
+    free(l);
+}
+
+int ev_add(ev_loop *l, int fd, int events, ev_cb cb, void *ctx) {
+    if (find_watch(l, fd) != NULL) {
+        LOG_ERROR("fd %d is already watched", fd);
+        return -1;
+    }
+    int slot = -1;
+    for (int i = 0; !l->dispatching && i < l->n_watches; i++) {
+        if (l->watches[i].fd < 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        if (l->n_watches == l->cap_watches) {
+            l->cap_watches = l->cap_watches ? 2 * l->cap_watches : 8;
+            l->watches = realloc(l->watches, (size_t)l->cap_watches * sizeof(ev_watch));
+        }
+        slot = l->n_watches++;
+    }
+    l->watches[slot] = (ev_watch){fd, events, cb, ctx};
+    if (backend_update(l, slot, 0, events) < 0) {
+        l->watches[slot].fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int ev_set(ev_loop *l, int fd, int events) {
+    ev_watch *w = find_watch(l, fd);
+    if (w == NULL) {
+        LOG_ERROR("fd %d is not watched", fd);
+        return -1;
+    }
+    if (backend_update(l, (int)(w - l->watches), w->events, events) < 0) {
+        return -1;
+    }
+    w->events = events;
+    return 0;
+}
+
+int ev_del(ev_loop *l, int fd) {
+    ev_watch *w = find_watch(l, fd);
+    if (w == NULL) {
+        return -1;
+    }
+    int ret = backend_update(l, (int)(w - l->watches), w->events, 0);
+    w->fd = -1;
+    return ret;
+}
+
+int ev_timer(ev_loop *l, uint64_t deadline, ev_cb cb, void *ctx) {
+    if (l->n_timers == l->cap_timers) {
+        l->cap_timers = l->cap_timers ? 2 * l->cap_timers : 8;
+        l->timers = realloc(l->timers, (size_t)l->cap_timers * sizeof(ev_timer_entry));
+    }
+    int id = l->next_timer_id++;
+    l->timers[l->n_timers++] = (ev_timer_entry){deadline, id, cb, ctx};
+    return id;
+}
+
+void ev_cancel(ev_loop *l, int id) {
+    for (int i = 0; i < l->n_timers; i++) {
+        if (l->timers[i].id == id) {
+            l->timers[i] = l->timers[--l->n_timers];
+            return;
+        }
+    }
+}
+
+static int sig_dispatch(ev_loop *l, int fd, int events, void *ctx) {
+    (void)events, (void)ctx;
+    unsigned char sigs[64];
+    bool seen[EV_MAX_SIGNAL] = {0};
+    ssize_t n;
+    while ((n = read(fd, sigs, sizeof(sigs))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            seen[sigs[i] % EV_MAX_SIGNAL] = true;
+        }
+    }
+    // Coalesced like signals are: one callback per signal number.
+    for (int sig = 1; sig < EV_MAX_SIGNAL; sig++) {
+        if (seen[sig] && l->signals[sig].cb != NULL) {
+            int ret = l->signals[sig].cb(l, sig, EV_SIGNAL, l->signals[sig].ctx);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+int ev_signal(ev_loop *l, int sig, ev_cb cb, void *ctx) {
+    if (sig <= 0 || sig >= EV_MAX_SIGNAL || (sig_loop != NULL && sig_loop != l)) {
+        LOG_ERROR("Can't handle signal %d in this loop", sig);
+        return -1;
+    }
+    if (sig_pipe[0] < 0) {
+        if (pipe(sig_pipe) != 0) {
+            LOG_ERROR("Failed to create signal pipe: %s", strerror(errno));
+            return -1;
+        }
+        for (int i = 0; i < 2; i++) {
+            fcntl(sig_pipe[i], F_SETFL, fcntl(sig_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(sig_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+    if (sig_loop == NULL) {
+        if (ev_add(l, sig_pipe[0], EV_READ, sig_dispatch, NULL) < 0) {
+            return -1;
+        }
+        sig_loop = l;
+    }
+    l->signals[sig] = (ev_handler){cb, ctx};
+    struct sigaction sa = {0};
+    sa.sa_handler = sig_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(sig, &sa, NULL) < 0) {
+        LOG_ERROR("sigaction(%d) failed: %s", sig, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Runs the timers due at now (not the ones they add, even if already due).
+static int run_timers(ev_loop *l, uint64_t now) {
+    int last_id = l->next_timer_id;
+    for (int i = 0; i < l->n_timers;) {
+        ev_timer_entry t = l->timers[i];
+        if (t.deadline > now || t.id >= last_id) {
+            i++;
+            continue;
+        }
+        l->timers[i] = l->timers[--l->n_timers]; // removed first so the callback can rearm.
+        int ret = t.cb(l, t.id, EV_TIMER, t.ctx);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int dispatch(ev_loop *l, int slot, int events) {
+    ev_watch *w = &l->watches[slot];
+    if (w->fd < 0) {
+        return 0; // removed by an earlier callback of this batch.
+    }
+    if ((events & EV_HUP) && (w->events & EV_READ)) {
+        events |= EV_READ;
+    }
+    return w->cb(l, w->fd, events, w->ctx);
+}
+
+int ev_run_once(ev_loop *l, int64_t timeout_ns) {
+    uint64_t now = now_ns();
+    for (int i = 0; i < l->n_timers; i++) {
+        uint64_t d = l->timers[i].deadline;
+        int64_t left = d > now ? (int64_t)(d - now) : 0;
+        if (timeout_ns < 0 || left < timeout_ns) {
+            timeout_ns = left;
+        }
+    }
+    // Rounded up: waking up early would just spin until the deadline.
+    int timeout_ms = timeout_ns < 0 ? -1 : (int)((timeout_ns + 999999) / 1000000);
+    int ret = 0;
+    l->dispatching = true;
+#if EV_EPOLL
+    struct epoll_event evs[EV_BATCH];
+    int n = epoll_wait(l->backend, evs, EV_BATCH, timeout_ms);
+#elif EV_KQUEUE
+    (void)timeout_ms;
+    struct kevent evs[EV_BATCH];
+    struct timespec ts = {timeout_ns / 1000000000, timeout_ns % 1000000000};
+    int n = kevent(l->backend, NULL, 0, evs, EV_BATCH, timeout_ns < 0 ? NULL : &ts);
+#else
+    if (l->cap_pfds < l->n_watches) {
+        l->cap_pfds = l->n_watches;
+        l->pfds = realloc(l->pfds, (size_t)l->cap_pfds * sizeof(struct pollfd));
+        l->pfd_slots = realloc(l->pfd_slots, (size_t)l->cap_pfds * sizeof(int));
+    }
+    int np = 0;
+    for (int i = 0; i < l->n_watches; i++) {
+        const ev_watch *w = &l->watches[i];
+        if (w->fd >= 0 && w->events != 0) {
+            short events = (short)(((w->events & EV_READ) ? POLLIN : 0) | ((w->events & EV_WRITE) ? POLLOUT : 0));
+            l->pfds[np] = (struct pollfd){w->fd, events, 0};
+            l->pfd_slots[np++] = i;
+        }
+    }
+    int n = poll(l->pfds, (nfds_t)np, timeout_ms);
+#endif
+    if (n < 0) {
+        l->dispatching = false;
+        if (errno == EINTR) {
+            return 0;
+        }
+        LOG_ERROR("Event loop wait failed: %s", strerror(errno));
+        return -1;
+    }
+#if EV_EPOLL
+    for (int i = 0; i < n && ret == 0; i++) {
+        uint32_t e = evs[i].events;
+        int events = ((e & EPOLLIN) ? EV_READ : 0) | ((e & EPOLLOUT) ? EV_WRITE : 0) |
+                     ((e & (EPOLLHUP | EPOLLERR)) ? EV_HUP : 0);
+        ret = dispatch(l, (int)evs[i].data.u32, events);
+    }
+#elif EV_KQUEUE
+    for (int i = 0; i < n && ret == 0; i++) {
+        int events = evs[i].filter == EVFILT_READ ? EV_READ : EV_WRITE;
+        if (evs[i].flags & (EV_EOF | EV_ERROR)) {
+            events |= EV_HUP;
+        }
+        ret = dispatch(l, (int)(intptr_t)evs[i].udata, events);
+    }
+#else
+    for (int i = 0; i < np && n > 0 && ret == 0; i++) {
+        short e = l->pfds[i].revents;
+        if (e == 0) {
+            continue;
+        }
+        n--;
+        int events = ((e & POLLIN) ? EV_READ : 0) | ((e & POLLOUT) ? EV_WRITE : 0) |
+                     ((e & (POLLHUP | POLLERR | POLLNVAL)) ? EV_HUP : 0);
+        ret = dispatch(l, l->pfd_slots[i], events);
+    }
+#endif
+    l->dispatching = false;
+    if (ret == 0 && l->n_timers > 0) {
+        ret = run_timers(l, now_ns());
+    }
+    return ret;
+}
+
+int ev_run(ev_loop *l) {
+    int ret;
+    while ((ret = ev_run_once(l, -1)) == 0) {
+    }
+    return ret;
+}
@@ -0,0 +1,100 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "fmt.h"
+#include <string.h>
+
+static const char digits2[200] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+
+static inline int num_digits(uint32_t n) {
+    int d = 1;
+    for (;;) {
+        if (n < 10) {
+            return d;
+        }
+        if (n < 100) {
+            return d + 1;
+        }
+        if (n < 1000) {
+            return d + 2;
+        }
+        if (n < 10000) {
+            return d + 3;
+        }
+        n /= 10000;
+        d += 4;
+    }
+}
+
+char *fmt_uint(char *p, uint32_t n) {
+    if (n < 10) {
+        *p = (char)('0' + n);
+        return p + 1;
+    }
+    int len = num_digits(n);
+    char *end = p + len;
+    char *q = end;
+    while (n >= 100) {
+        q -= 2;
+        memcpy(q, digits2 + (n % 100) * 2, 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        q -= 2;
+        memcpy(q, digits2 + n * 2, 2);
+    } else {
+        *--q = (char)('0' + n);
+    }
+    return end;
+}
+
+char *fmt_int(char *p, int n) {
+    if (n < 0) {
+        *p++ = '-';
+        return fmt_uint(p, -(uint32_t)n); // also correct for INT_MIN.
+    }
+    return fmt_uint(p, (uint32_t)n);
+}
+
+char *fmt_u8(char *p, uint8_t n) {
+    if (n < 10) {
+        *p = (char)('0' + n);
+        return p + 1;
+    }
+    if (n < 100) {
+        memcpy(p, digits2 + n * 2, 2);
+        return p + 2;
+    }
+    *p = (char)('0' + n / 100);
+    memcpy(p + 1, digits2 + (n % 100) * 2, 2);
+    return p + 3;
+}
+
+char *fmt_rgb(char *p, uint8_t r, uint8_t g, uint8_t b) {
+    p = fmt_u8(p, r);
+    *p++ = ';';
+    p = fmt_u8(p, g);
+    *p++ = ';';
+    return fmt_u8(p, b);
+}
+
+char *fmt_pair(char *p, uint32_t a, uint32_t b) {
+    p = fmt_uint(p, a);
+    *p++ = ';';
+    return fmt_uint(p, b);
+}
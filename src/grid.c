@@ -0,0 +1,116 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "grid.h"
+#include "log.h"
+#include "utf8.h"
+#include <stdlib.h>
+#include <string.h>
+
+grid new_grid(int w, int h) {
+    if (w <= 0 || h <= 0) {
+        return (grid){0};
+    }
+    grid g = {w, h, malloc((size_t)w * h * sizeof(cell)), malloc((size_t)h * sizeof(grid_span))};
+    if (!g.cells || !g.dirty) {
+        LOG_ERROR("Failed to allocate %dx%d grid", w, h);
+        abort();
+    }
+    grid_clean(&g);
+    fill_grid(&g, BLANK_CELL); // all dirty.
+    return g;
+}
+
+void free_grid(grid *g) {
+    free(g->cells);
+    free(g->dirty);
+    *g = (grid){0};
+}
+
+void resize_grid(grid *g, int w, int h) {
+    if (g->w == w && g->h == h) {
+        return;
+    }
+    grid n = new_grid(w, h);
+    int cw = g->w < w ? g->w : w;
+    int ch = g->h < h ? g->h : h;
+    for (int y = 0; y < ch; y++) {
+        cell *row = n.cells + (size_t)y * w;
+        memcpy(row, g->cells + (size_t)y * g->w, (size_t)cw * sizeof(cell));
+        if (cw > 0 && (row[cw - 1].flags & AP_CELL_WIDE)) {
+            row[cw - 1] = BLANK_CELL; // its second half was cut.
+        }
+    }
+    free_grid(g);
+    *g = n;
+}
+
+void fill_grid(grid *g, cell c) {
+    size_t n = (size_t)g->w * g->h;
+    for (size_t i = 0; i < n; i++) {
+        g->cells[i] = c;
+    }
+    grid_invalidate(g, 0, 0, g->w, g->h);
+}
+
+bool cell_eq(const cell *a, const cell *b) { return memcmp(a, b, sizeof(cell)) == 0; }
+
+cell *grid_at(grid *g, int x, int y) {
+    if (x < 0 || y < 0 || x >= g->w || y >= g->h) {
+        return NULL;
+    }
+    return g->cells + (size_t)y * g->w + x;
+}
+
+// Blanks the other half of the wide glyph x,y is part of, if any.
+static void unwide(grid *g, int x, int y) {
+    cell *c = g->cells + (size_t)y * g->w + x;
+    if ((c->flags & AP_CELL_CONT) && x > 0) {
+        c[-1] = BLANK_CELL;
+        grid_touch(g, x - 1, y, 1);
+    } else if ((c->flags & AP_CELL_WIDE) && x + 1 < g->w) {
+        c[1] = BLANK_CELL;
+        grid_touch(g, x + 1, y, 1);
+    }
+}
+
+bool grid_put(grid *g, int x, int y, cell c) {
+    if (x < 0 || y < 0 || x >= g->w || y >= g->h) {
+        return false;
+    }
+    bool wide = glyph_width(c.glyph) == 2;
+    if (wide && x + 1 == g->w) {
+        c.glyph = ' ';
+        wide = false;
+    }
+    cell *dst = g->cells + (size_t)y * g->w + x;
+    unwide(g, x, y);
+    c.flags = wide ? AP_CELL_WIDE : 0;
+    dst[0] = c;
+    if (wide) {
+        unwide(g, x + 1, y);
+        dst[1] = (cell){0, c.fg, c.bg, c.attr, AP_CELL_CONT};
+    }
+    grid_touch(g, x, y, wide ? 2 : 1);
+    return true;
+}
+
+void grid_invalidate(grid *g, int x, int y, int w, int h) {
+    int x1 = x + w > g->w ? g->w : x + w, y1 = y + h > g->h ? g->h : y + h;
+    x = x < 0 ? 0 : x;
+    for (y = y < 0 ? 0 : y; y < y1 && x < x1; y++) {
+        grid_touch(g, x, y, x1 - x);
+    }
+}
+
+void grid_clean(grid *g) {
+    for (int y = 0; y < g->h; y++) {
+        g->dirty[y] = (grid_span){g->w, 0};
+    }
+}
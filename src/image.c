@@ -0,0 +1,484 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "image.h"
+#include "fmt.h"
+#include "log.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#if AP_ZLIB
+#include <zlib.h>
+#endif
+
+image new_image(int w, int h) {
+    if (w <= 0 || h <= 0) {
+        return (image){0};
+    }
+    image img = {w, h, calloc((size_t)w * (size_t)h, 4)};
+    if (img.data == NULL) {
+        LOG_ERROR("Failed to allocate %dx%d image: %s", w, h, strerror(errno));
+        return (image){0};
+    }
+    return img;
+}
+
+void free_image(image *img) {
+    free(img->data);
+    *img = (image){0};
+}
+
+void image_scale(image *dst, const image *src) {
+    if (src->w == 0 || src->h == 0) {
+        return;
+    }
+    for (int y = 0; y < dst->h; y++) {
+        const uint8_t *row = image_at(src, 0, (int)((int64_t)y * src->h / dst->h));
+        uint8_t *d = image_at(dst, 0, y);
+        for (int x = 0; x < dst->w; x++) {
+            memcpy(d + 4 * x, row + 4 * ((int64_t)x * src->w / dst->w), 4);
+        }
+    }
+}
+
+// --- Cell encoders
+
+static inline bool opaque(const uint8_t *p) { return p[3] >= 128; }
+
+static const uint8_t transparent_pixel[4] = {0};
+
+static inline ap_color pixel_color(const uint8_t *p) {
+    return opaque(p) ? AP_COLOR_RGB(p[0], p[1], p[2]) : AP_COLOR_DEFAULT;
+}
+
+void image_halfblocks(grid *g, int x, int y, const image *img) {
+    for (int cy = 0; 2 * cy < img->h; cy++) {
+        for (int cx = 0; cx < img->w; cx++) {
+            const uint8_t *top = image_at(img, cx, 2 * cy);
+            const uint8_t *bottom = 2 * cy + 1 < img->h ? image_at(img, cx, 2 * cy + 1) : transparent_pixel;
+            cell c = BLANK_CELL;
+            if (opaque(top)) {
+                c = (cell){0x2580, pixel_color(top), pixel_color(bottom), 0, 0}; // ▀
+            } else if (opaque(bottom)) {
+                c = (cell){0x2584, pixel_color(bottom), AP_COLOR_DEFAULT, 0, 0}; // ▄
+            }
+            grid_put(g, x + cx, y + cy, c);
+        }
+    }
+}
+
+// Quadrant block glyphs by mask of the foreground pixels: 1 upper left, 2 upper right, 4 lower left, 8 lower right.
+static const uint32_t quadrant_glyphs[16] = {
+    ' ', 0x2598, 0x259D, 0x2580, 0x2596, 0x258C, 0x259E, 0x259B,
+    0x2597, 0x259A, 0x2590, 0x259C, 0x2584, 0x2599, 0x259F, 0x2588,
+};
+
+static inline ap_color average(const uint8_t *px[4], int mask) {
+    int r = 0, g = 0, b = 0, n = 0;
+    for (int i = 0; i < 4; i++) {
+        if (mask & (1 << i)) {
+            r += px[i][0];
+            g += px[i][1];
+            b += px[i][2];
+            n++;
+        }
+    }
+    return AP_COLOR_RGB(r / n, g / n, b / n);
+}
+
+void image_quadrants(grid *g, int x, int y, const image *img) {
+    for (int cy = 0; 2 * cy < img->h; cy++) {
+        for (int cx = 0; 2 * cx < img->w; cx++) {
+            const uint8_t *px[4];
+            int opaque_mask = 0, luma[4], total = 0;
+            for (int i = 0; i < 4; i++) {
+                int px_x = 2 * cx + (i & 1), px_y = 2 * cy + (i >> 1);
+                px[i] = px_x < img->w && px_y < img->h ? image_at(img, px_x, px_y) : transparent_pixel;
+                luma[i] = 2 * px[i][0] + 5 * px[i][1] + px[i][2];
+                if (opaque(px[i])) {
+                    opaque_mask |= 1 << i;
+                    total += luma[i];
+                }
+            }
+            cell c = BLANK_CELL;
+            if (opaque_mask != 0 && opaque_mask != 15) {
+                // Transparent pixels show the default background.
+                c = (cell){quadrant_glyphs[opaque_mask], average(px, opaque_mask), AP_COLOR_DEFAULT, 0, 0};
+            } else if (opaque_mask == 15) {
+                int mask = 0;
+                for (int i = 0; i < 4; i++) {
+                    mask |= (4 * luma[i] > total) << i;
+                }
+                ap_color bg = average(px, 15 & ~mask);
+                c = mask == 0 ? (cell){' ', bg, bg, 0, 0} : (cell){quadrant_glyphs[mask], average(px, mask), bg, 0, 0};
+            }
+            grid_put(g, x + cx, y + cy, c);
+        }
+    }
+}
+
+// --- Kitty graphics
+
+enum { KITTY_CHUNK = 3072 }; // data bytes per escape sequence, 4096 in base64.
+
+static const char b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Writes the base64 encoding of n bytes at p, returns the end.
+static char *base64(char *p, const uint8_t *s, size_t n) {
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        uint32_t v = (uint32_t)s[i] << 16 | (uint32_t)s[i + 1] << 8 | s[i + 2];
+        p[0] = b64_chars[v >> 18];
+        p[1] = b64_chars[(v >> 12) & 63];
+        p[2] = b64_chars[(v >> 6) & 63];
+        p[3] = b64_chars[v & 63];
+        p += 4;
+    }
+    if (i < n) {
+        uint32_t v = (uint32_t)s[i] << 16 | (i + 1 < n ? (uint32_t)s[i + 1] << 8 : 0);
+        p[0] = b64_chars[v >> 18];
+        p[1] = b64_chars[(v >> 12) & 63];
+        p[2] = i + 1 < n ? b64_chars[(v >> 6) & 63] : '=';
+        p[3] = '=';
+        p += 4;
+    }
+    return p;
+}
+
+static void append_uint(buffer *out, uint32_t n) {
+    char *p = reserve_buf(out, FMT_UINT_MAX);
+    commit_buf(out, (size_t)(fmt_uint(p, n) - p));
+}
+
+void kitty_encode(buffer *out, const image *img, uint32_t id, bool zlib) {
+    const uint8_t *data = img->data;
+    size_t n = (size_t)img->w * (size_t)img->h * 4;
+    uint8_t *z = NULL;
+#if AP_ZLIB
+    if (zlib) {
+        uLongf zn = compressBound(n);
+        z = malloc(zn);
+        if (z != NULL && compress2(z, &zn, data, n, 1) == Z_OK) {
+            data = z;
+            n = zn;
+        } else {
+            LOG_ERROR("Failed to compress %zu bytes image, sending it uncompressed", n);
+            free(z);
+            z = NULL;
+        }
+    }
+#else
+    (void)zlib;
+#endif
+    append_str(out, STR("\033_Ga=T,f=32,s="));
+    append_int(out, img->w);
+    append_str(out, STR(",v="));
+    append_int(out, img->h);
+    if (id != 0) {
+        append_str(out, STR(",i="));
+        append_uint(out, id);
+    }
+    if (z != NULL) {
+        append_str(out, STR(",o=z"));
+    }
+    append_str(out, STR(",C=1,q=2,"));
+    size_t pos = 0;
+    do {
+        size_t c = n - pos < KITTY_CHUNK ? n - pos : KITTY_CHUNK;
+        if (pos > 0) {
+            append_str(out, STR("\033_G"));
+        }
+        append_str(out, pos + c < n ? STR("m=1;") : STR("m=0;"));
+        char *p = reserve_buf(out, (c + 2) / 3 * 4);
+        commit_buf(out, (size_t)(base64(p, data + pos, c) - p));
+        append_str(out, STR("\033\\"));
+        pos += c;
+    } while (pos < n);
+    free(z);
+}
+
+void kitty_place(buffer *out, uint32_t id) {
+    append_str(out, STR("\033_Ga=p,i="));
+    append_uint(out, id);
+    append_str(out, STR(",C=1,q=2\033\\"));
+}
+
+void kitty_delete(buffer *out, uint32_t id) {
+    append_str(out, STR("\033_Ga=d,d=I,i="));
+    append_uint(out, id);
+    append_str(out, STR(",q=2\033\\"));
+}
+
+// --- Sixel
+
+enum {
+    BINS = 1 << 15,  // 5 bits per channel color histogram.
+    TRANSPARENT = BINS, // key of transparent pixels.
+    NO_INDEX = 255, // lut value of transparent pixels.
+};
+
+typedef struct color_box {
+    int lo, hi;   // range of e->bins.
+    uint64_t pop; // pixels.
+    int shift;    // of the widest channel in the keys.
+    int range;    // of that channel.
+} color_box;
+
+struct sixel_encoder {
+    uint32_t count[BINS];
+    uint64_t sum[BINS][3]; // of the 8 bits channels, for the palette averages.
+    uint8_t lut[BINS + 1]; // bin (or TRANSPARENT) to palette index.
+    uint16_t bins[BINS];   // occupied bins.
+    uint16_t tmp[BINS];
+    color_box boxes[256];
+    uint8_t palette[256][3];
+    int16_t slot[256]; // row of the color in rows for the current band, -1 when unused.
+    uint8_t order[256];
+    uint16_t *keys; // bin of each pixel.
+    size_t keys_cap;
+    uint8_t *rows; // sixel bits per used color and column of the current band.
+    size_t rows_cap;
+};
+
+sixel_encoder *sixel_new(void) {
+    sixel_encoder *e = calloc(1, sizeof(sixel_encoder));
+    if (e == NULL) {
+        LOG_ERROR("Failed to allocate sixel encoder: %s", strerror(errno));
+        return NULL;
+    }
+    e->lut[TRANSPARENT] = NO_INDEX;
+    memset(e->slot, -1, sizeof(e->slot));
+    return e;
+}
+
+void sixel_free(sixel_encoder *e) {
+    if (e == NULL) {
+        return;
+    }
+    free(e->keys);
+    free(e->rows);
+    free(e);
+}
+
+static void box_stats(sixel_encoder *e, color_box *b) {
+    int lo[3] = {31, 31, 31}, hi[3] = {0, 0, 0};
+    b->pop = 0;
+    for (int i = b->lo; i < b->hi; i++) {
+        int k = e->bins[i];
+        for (int c = 0; c < 3; c++) {
+            int v = (k >> (10 - 5 * c)) & 31;
+            lo[c] = v < lo[c] ? v : lo[c];
+            hi[c] = v > hi[c] ? v : hi[c];
+        }
+        b->pop += e->count[k];
+    }
+    b->range = -1;
+    for (int c = 0; c < 3; c++) {
+        if (hi[c] - lo[c] > b->range) {
+            b->range = hi[c] - lo[c];
+            b->shift = 10 - 5 * c;
+        }
+    }
+}
+
+// Splits b at the population median of its widest channel into b and nb.
+static void box_split(sixel_encoder *e, color_box *b, color_box *nb) {
+    // Counting sort of the bins by that channel.
+    int start[33] = {0};
+    for (int i = b->lo; i < b->hi; i++) {
+        start[((e->bins[i] >> b->shift) & 31) + 1]++;
+    }
+    for (int v = 0; v < 32; v++) {
+        start[v + 1] += start[v];
+    }
+    for (int i = b->lo; i < b->hi; i++) {
+        e->tmp[b->lo + start[(e->bins[i] >> b->shift) & 31]++] = e->bins[i];
+    }
+    memcpy(e->bins + b->lo, e->tmp + b->lo, (size_t)(b->hi - b->lo) * sizeof(uint16_t));
+    uint64_t acc = 0;
+    int split = b->lo + 1;
+    for (int i = b->lo; i < b->hi - 1; i++) {
+        acc += e->count[e->bins[i]];
+        split = i + 1;
+        if (2 * acc >= b->pop) {
+            break;
+        }
+    }
+    *nb = (color_box){.lo = split, .hi = b->hi};
+    b->hi = split;
+    box_stats(e, b);
+    box_stats(e, nb);
+}
+
+// Builds the palette and lut from the histogram, returns the number of colors.
+static int median_cut(sixel_encoder *e, int n_bins, int max_colors) {
+    if (n_bins == 0) {
+        return 0;
+    }
+    int n = 1;
+    e->boxes[0] = (color_box){.lo = 0, .hi = n_bins};
+    box_stats(e, &e->boxes[0]);
+    while (n < max_colors) {
+        // Split the box with the most pixels times color range.
+        int best = -1;
+        uint64_t best_score = 0;
+        for (int i = 0; i < n; i++) {
+            uint64_t score = e->boxes[i].pop * (uint64_t)e->boxes[i].range;
+            if (e->boxes[i].hi - e->boxes[i].lo > 1 && score >= best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (best < 0) {
+            break; // every box is a single bin.
+        }
+        box_split(e, &e->boxes[best], &e->boxes[n]);
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t s[3] = {0, 0, 0}, cnt = 0;
+        for (int j = e->boxes[i].lo; j < e->boxes[i].hi; j++) {
+            int k = e->bins[j];
+            for (int c = 0; c < 3; c++) {
+                s[c] += e->sum[k][c];
+            }
+            cnt += e->count[k];
+            e->lut[k] = (uint8_t)i;
+        }
+        for (int c = 0; c < 3; c++) {
+            e->palette[i][c] = (uint8_t)(s[c] / cnt);
+        }
+    }
+    return n;
+}
+
+// Appends the run of count times sixel character ch.
+static inline char *sixel_run(char *p, uint8_t ch, int count) {
+    if (count > 3) {
+        *p++ = '!';
+        p = fmt_uint(p, (uint32_t)count);
+        *p++ = (char)ch;
+        return p;
+    }
+    while (count-- > 0) {
+        *p++ = (char)ch;
+    }
+    return p;
+}
+
+void sixel_encode(sixel_encoder *e, buffer *out, const image *img, int max_colors) {
+    max_colors = max_colors < 2 ? 2 : max_colors > 255 ? 255 : max_colors;
+    int w = img->w, h = img->h;
+    size_t n = (size_t)w * (size_t)h;
+    if (n > e->keys_cap) {
+        free(e->keys);
+        e->keys = malloc(n * sizeof(uint16_t));
+        e->keys_cap = e->keys != NULL ? n : 0;
+    }
+    if ((size_t)w * 256 > e->rows_cap) {
+        free(e->rows);
+        e->rows = malloc((size_t)w * 256);
+        e->rows_cap = e->rows != NULL ? (size_t)w * 256 : 0;
+    }
+    if (e->keys == NULL || e->rows == NULL) {
+        LOG_ERROR("Failed to allocate sixel scratch memory for %dx%d", w, h);
+        return;
+    }
+    // Histogram bins (straight loop, vectorized by the compiler), then counts.
+    const uint8_t *d = img->data;
+    uint16_t *keys = e->keys;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *p = d + 4 * i;
+        keys[i] = p[3] < 128 ? TRANSPARENT : (uint16_t)((p[0] >> 3) << 10 | (p[1] >> 3) << 5 | p[2] >> 3);
+    }
+    int n_bins = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint16_t k = keys[i];
+        if (k == TRANSPARENT) {
+            continue;
+        }
+        if (e->count[k]++ == 0) {
+            e->bins[n_bins++] = k;
+        }
+        e->sum[k][0] += d[4 * i];
+        e->sum[k][1] += d[4 * i + 1];
+        e->sum[k][2] += d[4 * i + 2];
+    }
+    int colors = median_cut(e, n_bins, max_colors);
+    for (int i = 0; i < n_bins; i++) { // reset for the next image.
+        e->count[e->bins[i]] = 0;
+        memset(e->sum[e->bins[i]], 0, sizeof(e->sum[0]));
+    }
+    // DCS P1=0 (aspect from the raster attributes) P2=1 (transparent background) q, raster 1:1 w x h.
+    append_str(out, STR("\033P0;1q\"1;1;"));
+    append_int(out, w);
+    append_byte(out, ';');
+    append_int(out, h);
+    for (int i = 0; i < colors; i++) {
+        char *p = reserve_buf(out, 6 + 3 * (FMT_U8_MAX + 1));
+        char *s = p;
+        *p++ = '#';
+        p = fmt_u8(p, (uint8_t)i);
+        *p++ = ';';
+        *p++ = '2';
+        for (int c = 0; c < 3; c++) {
+            *p++ = ';';
+            p = fmt_u8(p, (uint8_t)((e->palette[i][c] * 100 + 127) / 255));
+        }
+        commit_buf(out, (size_t)(p - s));
+    }
+    for (int y0 = 0; y0 < h; y0 += 6) {
+        int used = 0;
+        for (int r = 0; r < 6 && y0 + r < h; r++) {
+            const uint16_t *row = keys + (size_t)(y0 + r) * (size_t)w;
+            for (int x = 0; x < w; x++) {
+                uint8_t c = e->lut[row[x]];
+                if (c == NO_INDEX) {
+                    continue;
+                }
+                if (e->slot[c] < 0) {
+                    e->slot[c] = (int16_t)used;
+                    e->order[used++] = c;
+                    memset(e->rows + (size_t)e->slot[c] * (size_t)w, 0, (size_t)w);
+                }
+                e->rows[(size_t)e->slot[c] * (size_t)w + (size_t)x] |= (uint8_t)(1 << r);
+            }
+        }
+        for (int u = 0; u < used; u++) {
+            uint8_t c = e->order[u];
+            const uint8_t *bits = e->rows + (size_t)u * (size_t)w;
+            int end = w;
+            while (end > 0 && bits[end - 1] == 0) {
+                end--; // trailing empty columns.
+            }
+            // "#c", the runs (each at most its length or "!n" + 1) and "$".
+            char *p = reserve_buf(out, 6 + (size_t)end + 1);
+            char *s = p;
+            *p++ = '#';
+            p = fmt_u8(p, c);
+            for (int x = 0; x < end;) {
+                int run = 1;
+                while (x + run < end && bits[x + run] == bits[x]) {
+                    run++;
+                }
+                p = sixel_run(p, (uint8_t)(63 + bits[x]), run);
+                x += run;
+            }
+            if (u < used - 1) {
+                *p++ = '$'; // back to the start of the band for the next color.
+            }
+            commit_buf(out, (size_t)(p - s));
+            e->slot[c] = -1;
+        }
+        if (y0 + 6 < h) {
+            append_byte(out, '-');
+        }
+    }
+    append_str(out, STR("\033\\"));
+}
@@ -0,0 +1,352 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "input.h"
+#include "scan.h"
+#include "utf8.h"
+#include <string.h>
+
+static const char paste_end[] = "\033[201~";
+
+enum {
+    PASTE_END_LEN = sizeof(paste_end) - 1,
+    MAX_PARAMS = 8,
+    MAX_PARAM = 99999, // saturate instead of overflowing on silly inputs.
+    MAX_SEQ = 4096,    // longest incomplete sequence held waiting for its end.
+};
+
+typedef struct csi {
+    char prefix, intermediate, final; // final is 0 for a malformed sequence.
+    int n;                            // number of parameters.
+    int p[MAX_PARAMS];                // parameters (their first sub parameter), -1 when omitted.
+    int sub[MAX_PARAMS];              // second sub parameters (after ':'), -1 when none.
+} csi;
+
+// Parses the CSI sequence at s (ESC [ ...). Returns its length, 0 if it's
+// incomplete. A sequence interrupted by a byte that can't be part of one ends
+// before that byte, with a 0 final.
+static size_t parse_csi(const char *s, size_t n, csi *c) {
+    *c = (csi){0};
+    for (int i = 0; i < MAX_PARAMS; i++) {
+        c->p[i] = c->sub[i] = -1;
+    }
+    int sub = 0; // index of the current sub parameter.
+    bool any = false;
+    for (size_t i = 2; i < n; i++) {
+        unsigned char b = (unsigned char)s[i];
+        if (b >= '0' && b <= '9') {
+            if (c->n < MAX_PARAMS && sub < 2) {
+                int *v = sub == 0 ? &c->p[c->n] : &c->sub[c->n];
+                *v = *v < 0 ? b - '0' : *v * 10 + (b - '0');
+                *v = *v > MAX_PARAM ? MAX_PARAM : *v;
+            }
+            any = true;
+        } else if (b == ';') {
+            c->n++;
+            sub = 0;
+            any = true;
+        } else if (b == ':') {
+            sub++;
+            any = true;
+        } else if (b >= '<' && b <= '?') {
+            c->prefix = i == 2 ? (char)b : c->prefix;
+        } else if (b >= 0x20 && b <= 0x2F) {
+            c->intermediate = (char)b;
+        } else if (b >= 0x40 && b <= 0x7E) {
+            c->final = (char)b;
+            c->n = !any ? 0 : c->n < MAX_PARAMS ? c->n + 1 : MAX_PARAMS;
+            return i + 1;
+        } else {
+            c->n = 0;
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Length of the OSC, DCS or APC string at s (terminated by BEL or ST), 0 if incomplete.
+static size_t string_len(const char *s, size_t n) {
+    for (size_t i = 2; i < n;) {
+        const char *t = scan_esc_or_bel(s + i, n - i);
+        if (t == NULL) {
+            return 0;
+        }
+        i = (size_t)(t - s) + 1;
+        if (*t == '\a') {
+            return i;
+        }
+        if (i < n && s[i] == '\\') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Decodes the (UTF-8) character at s as a key. Returns its length, 0 if
+// incomplete (and not final, U+FFFD then).
+static size_t decode_char(const char *s, size_t n, bool final, input_event *e) {
+    unsigned char c = (unsigned char)s[0];
+    if (c >= 0x80) {
+        size_t len;
+        e->key = utf8_decode((const unsigned char *)s, n, &len);
+        return !final && len == 1 && n < 4 && utf8_partial(s, n) == n ? 0 : len;
+    }
+    switch (c) {
+    case 0:
+        e->key = ' ';
+        e->mods = INPUT_CTRL;
+        break;
+    case '\b':
+        e->key = INPUT_KEY_BACKSPACE;
+        e->mods = INPUT_CTRL;
+        break;
+    case '\t':
+    case '\r':
+    case 0x1b:
+    case 0x7f:
+        e->key = c;
+        break;
+    default:
+        if (c < 0x1b) {
+            e->key = 'a' + c - 1;
+            e->mods = INPUT_CTRL;
+        } else if (c < 0x20) {
+            e->key = c + 0x40; // Ctrl-\ Ctrl-] Ctrl-^ Ctrl-_
+            e->mods = INPUT_CTRL;
+        } else {
+            e->key = c;
+        }
+    }
+    return 1;
+}
+
+static inline uint8_t mods_param(int p) { return p > 1 ? (uint8_t)(p - 1) : 0; }
+
+// Letter finals of the legacy cursor and F1-F4 keys, with a 1 (or omitted)
+// first parameter (CSI 1;5A is Ctrl-Up) or after SS3 (ESC O A).
+static bool letter_key(char final, input_event *e) {
+    switch (final) {
+    case 'A':
+        e->key = INPUT_KEY_UP;
+        return true;
+    case 'B':
+        e->key = INPUT_KEY_DOWN;
+        return true;
+    case 'C':
+        e->key = INPUT_KEY_RIGHT;
+        return true;
+    case 'D':
+        e->key = INPUT_KEY_LEFT;
+        return true;
+    case 'H':
+        e->key = INPUT_KEY_HOME;
+        return true;
+    case 'F':
+        e->key = INPUT_KEY_END;
+        return true;
+    case 'M':
+        e->key = INPUT_KEY_ENTER; // keypad enter.
+        return true;
+    case 'P':
+    case 'Q':
+    case 'R':
+    case 'S':
+        e->key = INPUT_KEY_F1 + (uint32_t)(final - 'P');
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Keys of the CSI number ~ sequences.
+static bool tilde_key(int p, input_event *e) {
+    static const uint32_t keys[] = {
+        [1] = INPUT_KEY_HOME,    [2] = INPUT_KEY_INSERT,    [3] = INPUT_KEY_DELETE, [4] = INPUT_KEY_END,
+        [5] = INPUT_KEY_PAGE_UP, [6] = INPUT_KEY_PAGE_DOWN, [7] = INPUT_KEY_HOME,   [8] = INPUT_KEY_END,
+    };
+    // F1 to F20, with the historical gaps.
+    static const int fkeys[] = {11, 12, 13, 14, 15, 17, 18, 19, 20, 21, 23, 24, 25, 26, 28, 29, 31, 32, 33, 34};
+    if (p > 0 && p < (int)(sizeof(keys) / sizeof(keys[0]))) {
+        e->key = keys[p];
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(fkeys) / sizeof(fkeys[0]); i++) {
+        if (fkeys[i] == p) {
+            e->key = INPUT_KEY_F1 + (uint32_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fills e for the complete CSI sequence c: type stays INPUT_OTHER if it's none of ours.
+static void csi_event(const csi *c, input_event *e) {
+    if (c->prefix == '<' && (c->final == 'M' || c->final == 'm') && c->intermediate == 0 && c->n == 3) {
+        int b = c->p[0] < 0 ? 0 : c->p[0];
+        e->type = INPUT_MOUSE;
+        e->mods = (b & 4 ? INPUT_SHIFT : 0) | (b & 8 ? INPUT_ALT : 0) | (b & 16 ? INPUT_CTRL : 0);
+        e->button = (uint8_t)(b & 0xC3);
+        e->action = c->final == 'm' ? INPUT_RELEASE : b & 32 ? INPUT_MOTION : INPUT_PRESS;
+        e->x = c->p[1] > 0 ? c->p[1] - 1 : 0;
+        e->y = c->p[2] > 0 ? c->p[2] - 1 : 0;
+        return;
+    }
+    if (c->prefix != 0 || c->intermediate != 0) {
+        return;
+    }
+    bool key;
+    switch (c->final) {
+    case 'u':
+        e->key = (uint32_t)c->p[0];
+        key = c->p[0] > 0;
+        break;
+    case '~':
+        key = tilde_key(c->p[0], e);
+        break;
+    case 'Z':
+        e->key = INPUT_KEY_TAB;
+        key = c->n == 0;
+        e->mods = INPUT_SHIFT; // back tab.
+        break;
+    case 'I':
+    case 'O':
+        if (c->n == 0) {
+            e->type = c->final == 'I' ? INPUT_FOCUS_IN : INPUT_FOCUS_OUT;
+        }
+        return;
+    default:
+        key = c->final != 'M' && c->p[0] <= 1 && c->n <= 2 && letter_key(c->final, e); // CSI M is X10 mouse.
+    }
+    if (!key) {
+        return;
+    }
+    e->type = INPUT_KEY;
+    if (c->n > 1) {
+        e->mods = mods_param(c->p[1]);
+        e->action = c->sub[1] == 2 ? INPUT_REPEAT : c->sub[1] == 3 ? INPUT_RELEASE : INPUT_PRESS;
+    }
+}
+
+// Decodes the escape sequence at s (ESC followed by one of [ O ] P _).
+// Returns its length, 0 if incomplete.
+static size_t decode_seq(input_decoder *d, const char *s, size_t n, input_event *e, bool *emit) {
+    e->type = INPUT_OTHER;
+    if (s[1] == 'O') {
+        if (n < 3) {
+            return 0;
+        }
+        if (letter_key(s[2], e)) {
+            e->type = INPUT_KEY;
+        }
+        return 3;
+    }
+    if (s[1] != '[') {
+        return string_len(s, n);
+    }
+    csi c;
+    size_t len = parse_csi(s, n, &c);
+    if (len > 0 && c.final == '~' && c.n == 1 && c.p[0] == 200 && c.prefix == 0) {
+        d->in_paste = true;
+        *emit = false;
+    } else if (len > 0 && c.final != 0) {
+        csi_event(&c, e);
+    }
+    return len;
+}
+
+// Whether s (starting with ESC) may be a sequence: ESC O only with an SS3 key after it.
+static inline bool seq_start(const char *s, size_t n) {
+    char c = s[1];
+    input_event unused;
+    return c == '[' || c == ']' || c == 'P' || c == '_' || (c == 'O' && (n < 3 || letter_key(s[2], &unused)));
+}
+
+// Decodes ESC and the character after it as an Alt + key. Returns its length, 0 if incomplete.
+static size_t alt_key(const char *s, size_t n, bool final, input_event *e) {
+    size_t len = decode_char(s + 1, n - 1, final, e);
+    e->mods |= INPUT_ALT;
+    return len > 0 ? len + 1 : 0;
+}
+
+// Decodes the event at s. Returns its length, 0 if incomplete. *emit is set to
+// false for the sequences that don't make an event (the paste start).
+static size_t decode_one(input_decoder *d, const char *s, size_t n, bool final, input_event *e, bool *emit) {
+    *e = (input_event){.type = INPUT_KEY, .data = s};
+    *emit = true;
+    size_t len;
+    if (s[0] == 0x1b && (n == 1 || (n == 2 && s[1] == 0x1b)) && !final) {
+        len = 0; // may be the start of a sequence still to be read.
+    } else if (s[0] != 0x1b || n == 1) {
+        len = decode_char(s, n, final, e);
+    } else if (seq_start(s, n)) {
+        len = decode_seq(d, s, n, e, emit);
+    } else if (s[1] == 0x1b && n > 2 && (s[2] == '[' || s[2] == 'O') && seq_start(s + 1, n - 1)) {
+        len = decode_seq(d, s + 1, n - 1, e, emit); // ESC then a sequence: Alt + key (some terminals).
+        len = len > 0 ? len + 1 : 0;
+        e->mods |= e->type == INPUT_KEY ? INPUT_ALT : 0;
+    } else {
+        len = alt_key(s, n, final, e);
+    }
+    if (len == 0 && s[0] == 0x1b && n > 1 && (final || n >= MAX_SEQ)) {
+        // A sequence that never got completed (e.g Alt-P or Alt-[ typed): just the key.
+        *e = (input_event){.type = INPUT_KEY, .data = s};
+        *emit = true;
+        len = alt_key(s, n, final, e);
+    }
+    e->size = len;
+    return len;
+}
+
+// Length of the start of s[0..n) that can't be the beginning of the paste end marker.
+static size_t paste_safe_len(const char *s, size_t n) {
+    for (size_t k = n < PASTE_END_LEN - 1 ? n : PASTE_END_LEN - 1; k > 0; k--) {
+        if (memcmp(s + n - k, paste_end, k) == 0) {
+            return n - k;
+        }
+    }
+    return n;
+}
+
+int input_decode(input_decoder *d, buffer *in, input_event *ev, int max, bool final) {
+    const char *s = in->data + in->start;
+    size_t n = in->size, i = 0;
+    int count = 0;
+    while (i < n && count < max) {
+        input_event *e = &ev[count];
+        if (d->in_paste) {
+            // Pastes only end with the marker: look for it at each ESC (rare in pasted text).
+            const char *p = s + i, *end = NULL;
+            while ((p = scan_esc(p, (size_t)(s + n - p))) != NULL && (size_t)(s + n - p) >= PASTE_END_LEN) {
+                if (memcmp(p, paste_end, PASTE_END_LEN) == 0) {
+                    end = p;
+                    break;
+                }
+                p++;
+            }
+            size_t len = end != NULL ? (size_t)(end - (s + i)) : paste_safe_len(s + i, n - i);
+            if (end == NULL && len == 0) {
+                break; // only the possible start of the end marker, wait for the rest.
+            }
+            *e = (input_event){.type = INPUT_PASTE, .paste_end = end != NULL, .data = s + i, .size = len};
+            i += len + (end != NULL ? PASTE_END_LEN : 0);
+            d->in_paste = end == NULL;
+            count++;
+            continue;
+        }
+        bool emit;
+        size_t len = decode_one(d, s + i, n - i, final, e, &emit);
+        if (len == 0) {
+            break;
+        }
+        i += len;
+        count += emit;
+    }
+    consume(in, i);
+    return count;
+}
@@ -0,0 +1,106 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "iov.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+enum { IOV_PER_CALL = 64 }; // well under IOV_MAX everywhere.
+
+void iov_init(iov_batch *b) {
+    *b = (iov_batch){0};
+    b->copy = new_buf(256);
+}
+
+void iov_free(iov_batch *b) {
+    free(b->entries);
+    b->entries = NULL;
+    b->n = b->cap = 0;
+    free_buf(&b->copy);
+}
+
+static iov_entry *new_entry(iov_batch *b) {
+    if (b->n == b->cap) {
+        b->cap = b->cap ? 2 * b->cap : 64;
+        b->entries = realloc(b->entries, (size_t)b->cap * sizeof(iov_entry));
+    }
+    return &b->entries[b->n++];
+}
+
+void iov_ref(iov_batch *b, const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    b->size += len;
+    if (b->n > 0) {
+        iov_entry *last = &b->entries[b->n - 1];
+        if (last->ref != NULL && last->ref + last->len == data) {
+            last->len += len;
+            return;
+        }
+    }
+    *new_entry(b) = (iov_entry){data, 0, len};
+}
+
+void iov_copy(iov_batch *b, const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    b->size += len;
+    size_t off = b->copy.size;
+    append_data(&b->copy, data, len);
+    if (b->n > 0 && b->entries[b->n - 1].ref == NULL) {
+        b->entries[b->n - 1].len += len; // copies are contiguous.
+        return;
+    }
+    *new_entry(b) = (iov_entry){NULL, off, len};
+}
+
+ssize_t iov_flush(iov_batch *b, int fd) {
+    ssize_t total = 0;
+    int i = 0;
+    size_t done = 0; // bytes of entries[i] already written.
+    while (i < b->n) {
+        struct iovec iov[IOV_PER_CALL];
+        int cnt = 0;
+        size_t want = 0;
+        for (int j = i; j < b->n && cnt < IOV_PER_CALL; j++, cnt++) {
+            const iov_entry *e = &b->entries[j];
+            const char *base = e->ref != NULL ? e->ref : b->copy.data + b->copy.start + e->off;
+            size_t skip = j == i ? done : 0;
+            iov[cnt].iov_base = (void *)(base + skip);
+            iov[cnt].iov_len = e->len - skip;
+            want += iov[cnt].iov_len;
+        }
+        ssize_t n = writev(fd, iov, cnt);
+        b->writes++;
+        b->partial_writes += n < (ssize_t)want;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            total = total ? total : -1; // keep the error for later if we did partial write.
+            break;
+        }
+        total += n;
+        // Advance past what was written (possibly ending in the middle of an entry).
+        size_t left = (size_t)n;
+        while (i < b->n && left >= b->entries[i].len - done) {
+            left -= b->entries[i].len - done;
+            done = 0;
+            i++;
+        }
+        done += left;
+    }
+    b->n = 0;
+    b->size = 0;
+    clear_buf(&b->copy);
+    return total;
+}
@@ -0,0 +1,145 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "lz4.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+enum {
+    LZ4_MIN_MATCH = 4,
+    LZ4_LAST_LITERALS = 5, // the last 5 bytes are always literals...
+    LZ4_MFLIMIT = 12,      // ...and the last match starts at least 12 bytes before the end.
+    LZ4_MAX_OFFSET = 65535,
+    LZ4_HASH_BITS = 13,
+    LZ4_SKIP_TRIGGER = 6, // the search step grows by one every 2^6 misses (incompressible data).
+};
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - LZ4_HASH_BITS); }
+
+// Length continuation bytes beyond the 15 of the token nibble.
+static inline unsigned char *put_len(unsigned char *op, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *put_literals(unsigned char *op, unsigned char *token, const unsigned char *lit, size_t n) {
+    *token = (unsigned char)((n >= 15 ? 15 : n) << 4);
+    if (n >= 15) {
+        op = put_len(op, n - 15);
+    }
+    memcpy(op, lit, n);
+    return op + n;
+}
+
+size_t lz4_compress(const char *src, size_t n, char *dst) {
+    const unsigned char *base = (const unsigned char *)src, *ip = base, *anchor = base, *end = base + n;
+    unsigned char *op = (unsigned char *)dst;
+    uint32_t table[1 << LZ4_HASH_BITS] = {0}; // positions, checked against the data so 0 is fine.
+    if (n > LZ4_MFLIMIT) {
+        const unsigned char *mflimit = end - LZ4_MFLIMIT, *matchlimit = end - LZ4_LAST_LITERALS;
+        unsigned misses = 0;
+        while (ip <= mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash4(seq);
+            const unsigned char *ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(ref) != seq) {
+                ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const unsigned char *m = ip + LZ4_MIN_MATCH, *r = ref + LZ4_MIN_MATCH;
+            while (m < matchlimit && *m == *r) {
+                m++;
+                r++;
+            }
+            unsigned char *token = op++;
+            op = put_literals(op, token, anchor, (size_t)(ip - anchor));
+            size_t offset = (size_t)(ip - ref), mlen = (size_t)(m - ip) - LZ4_MIN_MATCH;
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)(mlen >= 15 ? 15 : mlen);
+            if (mlen >= 15) {
+                op = put_len(op, mlen - 15);
+            }
+            ip = anchor = m;
+            table[hash4(read32(m - 2))] = (uint32_t)(m - 2 - base); // helps the next match.
+        }
+    }
+    unsigned char *token = op++;
+    op = put_literals(op, token, anchor, (size_t)(end - anchor));
+    return (size_t)(op - (unsigned char *)dst);
+}
+
+// Reads the extra length bytes after a 15 nibble. Returns false past end.
+static inline bool get_len(const unsigned char **ip, const unsigned char *end, size_t *len) {
+    unsigned b;
+    do {
+        if (*ip >= end) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+ssize_t lz4_decompress(const char *src, size_t n, char *dst, size_t cap) {
+    const unsigned char *ip = (const unsigned char *)src, *end = ip + n;
+    unsigned char *out = (unsigned char *)dst, *op = out, *oend = out + cap;
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if ((lit == 15 && !get_len(&ip, end, &lit)) || lit > (size_t)(end - ip) || lit > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == end) {
+            break; // the last sequence has no match.
+        }
+        if (end - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8, mlen = token & 15;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out) || (mlen == 15 && !get_len(&ip, end, &mlen))) {
+            return -1;
+        }
+        mlen += LZ4_MIN_MATCH;
+        if (mlen > (size_t)(oend - op)) {
+            return -1;
+        }
+        // Overlapping matches repeat the last offset bytes: copy them in growing
+        // non overlapping pieces (the copied part keeps the same period).
+        const unsigned char *m = op - offset;
+        while (mlen > 0) {
+            size_t c = mlen < (size_t)(op - m) ? mlen : (size_t)(op - m);
+            memcpy(op, m, c);
+            op += c;
+            mlen -= c;
+        }
+    }
+    return op - out;
+}
@@ -0,0 +1,716 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "rec.h"
+#include "log.h"
+#include "lz4.h"
+#include "timer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static const char REC_MAGIC[8] = {'A', 'P', 'R', 'E', 'C', '0', '0', '1'};
+static const char REC_INDEX_MAGIC[8] = {'A', 'P', 'R', 'E', 'C', 'I', 'D', 'X'};
+enum {
+    REC_VERSION = 1,
+    REC_VERSION_LZ4 = 2,
+    REC_FILE_BUFFER = 1 << 16, // stdio buffer for the output files, larger than the default to batch writes.
+};
+
+static inline char *put_u16(char *p, uint16_t v) {
+    p[0] = (char)v;
+    p[1] = (char)(v >> 8);
+    return p + 2;
+}
+
+static inline char *put_u32(char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (char)(v >> (8 * i));
+    }
+    return p + 4;
+}
+
+static inline char *put_u64(char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (char)(v >> (8 * i));
+    }
+    return p + 8;
+}
+
+static inline uint16_t get_u16(const char *p) { return (uint16_t)((unsigned char)p[0] | (unsigned char)p[1] << 8); }
+
+static inline uint32_t get_u32(const char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+        v = v << 8 | (unsigned char)p[i];
+    }
+    return v;
+}
+
+static inline uint64_t get_u64(const char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = v << 8 | (unsigned char)p[i];
+    }
+    return v;
+}
+
+// --- Indexer
+
+static void add_frame(rec_indexer *ix, uint64_t stream, rec_frame_kind kind) {
+    // Most recent chunk starting at or before that stream offset.
+    int i = 0;
+    while (i < ix->n_chunks && ix->chunks[i].stream > stream) {
+        i++;
+    }
+    if (i == ix->n_chunks) {
+        LOG_DEBUG("Frame at stream offset %llu is too many chunks back, not indexed", (unsigned long long)stream);
+        return;
+    }
+    if (ix->n_frames == ix->cap_frames) {
+        ix->cap_frames = ix->cap_frames ? 2 * ix->cap_frames : 256;
+        ix->frames = realloc(ix->frames, ix->cap_frames * sizeof(rec_frame));
+    }
+    ix->frames[ix->n_frames++] = (rec_frame){
+        .chunk_offset = ix->chunks[i].offset,
+        .skip = (uint32_t)(stream - ix->chunks[i].stream),
+        .kind = kind,
+        .ts = ix->chunks[i].ts,
+    };
+}
+
+static int index_token(void *ctx, const ansi_token *t) {
+    rec_indexer *ix = ctx;
+    uint64_t start = ix->pos;
+    ix->pos += t->size;
+    if (t->type != ANSI_CSI) {
+        return 0;
+    }
+    if (t->final == 'J') {
+        add_frame(ix, start, REC_FRAME_CLEAR);
+    } else if (t->final == 'l' && t->prefix == '?' && t->n_params == 1 && t->params[0] == 2026) {
+        add_frame(ix, ix->pos, REC_FRAME_SYNC);
+    }
+    return 0;
+}
+
+void rec_indexer_init(rec_indexer *ix) {
+    *ix = (rec_indexer){0};
+    ansi_init(&ix->tok, index_token, ix);
+}
+
+void rec_indexer_free(rec_indexer *ix) {
+    ansi_free(&ix->tok);
+    free(ix->frames);
+    ix->frames = NULL;
+    ix->n_frames = ix->cap_frames = 0;
+}
+
+void rec_indexer_feed(rec_indexer *ix, uint64_t offset, uint64_t ts, const char *data, size_t len) {
+    enum { N = sizeof(ix->chunks) / sizeof(ix->chunks[0]) };
+    if (ix->n_chunks < N) {
+        ix->n_chunks++;
+    }
+    memmove(&ix->chunks[1], &ix->chunks[0], (size_t)(ix->n_chunks - 1) * sizeof(ix->chunks[0]));
+    ix->chunks[0].offset = offset;
+    ix->chunks[0].stream = ix->chunk_in;
+    ix->chunks[0].ts = ts;
+    ix->chunk_in += len;
+    ansi_feed(&ix->tok, data, len);
+}
+
+// --- Writer
+
+static rec_writer *create(const char *path, int width, int height, bool lz4) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        LOG_ERROR("Error creating recording '%s': %s", path, strerror(errno));
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, REC_FILE_BUFFER);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    char hdr[REC_HEADER_SIZE];
+    char *p = hdr;
+    memcpy(p, REC_MAGIC, sizeof(REC_MAGIC));
+    p = put_u16(p + sizeof(REC_MAGIC), lz4 ? REC_VERSION_LZ4 : REC_VERSION);
+    p = put_u16(p, (uint16_t)width);
+    p = put_u16(p, (uint16_t)height);
+    p = put_u16(p, 0);
+    put_u64(p, (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+    // Flushed right away so a fork()ed child can't write it again.
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || fflush(f) != 0) {
+        LOG_ERROR("Error writing recording header to '%s': %s", path, strerror(errno));
+        fclose(f);
+        return NULL;
+    }
+    rec_writer *w = calloc(1, sizeof(rec_writer));
+    w->f = f;
+    w->lz4 = lz4;
+    w->offset = w->file_offset = REC_HEADER_SIZE;
+    w->start = now_ns();
+    rec_indexer_init(&w->ix);
+    return w;
+}
+
+rec_writer *rec_create(const char *path, int width, int height) { return create(path, width, height, false); }
+
+rec_writer *rec_create_compressed(const char *path, int width, int height) {
+    return create(path, width, height, true);
+}
+
+// Compresses and writes the block being built.
+static int write_block(rec_writer *w) {
+    if (w->block.size == 0) {
+        return 0;
+    }
+    size_t n = w->block.size;
+    const char *data = w->block.data + w->block.start;
+    clear_buf(&w->packed);
+    char *p = reserve_buf(&w->packed, REC_BLOCK_HEADER_SIZE + lz4_bound(n));
+    size_t packed = lz4_compress(data, n, p + REC_BLOCK_HEADER_SIZE);
+    if (packed >= n) {
+        memcpy(p + REC_BLOCK_HEADER_SIZE, data, n); // incompressible: stored.
+        packed = n;
+    }
+    put_u32(put_u32(p, (uint32_t)packed), (uint32_t)n);
+    commit_buf(&w->packed, REC_BLOCK_HEADER_SIZE + packed);
+    clear_buf(&w->block);
+    if (fwrite(p, 1, w->packed.size, w->f) != w->packed.size) {
+        LOG_ERROR("Error writing %zu bytes block to recording: %s", w->packed.size, strerror(errno));
+        return -1;
+    }
+    w->file_offset += w->packed.size;
+    w->packed_bytes += packed;
+    return 0;
+}
+
+// Appends a chunk to the block being built, writing that block first when the
+// chunk starts a clear screen frame (so seeking there decompresses only from
+// there), unless it's still small as tiny blocks compress poorly.
+static int write_compressed(rec_writer *w, const char *hdr, const char *data, size_t len) {
+    size_t frames = w->ix.n_frames;
+    rec_indexer_feed(&w->ix, w->offset, get_u64(hdr), data, len);
+    bool cut = false;
+    for (size_t i = frames; i < w->ix.n_frames; i++) {
+        cut = cut || (w->ix.frames[i].kind == REC_FRAME_CLEAR && w->ix.frames[i].chunk_offset == w->offset);
+    }
+    if (cut && w->block.size >= REC_BLOCK_MIN && write_block(w) < 0) {
+        return -1;
+    }
+    append_data(&w->block, hdr, REC_CHUNK_HEADER_SIZE);
+    append_data(&w->block, data, len);
+    w->offset += REC_CHUNK_HEADER_SIZE + len;
+    return w->block.size >= REC_BLOCK_SIZE ? write_block(w) : 0;
+}
+
+rec_writer *rec_append(const char *path) {
+    FILE *f = fopen(path, "a");
+    if (f == NULL) {
+        LOG_ERROR("Error opening output file '%s': %s", path, strerror(errno));
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, REC_FILE_BUFFER);
+    rec_writer *w = calloc(1, sizeof(rec_writer));
+    w->f = f;
+    w->raw = true;
+    w->start = now_ns();
+    return w;
+}
+
+int rec_write(rec_writer *w, const char *data, size_t len) { return rec_write_at(w, now_ns(), data, len); }
+
+int rec_write_at(rec_writer *w, uint64_t now, const char *data, size_t len) {
+    if (w->raw) {
+        if (fwrite(data, 1, len, w->f) != len) {
+            LOG_ERROR("Error writing %zu bytes to output file: %s", len, strerror(errno));
+            return -1;
+        }
+        w->offset += len;
+        return 0;
+    }
+    uint64_t ts = now - w->start;
+    char hdr[REC_CHUNK_HEADER_SIZE];
+    put_u32(put_u64(hdr, ts), (uint32_t)len);
+    if (w->lz4) {
+        return write_compressed(w, hdr, data, len);
+    }
+    if (fwrite(hdr, 1, sizeof(hdr), w->f) != sizeof(hdr) || fwrite(data, 1, len, w->f) != len) {
+        LOG_ERROR("Error writing %zu bytes chunk to recording: %s", len, strerror(errno));
+        return -1;
+    }
+    rec_indexer_feed(&w->ix, w->offset, ts, data, len);
+    w->offset += REC_CHUNK_HEADER_SIZE + len;
+    return 0;
+}
+
+int rec_close_writer(rec_writer *w) {
+    int ret = 0;
+    if (w->raw) {
+        ret = fclose(w->f);
+        if (ret != 0) {
+            LOG_ERROR("Error closing output file: %s", strerror(errno));
+        }
+        free(w);
+        return ret;
+    }
+    if (w->lz4) {
+        ret = write_block(w);
+        free_buf(&w->block);
+        free_buf(&w->packed);
+    } else {
+        w->file_offset = w->offset;
+    }
+    char entry[REC_FRAME_SIZE];
+    for (size_t i = 0; i < w->ix.n_frames && ret == 0; i++) {
+        const rec_frame *f = &w->ix.frames[i];
+        put_u64(put_u32(put_u32(put_u64(entry, f->chunk_offset), f->skip), f->kind), f->ts);
+        if (fwrite(entry, 1, sizeof(entry), w->f) != sizeof(entry)) {
+            ret = -1;
+        }
+    }
+    char footer[REC_FOOTER_SIZE];
+    memcpy(put_u64(put_u64(footer, w->file_offset), w->ix.n_frames), REC_INDEX_MAGIC, sizeof(REC_INDEX_MAGIC));
+    if (ret == 0 && fwrite(footer, 1, sizeof(footer), w->f) != sizeof(footer)) {
+        ret = -1;
+    }
+    if (fclose(w->f) != 0) {
+        ret = -1;
+    }
+    if (ret != 0) {
+        LOG_ERROR("Error writing recording index: %s", strerror(errno));
+    } else if (w->lz4) {
+        uint64_t chunks = w->offset - REC_HEADER_SIZE;
+        LOG_INFO(
+            "Recording closed with %zu frames indexed, %llu bytes of chunks compressed to %llu (%.1f%%)",
+            w->ix.n_frames,
+            (unsigned long long)chunks,
+            (unsigned long long)w->packed_bytes,
+            chunks ? 100. * (double)w->packed_bytes / (double)chunks : 0.
+        );
+    } else {
+        LOG_INFO("Recording closed with %zu frames indexed", w->ix.n_frames);
+    }
+    rec_indexer_free(&w->ix);
+    free(w);
+    return ret;
+}
+
+// --- Background writer
+
+// Queued chunk header, followed by the data.
+typedef struct rec_entry {
+    rec_writer *w;
+    uint64_t now;
+    size_t len;
+} rec_entry;
+
+enum { REC_QUEUE_BLOCK = 1 << 16 };
+
+struct rec_queue {
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    // The 2 (swapped) buffers' blocks, only grown by producers with mu held.
+    pool blocks;
+    buffer pending; // rec_entry and data, appended by producers.
+    bool stop;
+    bool failed;      // a write failed.
+    size_t batches;   // batches written (for stats).
+    uint64_t written; // bytes written.
+};
+
+static void *rec_queue_loop(void *arg) {
+    rec_queue *q = arg;
+    pthread_mutex_lock(&q->mu);
+    buffer work = new_buf_in(REC_QUEUE_BLOCK, &q->blocks.alloc);
+    pthread_mutex_unlock(&q->mu);
+    for (;;) {
+        pthread_mutex_lock(&q->mu);
+        while (q->pending.size == 0 && !q->stop) {
+            pthread_cond_wait(&q->cond, &q->mu);
+        }
+        bool stop = q->stop && q->pending.size == 0;
+        buffer tmp = q->pending; // swap so producers append to the other buffer while we write.
+        q->pending = work;
+        work = tmp;
+        pthread_mutex_unlock(&q->mu);
+        if (stop) {
+            break;
+        }
+        size_t off = 0;
+        while (off < work.size) {
+            rec_entry e;
+            memcpy(&e, work.data + work.start + off, sizeof(e));
+            off += sizeof(e);
+            if (rec_write_at(e.w, e.now, work.data + work.start + off, e.len) < 0) {
+                q->failed = true;
+            }
+            off += e.len;
+            q->written += e.len;
+        }
+        q->batches++;
+        clear_buf(&work);
+        // Let the next batch accumulate (the files themselves are buffered by stdio).
+        struct timespec ts = {0, REC_QUEUE_INTERVAL_NS};
+        nanosleep(&ts, NULL);
+    }
+    pthread_mutex_lock(&q->mu);
+    free_buf(&work);
+    pthread_mutex_unlock(&q->mu);
+    return NULL;
+}
+
+rec_queue *rec_queue_start(void) {
+    rec_queue *q = calloc(1, sizeof(rec_queue));
+    pthread_mutex_init(&q->mu, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    pool_init(&q->blocks, REC_QUEUE_BLOCK, 2);
+    q->pending = new_buf_in(REC_QUEUE_BLOCK, &q->blocks.alloc);
+    int err = pthread_create(&q->thread, NULL, rec_queue_loop, q);
+    if (err != 0) {
+        LOG_ERROR("Failed to start recording writer thread: %s", strerror(err));
+        free_buf(&q->pending);
+        pool_free(&q->blocks);
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void rec_queue_write(rec_queue *q, rec_writer *w, const char *data, size_t len) {
+    rec_entry e = {w, now_ns(), len};
+    pthread_mutex_lock(&q->mu);
+    bool was_empty = q->pending.size == 0;
+    append_data(&q->pending, (const char *)&e, sizeof(e));
+    append_data(&q->pending, data, len);
+    pthread_mutex_unlock(&q->mu);
+    if (was_empty) {
+        pthread_cond_signal(&q->cond);
+    }
+}
+
+int rec_queue_stop(rec_queue *q) {
+    pthread_mutex_lock(&q->mu);
+    q->stop = true;
+    pthread_mutex_unlock(&q->mu);
+    pthread_cond_signal(&q->cond);
+    pthread_join(q->thread, NULL);
+    LOG_INFO("Recording writer thread wrote %llu bytes in %zu batches", (unsigned long long)q->written, q->batches);
+    int ret = q->failed ? -1 : 0;
+    pthread_mutex_destroy(&q->mu);
+    pthread_cond_destroy(&q->cond);
+    free_buf(&q->pending);
+    pool_free(&q->blocks);
+    free(q);
+    return ret;
+}
+
+// --- Reader
+
+// Decompresses block i into r->block.
+static bool load_block(rec_reader *r, size_t i) {
+    const rec_block *b = &r->blocks[i];
+    r->cur = r->n_blocks;
+    clear_buf(&r->block);
+    ensure_cap(&r->block, b->size);
+    char *dst = r->block.data + r->block.start;
+    bool stored = b->packed == b->size;
+    if (!stored) {
+        clear_buf(&r->packed);
+        ensure_cap(&r->packed, b->packed);
+    }
+    char *src = stored ? dst : r->packed.data + r->packed.start;
+    if (pread(r->fd, src, b->packed, (off_t)b->file) != (ssize_t)b->packed ||
+        (!stored && lz4_decompress(src, b->packed, dst, b->size) != (ssize_t)b->size)) {
+        LOG_ERROR("Corrupted recording block at offset %llu", (unsigned long long)b->file);
+        errno = EINVAL;
+        return false;
+    }
+    r->cur = i;
+    return true;
+}
+
+// pread() of the chunks stream: the file itself, or the decompressed blocks
+// (in which case at most to the end of the block at offset, which never cuts a chunk).
+static ssize_t read_at(rec_reader *r, char *dst, size_t n, uint64_t offset) {
+    if (!r->lz4) {
+        return pread(r->fd, dst, n, (off_t)offset);
+    }
+    const rec_block *b = r->cur < r->n_blocks ? &r->blocks[r->cur] : NULL;
+    if (b == NULL || offset < b->offset || offset >= b->offset + b->size) {
+        // Binary search the last block starting at or before offset.
+        size_t lo = 0, hi = r->n_blocks;
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (r->blocks[mid].offset <= offset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        if (r->n_blocks == 0 || offset < r->blocks[lo].offset || !load_block(r, lo)) {
+            return -1;
+        }
+        b = &r->blocks[lo];
+    }
+    size_t avail = (size_t)(b->offset + b->size - offset);
+    if (n > avail) {
+        n = avail;
+    }
+    memcpy(dst, r->block.data + r->block.start + (offset - b->offset), n);
+    return (ssize_t)n;
+}
+
+// Lists the blocks of a compressed recording (up to end of the file data), whose
+// chunks then end at data_end.
+static void scan_blocks(rec_reader *r, uint64_t end) {
+    size_t cap = 0;
+    uint64_t pos = REC_HEADER_SIZE, offset = REC_HEADER_SIZE;
+    char hdr[REC_BLOCK_HEADER_SIZE];
+    while (pos + REC_BLOCK_HEADER_SIZE <= end && pread(r->fd, hdr, sizeof(hdr), (off_t)pos) == (ssize_t)sizeof(hdr)) {
+        rec_block b = {offset, pos + REC_BLOCK_HEADER_SIZE, get_u32(hdr + 4), get_u32(hdr)};
+        if (b.packed > b.size || b.file + b.packed > end) {
+            break; // truncated last block.
+        }
+        if (r->n_blocks == cap) {
+            cap = cap ? 2 * cap : 64;
+            r->blocks = realloc(r->blocks, cap * sizeof(rec_block));
+        }
+        r->blocks[r->n_blocks++] = b;
+        pos = b.file + b.packed;
+        offset += b.size;
+    }
+    r->cur = r->n_blocks;
+    r->data_end = offset;
+}
+
+static bool read_index(rec_reader *r, uint64_t size) {
+    char footer[REC_FOOTER_SIZE];
+    if (size < REC_HEADER_SIZE + REC_FOOTER_SIZE ||
+        pread(r->fd, footer, sizeof(footer), (off_t)(size - REC_FOOTER_SIZE)) != (ssize_t)sizeof(footer) ||
+        memcmp(footer + 16, REC_INDEX_MAGIC, sizeof(REC_INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    uint64_t index_offset = get_u64(footer);
+    uint64_t count = get_u64(footer + 8);
+    if (index_offset < REC_HEADER_SIZE || count > size / REC_FRAME_SIZE ||
+        index_offset + count * REC_FRAME_SIZE + REC_FOOTER_SIZE != size) {
+        return false;
+    }
+    size_t bytes = (size_t)count * REC_FRAME_SIZE;
+    char *raw = malloc(bytes + 1);
+    bool ok = pread(r->fd, raw, bytes, (off_t)index_offset) == (ssize_t)bytes;
+    if (ok) {
+        r->frames = malloc((size_t)count * sizeof(rec_frame) + 1);
+        for (size_t i = 0; i < count; i++) {
+            const char *e = raw + i * REC_FRAME_SIZE;
+            r->frames[i] = (rec_frame){get_u64(e), get_u32(e + 8), get_u32(e + 12), get_u64(e + 16)};
+        }
+        r->n_frames = (size_t)count;
+        r->data_end = index_offset;
+    }
+    free(raw);
+    return ok;
+}
+
+// No (valid) index: go through the chunks (up to size) to rebuild it.
+static void scan_index(rec_reader *r, uint64_t size) {
+    rec_indexer ix;
+    rec_indexer_init(&ix);
+    buffer chunk = new_buf(4096);
+    uint64_t pos = REC_HEADER_SIZE;
+    char hdr[REC_CHUNK_HEADER_SIZE];
+    while (pos + REC_CHUNK_HEADER_SIZE <= size) {
+        if (read_at(r, hdr, sizeof(hdr), pos) != (ssize_t)sizeof(hdr)) {
+            break;
+        }
+        uint32_t len = get_u32(hdr + 8);
+        if (pos + REC_CHUNK_HEADER_SIZE + len > size) {
+            break; // truncated last chunk.
+        }
+        clear_buf(&chunk);
+        ensure_cap(&chunk, len);
+        if (read_at(r, chunk.data, len, pos + REC_CHUNK_HEADER_SIZE) != (ssize_t)len) {
+            break;
+        }
+        rec_indexer_feed(&ix, pos, get_u64(hdr), chunk.data, len);
+        pos += REC_CHUNK_HEADER_SIZE + len;
+    }
+    free_buf(&chunk);
+    r->data_end = pos;
+    r->frames = ix.frames;
+    r->n_frames = ix.n_frames;
+    ix.frames = NULL;
+    rec_indexer_free(&ix);
+    LOG_INFO("Recording has no index, rebuilt it by scanning: %zu frames", r->n_frames);
+}
+
+rec_reader *rec_open(int fd) {
+    char hdr[REC_HEADER_SIZE];
+    ssize_t n = pread(fd, hdr, sizeof(hdr), 0);
+    if (n != (ssize_t)sizeof(hdr) || memcmp(hdr, REC_MAGIC, sizeof(REC_MAGIC)) != 0) {
+        errno = 0;
+        return NULL; // not (seekable) or not a recording.
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOG_ERROR("Error getting recording size: %s", strerror(errno));
+        return NULL;
+    }
+    uint16_t version = get_u16(hdr + 8);
+    if (version != REC_VERSION && version != REC_VERSION_LZ4) {
+        LOG_ERROR("Unsupported recording version %d", version);
+        errno = EINVAL;
+        return NULL;
+    }
+    rec_reader *r = calloc(1, sizeof(rec_reader));
+    r->fd = fd;
+    r->lz4 = version == REC_VERSION_LZ4;
+    r->width = get_u16(hdr + 10);
+    r->height = get_u16(hdr + 12);
+    r->start = get_u64(hdr + 16);
+    uint64_t size = (uint64_t)st.st_size;
+    r->indexed = read_index(r, size);
+    if (r->lz4) {
+        scan_blocks(r, r->indexed ? r->data_end : size);
+    }
+    if (!r->indexed) {
+        scan_index(r, r->lz4 ? r->data_end : size);
+    }
+    r->next = REC_HEADER_SIZE;
+    return r;
+}
+
+rec_reader *rec_clone(const rec_reader *r) {
+    rec_reader *c = malloc(sizeof(rec_reader));
+    *c = *r;
+    c->frames = malloc(r->n_frames * sizeof(rec_frame) + 1);
+    memcpy(c->frames, r->frames, r->n_frames * sizeof(rec_frame));
+    c->blocks = malloc(r->n_blocks * sizeof(rec_block) + 1);
+    memcpy(c->blocks, r->blocks, r->n_blocks * sizeof(rec_block));
+    c->cur = c->n_blocks;
+    c->block = c->packed = (buffer){0};
+    return c;
+}
+
+void rec_close_reader(rec_reader *r) {
+    if (r == NULL) {
+        return;
+    }
+    free(r->frames);
+    free(r->blocks);
+    free_buf(&r->block);
+    free_buf(&r->packed);
+    free(r);
+}
+
+ssize_t rec_read(rec_reader *r, buffer *b, size_t n) {
+    while (r->left == 0) {
+        char hdr[REC_CHUNK_HEADER_SIZE];
+        if (r->next + REC_CHUNK_HEADER_SIZE > r->data_end) {
+            return 0;
+        }
+        if (read_at(r, hdr, sizeof(hdr), r->next) != (ssize_t)sizeof(hdr)) {
+            return -1;
+        }
+        r->ts = get_u64(hdr);
+        r->at = r->next + REC_CHUNK_HEADER_SIZE;
+        uint64_t len = get_u32(hdr + 8);
+        if (r->at + len > r->data_end) {
+            len = r->data_end - r->at; // truncated last chunk.
+        }
+        r->next = r->at + len;
+        uint32_t skip = r->skip < len ? r->skip : (uint32_t)len;
+        r->skip = 0;
+        r->at += skip;
+        r->left = (uint32_t)(len - skip);
+    }
+    if (n > r->left) {
+        n = r->left;
+    }
+    ensure_room(b, n);
+    ssize_t got = read_at(r, b->data + b->start + b->size, n, r->at);
+    if (got > 0) {
+        b->size += (size_t)got;
+        r->at += (uint64_t)got;
+        r->left -= (uint32_t)got;
+    }
+    return got;
+}
+
+void rec_seek(rec_reader *r, const rec_frame *frame) {
+    r->next = frame->chunk_offset;
+    r->skip = frame->skip;
+    r->left = 0;
+}
+
+ssize_t rec_read_frames(rec_reader *r, buffer *b, const rec_frame *from, const rec_frame *to) {
+    enum { READ_SIZE = 1 << 20 };
+    size_t before = b->size;
+    rec_seek(r, from);
+    ssize_t got = 1;
+    if (to == NULL || to->chunk_offset != from->chunk_offset) {
+        // The whole chunks up to to's: it's where rec_read() sees the end.
+        uint64_t data_end = r->data_end;
+        if (to != NULL) {
+            r->data_end = to->chunk_offset;
+        }
+        while ((got = rec_read(r, b, READ_SIZE)) > 0) {
+        }
+        r->data_end = data_end;
+    }
+    if (to != NULL && got >= 0) {
+        // Then to's chunk up to its frame (from's skip still applies in the same chunk).
+        size_t want = to->skip - (to->chunk_offset == from->chunk_offset ? from->skip : 0);
+        while (want > 0 && (got = rec_read(r, b, want)) > 0) {
+            want -= (size_t)got;
+        }
+    }
+    return got < 0 ? -1 : (ssize_t)(b->size - before);
+}
+
+const rec_frame *rec_find_clear(const rec_reader *r, size_t nth) {
+    for (size_t i = 0; i < r->n_frames; i++) {
+        if (r->frames[i].kind == REC_FRAME_CLEAR && nth-- == 0) {
+            return &r->frames[i];
+        }
+    }
+    return NULL;
+}
+
+const rec_frame *rec_find_time(const rec_reader *r, uint64_t ts) {
+    // Frames are in timestamp order: binary search the first one after ts.
+    size_t lo = 0, hi = r->n_frames;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->frames[mid].ts <= ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    while (lo > 0) {
+        if (r->frames[--lo].kind == REC_FRAME_CLEAR) {
+            return &r->frames[lo];
+        }
+    }
+    return NULL;
+}
+
+size_t rec_clear_count(const rec_reader *r, const rec_frame *frame) {
+    size_t count = 0;
+    for (const rec_frame *f = r->frames; f < frame; f++) {
+        count += f->kind == REC_FRAME_CLEAR;
+    }
+    return count;
+}
@@ -0,0 +1,212 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE // memfd_create
+#endif
+#include "ring.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Anonymous shared memory file of size bytes, -1 on error.
+static int shared_fd(size_t size) {
+#if defined(__linux__)
+    int fd = memfd_create("ap-ring", MFD_CLOEXEC);
+#else
+    static atomic_int seq;
+    char name[32];
+    snprintf(name, sizeof(name), "/ap-ring-%d-%d", (int)getpid(), atomic_fetch_add(&seq, 1));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name); // only our mappings keep it alive.
+    }
+#endif
+    if (fd >= 0 && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Maps the same cap bytes twice in a row so data[i] and data[i + cap] alias.
+static char *map_mirrored(size_t cap) {
+    int fd = shared_fd(cap);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Reserve the whole range first so the second half can't land on something else.
+    char *base = mmap(NULL, 2 * cap, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        void *p = mmap(base + (size_t)i * cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (p == MAP_FAILED) {
+            munmap(base, 2 * cap);
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd); // the mappings keep the memory.
+    return base;
+}
+
+static inline size_t pos(const ring *r, uint64_t p) { return (size_t)(p & (r->cap - 1)); }
+
+bool ring_init(ring *r, size_t min_cap) {
+    *r = (ring){0};
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = page;
+    while (cap < min_cap) {
+        cap *= 2;
+    }
+    r->cap = cap;
+    r->data = map_mirrored(cap);
+    if (r->data != NULL) {
+        r->mirrored = true;
+        return true;
+    }
+    LOG_DEBUG("Mirrored mapping of %zu bytes failed (%s), using a plain ring", cap, strerror(errno));
+    r->data = malloc(cap);
+    if (r->data == NULL) {
+        LOG_ERROR("Failed to allocate %zu bytes ring: %s", cap, strerror(errno));
+        r->cap = 0;
+        return false;
+    }
+    return true;
+}
+
+void ring_free(ring *r) {
+    if (r->data != NULL) {
+        if (r->mirrored) {
+            munmap(r->data, 2 * r->cap);
+        } else {
+            free(r->data);
+        }
+    }
+    *r = (ring){0};
+}
+
+// Readable bytes contiguous from head.
+static inline size_t readable(const ring *r) {
+    size_t n = ring_size(r);
+    if (r->mirrored) {
+        return n;
+    }
+    size_t to_end = r->cap - pos(r, r->head);
+    return n < to_end ? n : to_end;
+}
+
+buffer ring_view(const ring *r) {
+    size_t n = readable(r);
+    return slice_buf((buffer){.data = r->data + pos(r, r->head), .size = n}, 0, n);
+}
+
+void ring_consume(ring *r, size_t n) {
+#if DEBUG
+    if (n > ring_size(r)) {
+        LOG_ERROR("Attempt to consume more bytes than available in ring: %zu > %zu", n, ring_size(r));
+        abort();
+    }
+#endif
+    r->head += n;
+    if (r->head == r->tail) {
+        ring_clear(r); // restart at the beginning: longer contiguous spans when not mirrored.
+    }
+}
+
+char *ring_reserve(ring *r, size_t *n) {
+    size_t room = ring_room(r);
+    if (!r->mirrored) {
+        size_t to_end = r->cap - pos(r, r->tail);
+        room = room < to_end ? room : to_end;
+    }
+    *n = room;
+    return r->data + pos(r, r->tail);
+}
+
+void ring_commit(ring *r, size_t n) {
+#if DEBUG
+    if (n > ring_room(r)) {
+        LOG_ERROR("Attempt to commit more bytes than room in ring: %zu > %zu", n, ring_room(r));
+        abort();
+    }
+#endif
+    r->tail += n;
+}
+
+bool ring_append(ring *r, const char *data, size_t n) {
+    if (n > ring_room(r)) {
+        return false;
+    }
+    while (n > 0) { // one iteration when mirrored, at most two otherwise.
+        size_t w;
+        char *dst = ring_reserve(r, &w);
+        w = n < w ? n : w;
+        memcpy(dst, data, w);
+        ring_commit(r, w);
+        data += w;
+        n -= w;
+    }
+    return true;
+}
+
+ssize_t ring_read(int fd, ring *r) {
+    size_t room;
+    char *dst = ring_reserve(r, &room);
+    if (room == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(fd, dst, room);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        ring_commit(r, (size_t)n);
+    }
+    return n;
+}
+
+ssize_t ring_write_avail(int fd, ring *r) {
+    size_t total = 0;
+    while (ring_size(r) > 0) {
+        buffer v = ring_view(r);
+        ssize_t w = write_avail(fd, v.data, v.size);
+        if (w < 0) {
+            return total ? (ssize_t)total : -1;
+        }
+        ring_consume(r, (size_t)w);
+        total += (size_t)w;
+        if ((size_t)w < v.size) {
+            break; // fd is full.
+        }
+    }
+    return (ssize_t)total;
+}
+
+size_t ring_transfer(buffer *dest, ring *src, size_t n) {
+    size_t total = 0;
+    while (total < n && ring_size(src) > 0) {
+        buffer v = ring_view(src);
+        size_t c = n - total < v.size ? n - total : v.size;
+        append_data(dest, v.data, c);
+        ring_consume(src, c);
+        total += c;
+    }
+    return total;
+}
@@ -0,0 +1,164 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+// Each implementation provides a vector type holding BLOCK bytes, a few
+// operations on it and vmask() which returns MASK_BITS bits per byte (in order)
+// set for the bytes where the vector is all ones.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMPL "avx2"
+#define BLOCK 32
+#define MASK_BITS 1
+typedef __m256i vec;
+static inline vec vload(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline vec vsplat(char c) { return _mm256_set1_epi8(c); }
+static inline vec veq(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vec vgt(vec a, vec b) { return _mm256_cmpgt_epi8(a, b); } // signed bytes
+static inline vec vor(vec a, vec b) { return _mm256_or_si256(a, b); }
+static inline vec vand(vec a, vec b) { return _mm256_and_si256(a, b); }
+static inline uint64_t vmask(vec v) { return (uint32_t)_mm256_movemask_epi8(v); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IMPL "sse2"
+#define BLOCK 16
+#define MASK_BITS 1
+typedef __m128i vec;
+static inline vec vload(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline vec vsplat(char c) { return _mm_set1_epi8(c); }
+static inline vec veq(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec vgt(vec a, vec b) { return _mm_cmpgt_epi8(a, b); } // signed bytes
+static inline vec vor(vec a, vec b) { return _mm_or_si128(a, b); }
+static inline vec vand(vec a, vec b) { return _mm_and_si128(a, b); }
+static inline uint64_t vmask(vec v) { return (uint32_t)_mm_movemask_epi8(v); }
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IMPL "neon"
+#define BLOCK 16
+#define MASK_BITS 4
+typedef uint8x16_t vec;
+static inline vec vload(const char *p) { return vld1q_u8((const uint8_t *)p); }
+static inline vec vsplat(char c) { return vdupq_n_u8((uint8_t)c); }
+static inline vec veq(vec a, vec b) { return vceqq_u8(a, b); }
+static inline vec vgt(vec a, vec b) { return vcgtq_s8(vreinterpretq_s8_u8(a), vreinterpretq_s8_u8(b)); }
+static inline vec vor(vec a, vec b) { return vorrq_u8(a, b); }
+static inline vec vand(vec a, vec b) { return vandq_u8(a, b); }
+// No movemask on NEON: narrowing shift gives 4 bits per byte in a 64 bit value.
+static inline uint64_t vmask(vec v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+#else
+#define IMPL "scalar"
+#define BLOCK 0
+#endif
+
+const char *scan_impl(void) { return IMPL; }
+
+typedef enum scan_kind { SCAN_ESC_OR_BEL, SCAN_CSI_FINAL, SCAN_ANY4, SCAN_NON_ASCII } scan_kind;
+
+typedef struct scan_args {
+    unsigned char accept[4]; // for SCAN_ANY4, padded with repeats of the first one.
+} scan_args;
+
+static inline __attribute__((always_inline)) int scalar_match(unsigned char c, scan_kind kind, const scan_args *a) {
+    switch (kind) {
+    case SCAN_ESC_OR_BEL:
+        return c == 0x1b || c == '\a';
+    case SCAN_CSI_FINAL:
+        return c >= 0x40 && c <= 0x7E;
+    case SCAN_ANY4:
+        return c == a->accept[0] || c == a->accept[1] || c == a->accept[2] || c == a->accept[3];
+    case SCAN_NON_ASCII:
+        return c >= 0x80;
+    }
+    return 0;
+}
+
+#if BLOCK
+static inline __attribute__((always_inline)) vec vmatch(vec v, scan_kind kind, const scan_args *a) {
+    switch (kind) {
+    case SCAN_ESC_OR_BEL:
+        return vor(veq(v, vsplat(0x1b)), veq(v, vsplat('\a')));
+    case SCAN_CSI_FINAL:
+        // 0x40..0x7E are all positive as signed bytes (so 0x80+ are excluded).
+        return vand(vgt(v, vsplat(0x3F)), vgt(vsplat(0x7F), v));
+    case SCAN_ANY4:
+        return vor(
+            vor(veq(v, vsplat((char)a->accept[0])), veq(v, vsplat((char)a->accept[1]))),
+            vor(veq(v, vsplat((char)a->accept[2])), veq(v, vsplat((char)a->accept[3])))
+        );
+    case SCAN_NON_ASCII:
+        return vgt(vsplat(0), v); // 0x80+ are the negative signed bytes.
+    }
+    return v;
+}
+#endif
+
+static inline __attribute__((always_inline)) const char *
+scan_forward(const char *s, size_t n, scan_kind kind, const scan_args *a) {
+    size_t i = 0;
+#if BLOCK
+    for (; i + BLOCK <= n; i += BLOCK) {
+        uint64_t m = vmask(vmatch(vload(s + i), kind, a));
+        if (m) {
+            return s + i + __builtin_ctzll(m) / MASK_BITS;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (scalar_match((unsigned char)s[i], kind, a)) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+const char *scan_esc(const char *s, size_t n) {
+    // libc's memchr is already vectorized (and picks the best ISA at runtime).
+    return memchr(s, 0x1b, n);
+}
+
+const char *scan_esc_or_bel(const char *s, size_t n) { return scan_forward(s, n, SCAN_ESC_OR_BEL, NULL); }
+
+const char *scan_csi_final(const char *s, size_t n) { return scan_forward(s, n, SCAN_CSI_FINAL, NULL); }
+
+const char *scan_any4(const char *s, size_t n, const char *accept, size_t accept_len) {
+    if (accept_len == 0) {
+        return NULL;
+    }
+    scan_args a;
+    for (size_t i = 0; i < 4; i++) {
+        a.accept[i] = (unsigned char)accept[i < accept_len ? i : 0];
+    }
+    return scan_forward(s, n, SCAN_ANY4, &a);
+}
+
+const char *scan_non_ascii(const char *s, size_t n) { return scan_forward(s, n, SCAN_NON_ASCII, NULL); }
+
+const char *scan_last_esc(const char *s, size_t n) {
+    size_t i = n;
+#if BLOCK
+    vec esc = vsplat(0x1b);
+    for (; i >= BLOCK; i -= BLOCK) {
+        uint64_t m = vmask(veq(vload(s + i - BLOCK), esc));
+        if (m) {
+            return s + i - BLOCK + (63 - __builtin_clzll(m)) / MASK_BITS;
+        }
+    }
+#endif
+    while (i > 0) {
+        if (s[--i] == 0x1b) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
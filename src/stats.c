@@ -0,0 +1,81 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "stats.h"
+#include <string.h>
+
+enum { SUB = 1 << HIST_SUB_BITS };
+
+static inline int bucket(uint64_t v) {
+    if (v < SUB) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int i = ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) | (int)((v >> (msb - HIST_SUB_BITS)) & (SUB - 1));
+    return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+// Largest value falling in bucket i.
+static inline uint64_t bucket_max(int i) {
+    if (i < SUB) {
+        return (uint64_t)i;
+    }
+    int shift = (i >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)(SUB + (i & (SUB - 1))) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_add(histogram *h, uint64_t v) {
+    if (h->count == 0 || v < h->min) {
+        h->min = v;
+    }
+    if (v > h->max) {
+        h->max = v;
+    }
+    h->count++;
+    h->sum += v;
+    h->buckets[bucket(v)]++;
+}
+
+void hist_reset(histogram *h) { memset(h, 0, sizeof(*h)); }
+
+void hist_merge(histogram *dst, const histogram *src) {
+    if (src->count == 0) {
+        return;
+    }
+    if (dst->count == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+uint64_t hist_quantile(const histogram *h, double q) {
+    if (h->count == 0) {
+        return 0;
+    }
+    // Rank of the sample at q, 1 based.
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+    rank = rank < 1 ? 1 : rank > h->count ? h->count : rank;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
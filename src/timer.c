@@ -8,6 +8,7 @@
  * Licensed under Apache-2.0 (see LICENSE).
  */
 #include "timer.h"
+#include <errno.h>
 #include <time.h>
 
 #if __APPLE__
@@ -34,6 +35,7 @@ uint64_t now_ns(void) {
 }
 
 void sleep_until_ns(uint64_t deadline) {
+#if __APPLE__
     for (;;) {
         uint64_t now = now_ns();
         if (now >= deadline)
@@ -46,4 +48,10 @@ void sleep_until_ns(uint64_t deadline) {
         };
         nanosleep(&ts, NULL);
     }
+#else
+    // Absolute deadline on the now_ns() clock: no drift from the time spent computing a delta.
+    struct timespec ts = {.tv_sec = deadline / 1000000000ull, .tv_nsec = deadline % 1000000000ull};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+#endif
 }
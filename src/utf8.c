@@ -0,0 +1,270 @@
+/**
+ * ansipixels-c:
+ * A C library for rendering fast Terminal User Interfaces (TUIs)
+ * using ANSI codes. Inspired by the Go library
+ * https://pkg.go.dev/fortio.org/terminal/ansipixels
+ *
+ * (C) 2026 Laurent Demailly <ldemailly at gmail> and contributors.
+ * Licensed under Apache-2.0 (see LICENSE).
+ */
+#include "utf8.h"
+#include "log.h"
+#include "scan.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8_width.h"
+
+// Length of the valid sequence at s, 0 if it's invalid, -1 if s[0..n) is a
+// valid but incomplete start of one.
+static int seq_len(const unsigned char *s, size_t n) {
+    unsigned c = s[0];
+    if (c < 0x80) {
+        return 1;
+    }
+    int l;
+    unsigned lo = 0x80, hi = 0xBF; // range of the second byte.
+    if (c >= 0xC2 && c <= 0xDF) {
+        l = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        l = 3;
+        lo = c == 0xE0 ? 0xA0 : lo; // overlong
+        hi = c == 0xED ? 0x9F : hi; // surrogates
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        l = 4;
+        lo = c == 0xF0 ? 0x90 : lo; // overlong
+        hi = c == 0xF4 ? 0x8F : hi; // above U+10FFFF
+    } else {
+        return 0; // continuation byte, overlong 2 bytes lead or past F4.
+    }
+    for (int i = 1; i < l; i++) {
+        if ((size_t)i >= n) {
+            return -1;
+        }
+        if (s[i] < lo || s[i] > hi) {
+            return 0;
+        }
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    return l;
+}
+
+uint32_t utf8_decode(const unsigned char *s, size_t n, size_t *len) {
+    int l = seq_len(s, n);
+    *len = 1;
+    if (l == 1) {
+        return s[0];
+    }
+    if (l <= 0) {
+        return 0xFFFD;
+    }
+    uint32_t c = s[0] & (0x7F >> l);
+    for (int i = 1; i < l; i++) {
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    *len = (size_t)l;
+    return c;
+}
+
+size_t utf8_valid(const char *s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        const char *p = scan_non_ascii(s + i, n - i);
+        if (p == NULL) {
+            return n;
+        }
+        i = (size_t)(p - s);
+        int l = seq_len((const unsigned char *)p, n - i);
+        if (l <= 0) {
+            return i;
+        }
+        i += (size_t)l;
+    }
+    return n;
+}
+
+size_t utf8_partial(const char *s, size_t n) {
+    const unsigned char *u = (const unsigned char *)s;
+    // The last sequence starts at most 3 continuation bytes before the end.
+    size_t i = n;
+    while (i > 0 && n - i < 4 && (u[i - 1] & 0xC0) == 0x80) {
+        i--;
+    }
+    if (i == 0 || n - i >= 4) {
+        return 0;
+    }
+    i--; // the lead (or ASCII) byte.
+    return seq_len(u + i, n - i) < 0 ? n - i : 0;
+}
+
+int utf8_width(uint32_t c) {
+    if (c >= 0x110000) {
+        return 1;
+    }
+    return (utf8_width_blocks[utf8_width_index[c >> 8]][(c & 0xFF) >> 2] >> (2 * (c & 3))) & 3;
+}
+
+// Zero width format characters that aren't extending the previous cluster (UAX #29 Control).
+static inline bool is_zw_control(uint32_t c) {
+    return c == 0x200B || c == 0x200E || c == 0x200F || (c >= 0x2028 && c <= 0x202E) || (c >= 0x2060 && c <= 0x206F) ||
+           c == 0xFEFF;
+}
+
+static inline bool is_regional_indicator(uint32_t c) { return c >= 0x1F1E6 && c <= 0x1F1FF; }
+
+// Extended_Pictographic, approximated with the symbol and emoji blocks.
+static inline bool is_pictographic(uint32_t c) {
+    return (c >= 0x2190 && c <= 0x2BFF) || (c >= 0x1F000 && c <= 0x1FAFF);
+}
+
+size_t utf8_grapheme(const char *s, size_t n, int *width) {
+    const unsigned char *p = (const unsigned char *)s;
+    if (p[0] < 0x80 && (n == 1 || p[1] < 0x80)) {
+        *width = 1; // ASCII followed by ASCII: no extension possible.
+        return 1;
+    }
+    size_t len;
+    uint32_t c = utf8_decode(p, n, &len);
+    int w = utf8_width(c);
+    if (c < 0x20 || (c >= 0x7F && c < 0xA0) || is_zw_control(c)) {
+        *width = is_zw_control(c) ? 0 : 1;
+        return len;
+    }
+    bool flag = is_regional_indicator(c); // waiting for the second half of a flag.
+    uint32_t prev = c;
+    size_t i = len;
+    while (i < n) {
+        size_t l;
+        uint32_t next = utf8_decode(p + i, n - i, &l);
+        if (flag && is_regional_indicator(next)) {
+            flag = false;
+            w = 2;
+        } else if (next == 0xFE0F) {
+            w = w ? 2 : 0; // emoji presentation.
+        } else if (next == 0xFE0E) {
+            w = w ? 1 : 0; // text presentation.
+        } else if (!(prev == 0x200D && is_pictographic(next)) && (utf8_width(next) != 0 || is_zw_control(next))) {
+            break;
+        }
+        prev = next;
+        i += l;
+    }
+    *width = w;
+    return i;
+}
+
+int utf8_str_width(string s) {
+    int total = 0;
+    for (size_t i = 0; i < s.size;) {
+        int w;
+        i += utf8_grapheme(s.data + i, s.size - i, &w);
+        total += w;
+    }
+    return total;
+}
+
+// --- Interned clusters: fixed size entries in pages that never move (so
+// cluster_string needs no lock), deduplicated by an open addressing hash index.
+
+enum {
+    CLUSTER_PAGE = 4096,                        // entries per page.
+    CLUSTER_PAGES = 256,                        // so at most 1M clusters.
+    CLUSTER_IDS = CLUSTER_PAGE * CLUSTER_PAGES, // fits in the glyph's low bits.
+};
+
+typedef struct cluster_entry {
+    uint8_t len;
+    char data[CLUSTER_MAX];
+} cluster_entry;
+
+static struct {
+    pthread_mutex_t lock;
+    cluster_entry *pages[CLUSTER_PAGES];
+    uint32_t count;
+    uint32_t *index; // ids + 1 (0 for empty), index_size a power of 2.
+    uint32_t index_size;
+    bool full_logged;
+} clusters = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline cluster_entry *cluster_entry_at(uint32_t id) {
+    return &clusters.pages[id / CLUSTER_PAGE][id % CLUSTER_PAGE];
+}
+
+static uint32_t cluster_hash(const char *s, size_t n) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool cluster_index_grow(void) {
+    uint32_t size = clusters.index_size ? 2 * clusters.index_size : 1024;
+    uint32_t *index = calloc(size, sizeof(uint32_t));
+    if (index == NULL) {
+        return false;
+    }
+    for (uint32_t id = 0; id < clusters.count; id++) {
+        cluster_entry *e = cluster_entry_at(id);
+        uint32_t slot = cluster_hash(e->data, e->len) & (size - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        index[slot] = id + 1;
+    }
+    free(clusters.index);
+    clusters.index = index;
+    clusters.index_size = size;
+    return true;
+}
+
+// Id of s[0..n), added if needed, or -1 on failure. Called with the lock held.
+static int64_t cluster_find_or_add(const char *s, size_t n) {
+    if (2 * (clusters.count + 1) > clusters.index_size && !cluster_index_grow()) {
+        return -1;
+    }
+    uint32_t mask = clusters.index_size - 1, slot = cluster_hash(s, n) & mask;
+    for (; clusters.index[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t id = clusters.index[slot] - 1;
+        cluster_entry *e = cluster_entry_at(id);
+        if (e->len == n && memcmp(e->data, s, n) == 0) {
+            return id;
+        }
+    }
+    uint32_t id = clusters.count;
+    cluster_entry **page = &clusters.pages[id / CLUSTER_PAGE];
+    if (id == CLUSTER_IDS || (*page == NULL && (*page = malloc(CLUSTER_PAGE * sizeof(cluster_entry))) == NULL)) {
+        if (!clusters.full_logged) {
+            LOG_ERROR("Can't intern more grapheme clusters (%u)", id);
+            clusters.full_logged = true;
+        }
+        return -1;
+    }
+    cluster_entry *e = cluster_entry_at(id);
+    e->len = (uint8_t)n;
+    memcpy(e->data, s, n);
+    clusters.index[slot] = id + 1;
+    clusters.count++;
+    return id;
+}
+
+uint32_t cluster_intern(const char *s, size_t n, int width) {
+    if (n > CLUSTER_MAX) {
+        return 0;
+    }
+    pthread_mutex_lock(&clusters.lock);
+    int64_t id = cluster_find_or_add(s, n);
+    pthread_mutex_unlock(&clusters.lock);
+    if (id < 0) {
+        return 0;
+    }
+    return CLUSTER_GLYPH | (width == 2 ? CLUSTER_WIDE : 0) | (uint32_t)id;
+}
+
+string cluster_string(uint32_t glyph) {
+    const cluster_entry *e = cluster_entry_at(glyph & (CLUSTER_IDS - 1));
+    return (string){e->data, e->len};
+}